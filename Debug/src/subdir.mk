@@ -4,8 +4,13 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/AvroWriter.cpp \
 ../src/CommandBuffer.cpp \
+../src/Compressor.cpp \
 ../src/DatabaseEnvironment.cpp \
+../src/FileWriter.cpp \
+../src/JsonString.cpp \
+../src/JsonWriter.cpp \
 ../src/KafkaWriter.cpp \
 ../src/MemoryException.cpp \
 ../src/OpCode.cpp \
@@ -28,24 +33,35 @@ CPP_SRCS += \
 ../src/OpenLogReplicator.cpp \
 ../src/OracleColumn.cpp \
 ../src/OracleEnvironment.cpp \
+../src/OracleNumber.cpp \
 ../src/OracleObject.cpp \
 ../src/OracleReader.cpp \
 ../src/OracleReaderRedo.cpp \
 ../src/OracleStatement.cpp \
+../src/OracleTime.cpp \
+../src/OutputBuffer.cpp \
 ../src/RedisWriter.cpp \
 ../src/RedoLogException.cpp \
 ../src/RedoLogRecord.cpp \
+../src/ShmWriter.cpp \
+../src/SinkWriter.cpp \
 ../src/Thread.cpp \
 ../src/Transaction.cpp \
 ../src/TransactionBuffer.cpp \
 ../src/TransactionChunk.cpp \
-../src/TransactionHeap.cpp \
+../src/TransactionSerializer.cpp \
+../src/TransactionTracker.cpp \
 ../src/TransactionMap.cpp \
 ../src/Writer.cpp 
 
 OBJS += \
+./src/AvroWriter.o \
 ./src/CommandBuffer.o \
+./src/Compressor.o \
 ./src/DatabaseEnvironment.o \
+./src/FileWriter.o \
+./src/JsonString.o \
+./src/JsonWriter.o \
 ./src/KafkaWriter.o \
 ./src/MemoryException.o \
 ./src/OpCode.o \
@@ -68,24 +84,35 @@ OBJS += \
 ./src/OpenLogReplicator.o \
 ./src/OracleColumn.o \
 ./src/OracleEnvironment.o \
+./src/OracleNumber.o \
 ./src/OracleObject.o \
 ./src/OracleReader.o \
 ./src/OracleReaderRedo.o \
 ./src/OracleStatement.o \
+./src/OracleTime.o \
+./src/OutputBuffer.o \
 ./src/RedisWriter.o \
 ./src/RedoLogException.o \
 ./src/RedoLogRecord.o \
+./src/ShmWriter.o \
+./src/SinkWriter.o \
 ./src/Thread.o \
 ./src/Transaction.o \
 ./src/TransactionBuffer.o \
 ./src/TransactionChunk.o \
-./src/TransactionHeap.o \
+./src/TransactionSerializer.o \
+./src/TransactionTracker.o \
 ./src/TransactionMap.o \
 ./src/Writer.o 
 
 CPP_DEPS += \
+./src/AvroWriter.d \
 ./src/CommandBuffer.d \
+./src/Compressor.d \
 ./src/DatabaseEnvironment.d \
+./src/FileWriter.d \
+./src/JsonString.d \
+./src/JsonWriter.d \
 ./src/KafkaWriter.d \
 ./src/MemoryException.d \
 ./src/OpCode.d \
@@ -108,18 +135,24 @@ CPP_DEPS += \
 ./src/OpenLogReplicator.d \
 ./src/OracleColumn.d \
 ./src/OracleEnvironment.d \
+./src/OracleNumber.d \
 ./src/OracleObject.d \
 ./src/OracleReader.d \
 ./src/OracleReaderRedo.d \
 ./src/OracleStatement.d \
+./src/OracleTime.d \
+./src/OutputBuffer.d \
 ./src/RedisWriter.d \
 ./src/RedoLogException.d \
 ./src/RedoLogRecord.d \
+./src/ShmWriter.d \
+./src/SinkWriter.d \
 ./src/Thread.d \
 ./src/Transaction.d \
 ./src/TransactionBuffer.d \
 ./src/TransactionChunk.d \
-./src/TransactionHeap.d \
+./src/TransactionSerializer.d \
+./src/TransactionTracker.d \
 ./src/TransactionMap.d \
 ./src/Writer.d 
 
@@ -0,0 +1,87 @@
+/* Microbenchmark of TransactionMap set/erase/getMatch
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+//build: g++ -std=c++1y -O2 -Isrc bench/TransactionMapBench.cpp src/TransactionMap.cpp src/MemoryException.cpp -o TransactionMapBench
+//usage: TransactionMapBench [open transactions] [operations]
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include "types.h"
+#include "TransactionMap.h"
+
+using namespace std;
+using namespace OpenLogReplicator;
+
+struct BenchKey {
+    typeuba uba;
+    uint32_t dba;
+    uint8_t slt;
+    uint8_t rci;
+};
+
+static uint64_t benchRandom(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static BenchKey benchKey(uint64_t &state) {
+    BenchKey key;
+    key.uba = benchRandom(state) | 1;
+    key.dba = benchRandom(state);
+    key.slt = benchRandom(state);
+    key.rci = benchRandom(state);
+    return key;
+}
+
+int main(int argc, char **argv) {
+    uint32_t open = (argc > 1) ? atoi(argv[1]) : 10000;
+    uint64_t operations = (argc > 2) ? atoll(argv[2]) : 10000000;
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+    //only pointer values are stored, the map never dereferences them
+    vector<BenchKey> keys;
+    TransactionMap map;
+    for (uint32_t i = 0; i < open; ++i) {
+        keys.push_back(benchKey(state));
+        map.set(keys[i].uba, keys[i].dba, keys[i].slt, keys[i].rci, (Transaction*)(uintptr_t)(i + 1));
+    }
+
+    //every step moves the last operation of one transaction: lookup, erase of the old key, set of the new one
+    uint64_t found = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < operations; ++i) {
+        uint32_t pos = benchRandom(state) % open;
+        BenchKey &key = keys[pos];
+        if (map.getMatch(key.uba, key.dba, key.slt, key.rci) != nullptr)
+            ++found;
+        map.erase(key.uba, key.dba, key.slt, key.rci);
+        key = benchKey(state);
+        map.set(key.uba, key.dba, key.slt, key.rci, (Transaction*)(uintptr_t)(pos + 1));
+    }
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    double ns = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    cout << "open: " << dec << open << ", operations: " << operations << ", found: " << found <<
+            ", ns per getMatch+erase+set: " << (ns / operations) << endl;
+    return (found == operations) ? 0 : 1;
+}
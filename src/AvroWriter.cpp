@@ -0,0 +1,431 @@
+/* Formatter of transactions as Avro encoded messages
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <set>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include "types.h"
+#include "AvroWriter.h"
+#include "CommandBuffer.h"
+#include "OracleColumn.h"
+#include "OracleNumber.h"
+#include "OracleObject.h"
+#include "OracleTime.h"
+#include "RedoLogRecord.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    static const string avroEventSchema =
+            "{\"name\":\"OpenLogReplicator.Event\",\"type\":\"record\",\"fields\":["
+            "{\"name\":\"event\",\"type\":{\"name\":\"OpenLogReplicator.EventType\",\"type\":\"enum\",\"symbols\":[\"BEGIN\",\"COMMIT\",\"ROLLBACK\",\"TRUNCATE\",\"SAVEPOINT\",\"PARTIAL_COMMIT\"]}},"
+            "{\"name\":\"scn\",\"type\":\"long\"},"
+            "{\"name\":\"xid\",\"type\":\"long\"},"
+            "{\"name\":\"uba\",\"type\":\"long\"},"
+            "{\"name\":\"table\",\"type\":\"string\"}]}";
+
+    AvroWriter::AvroWriter(const string alias, CommandBuffer *commandBuffer, uint32_t format, bool markers, const string schemaDir) :
+        JsonWriter(alias, commandBuffer, format, markers),
+        schemaDir(schemaDir.c_str()),
+        eventFingerprint(fingerprint(avroEventSchema)),
+        eventSchemaWritten(false),
+        rowType(0),
+        rowObject(nullptr),
+        rowObjn(0),
+        rowObjd(0),
+        rowAfn(0),
+        rowBdba(0),
+        rowSlot(0),
+        image(nullptr) {
+        before.present = false;
+        after.present = false;
+    }
+
+    AvroWriter::~AvroWriter() {
+        for (auto it : schemas)
+            delete it.second;
+        schemas.clear();
+    }
+
+    //formatter writing to other buffer
+    Writer *AvroWriter::clone(CommandBuffer *commandBuffer) {
+        return new AvroWriter(alias, commandBuffer, format, markers, schemaDir);
+    }
+
+    //CRC-64-AVRO
+    uint64_t AvroWriter::fingerprint(const string &text) {
+        static uint64_t table[256];
+        static bool tableReady = false;
+        const uint64_t empty = 0xC15D213AA4D7A795;
+
+        if (!tableReady) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint64_t fp = i;
+                for (uint32_t j = 0; j < 8; ++j)
+                    fp = (fp >> 1) ^ (empty & -(fp & 1));
+                table[i] = fp;
+            }
+            tableReady = true;
+        }
+
+        uint64_t fp = empty;
+        for (uint8_t chr : text)
+            fp = (fp >> 8) ^ table[(fp ^ chr) & 0xFF];
+        return fp;
+    }
+
+    //Avro names allow only letters, digits and underscore
+    string AvroWriter::avroName(const string &name) {
+        string ret = name;
+        for (uint32_t i = 0; i < ret.length(); ++i)
+            if (!isalnum(ret[i]) && ret[i] != '_')
+                ret[i] = '_';
+        if (ret.length() == 0 || isdigit(ret[0]))
+            ret = "_" + ret;
+        return ret;
+    }
+
+    AvroSchema *AvroWriter::getSchema(OracleObject *object) {
+        auto it = schemas.find(object);
+        if (it != schemas.end())
+            return it->second;
+
+        AvroSchema *schema = new AvroSchema();
+        for (uint32_t i = 0; i < object->columns.size(); ++i) {
+            schema->typeNos.push_back(object->columns[i]->typeNo);
+            switch (object->columns[i]->typeNo) {
+            case 2: //numeric
+                schema->columnTypes.push_back(AVRO_COLUMN_NUMBER);
+                break;
+            case ORACLE_TYPE_DATE:
+            case ORACLE_TYPE_TIMESTAMP:
+            case ORACLE_TYPE_TIMESTAMP_TZ:
+            case ORACLE_TYPE_TIMESTAMP_LTZ:
+                schema->columnTypes.push_back(AVRO_COLUMN_TIMESTAMP);
+                break;
+            case ORACLE_TYPE_INTERVAL_YM:
+            case ORACLE_TYPE_INTERVAL_DS:
+                schema->columnTypes.push_back(AVRO_COLUMN_INTERVAL);
+                break;
+            case 1: //varchar(2)
+            case 96: //char
+                schema->columnTypes.push_back(AVRO_COLUMN_STRING);
+                break;
+            default:
+                schema->columnTypes.push_back(AVRO_COLUMN_BYTES);
+            }
+        }
+
+        schema->fingerprint = fingerprint(schemaText(object, schema, true));
+        if (schemaDir.length() > 0)
+            writeSchema(avroName(object->owner) + "." + avroName(object->objectName), schema->fingerprint,
+                    schemaText(object, schema, false));
+        schemas[object] = schema;
+        return schema;
+    }
+
+    //canonical form has only full names and no logical types
+    string AvroWriter::schemaText(OracleObject *object, AvroSchema *schema, bool canonical) {
+        string name = avroName(object->owner) + "." + avroName(object->objectName);
+        string text = "{\"name\":\"" + name + "\",\"type\":\"record\",\"fields\":["
+                "{\"name\":\"op\",\"type\":{\"name\":\"OpenLogReplicator.Operation\",\"type\":\"enum\",\"symbols\":[\"INSERT\",\"DELETE\",\"UPDATE\"]}},"
+                "{\"name\":\"scn\",\"type\":\"long\"},"
+                "{\"name\":\"xid\",\"type\":\"long\"},"
+                "{\"name\":\"seq\",\"type\":\"long\"},"
+                "{\"name\":\"provisional\",\"type\":\"boolean\"},"
+                "{\"name\":\"rowid\",\"type\":\"string\"},"
+                "{\"name\":\"before\",\"type\":[\"null\",{\"name\":\"" + name + "_row\",\"type\":\"record\",\"fields\":[";
+
+        set<string> names;
+        for (uint32_t i = 0; i < object->columns.size(); ++i) {
+            string columnName = avroName(object->columns[i]->columnName);
+            if (names.find(columnName) != names.end())
+                columnName += "_" + to_string(i);
+            names.insert(columnName);
+
+            if (i > 0)
+                text += ",";
+            text += "{\"name\":\"" + columnName + "\",\"type\":[\"null\",";
+            switch (schema->columnTypes[i]) {
+            case AVRO_COLUMN_NUMBER:
+                text += "\"long\",\"string\"";
+                break;
+            case AVRO_COLUMN_TIMESTAMP:
+                if (canonical)
+                    text += "\"long\"";
+                else
+                    text += "{\"type\":\"long\",\"logicalType\":\"timestamp-micros\"}";
+                break;
+            case AVRO_COLUMN_STRING:
+            case AVRO_COLUMN_INTERVAL:
+                text += "\"string\"";
+                break;
+            default:
+                text += "\"bytes\"";
+            }
+            text += "]}";
+        }
+
+        text += "]}]},{\"name\":\"after\",\"type\":[\"null\",\"" + name + "_row\"]}]}";
+        return text;
+    }
+
+    //schema file: <schemadir>/<name>.<fingerprint>.avsc, replaced atomically
+    void AvroWriter::writeSchema(const string &name, uint64_t fingerprint, const string &text) {
+        char fingerprintHex[17];
+        snprintf(fingerprintHex, sizeof(fingerprintHex), "%016llx", (unsigned long long)fingerprint);
+        string fileName = schemaDir + "/" + name + "." + fingerprintHex + ".avsc";
+        string tmpName = fileName + ".XXXXXX";
+        char *tmpNameTemplate = new char[tmpName.length() + 1];
+        strcpy(tmpNameTemplate, tmpName.c_str());
+
+        int fd = mkstemp(tmpNameTemplate);
+        if (fd == -1) {
+            cerr << "ERROR: can't write Avro schema: " << fileName << endl;
+            delete[] tmpNameTemplate;
+            return;
+        }
+        bool ok = (write(fd, text.c_str(), text.length()) == (ssize_t)text.length());
+        close(fd);
+        if (!ok || rename(tmpNameTemplate, fileName.c_str()) != 0) {
+            cerr << "ERROR: can't write Avro schema: " << fileName << endl;
+            unlink(tmpNameTemplate);
+        }
+        delete[] tmpNameTemplate;
+    }
+
+    //zigzag varint
+    void AvroWriter::appendLong(int64_t val) {
+        uint64_t n = ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+        uint8_t buffer[10];
+        uint32_t length = 0;
+        while (n >= 0x80) {
+            buffer[length++] = (n & 0x7F) | 0x80;
+            n >>= 7;
+        }
+        buffer[length++] = n;
+        commandBuffer->append(buffer, length);
+    }
+
+    void AvroWriter::appendString(const uint8_t *data, uint32_t length) {
+        appendLong(length);
+        commandBuffer->append(data, length);
+    }
+
+    //single object encoding: marker and little endian schema fingerprint
+    void AvroWriter::appendHeader(uint64_t fingerprint) {
+        uint8_t buffer[10];
+        buffer[0] = 0xC3;
+        buffer[1] = 0x01;
+        for (uint32_t i = 0; i < 8; ++i)
+            buffer[2 + i] = (fingerprint >> (i * 8)) & 0xFF;
+        commandBuffer->append(buffer, sizeof(buffer));
+    }
+
+    void AvroWriter::appendEvent(uint32_t event, typescn scn, typexid xid, typeuba uba, OracleObject *object) {
+        if (!eventSchemaWritten && schemaDir.length() > 0)
+            writeSchema("OpenLogReplicator.Event", eventFingerprint, avroEventSchema);
+        eventSchemaWritten = true;
+
+        appendHeader(eventFingerprint);
+        appendLong(event);
+        appendLong(scn);
+        appendLong(xid);
+        appendLong(uba);
+        if (object != nullptr)
+            appendString((const uint8_t*)object->fullName.c_str(), object->fullName.length());
+        else
+            appendLong(0);
+    }
+
+    void AvroWriter::appendImage(AvroSchema *schema, AvroImage &avroImage) {
+        if (!avroImage.present) {
+            appendLong(0);
+            return;
+        }
+
+        appendLong(1);
+        for (uint32_t i = 0; i < schema->columnTypes.size(); ++i) {
+            if (i >= avroImage.records.size() || avroImage.records[i] == nullptr)
+                appendLong(0);
+            else
+                appendAvroValue(schema->columnTypes[i], schema->typeNos[i], avroImage.records[i], avroImage.fieldPos[i], avroImage.fieldLength[i]);
+        }
+    }
+
+    //union branch and value
+    void AvroWriter::appendAvroValue(uint32_t columnType, uint32_t typeNo, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength) {
+        uint8_t *data = redoLogRecord->data + fieldPos;
+        int64_t val;
+
+        switch (columnType) {
+        case AVRO_COLUMN_NUMBER:
+            if (OracleNumber::decode(data, fieldLength, val)) {
+                appendLong(1);
+                appendLong(val);
+            } else {
+                uint8_t buffer[AVRO_NUMBER_LENGTH_MAX];
+                uint32_t length = OracleNumber::length(data, fieldLength);
+                if (length == 0 || length > AVRO_NUMBER_LENGTH_MAX || OracleNumber::format(data, fieldLength, buffer) != length) {
+                    cerr << "ERROR: unknown value (type: 2), length: " << dec << fieldLength << endl;
+                    appendLong(0);
+                } else {
+                    appendLong(2);
+                    appendString(buffer, length);
+                }
+            }
+            break;
+
+        case AVRO_COLUMN_TIMESTAMP:
+            if (OracleTime::decode(data, fieldLength, val)) {
+                appendLong(1);
+                appendLong(val);
+            } else {
+                cerr << "ERROR: unknown value (type: 12/180/181/231), length: " << dec << fieldLength << endl;
+                appendLong(0);
+            }
+            break;
+
+        case AVRO_COLUMN_INTERVAL: {
+                uint8_t buffer[ORACLE_TIME_LENGTH_MAX];
+                uint32_t length = OracleTime::format(typeNo, data, fieldLength, buffer);
+                if (length == 0) {
+                    cerr << "ERROR: unknown value (type: " << dec << typeNo << "), length: " << dec << fieldLength << endl;
+                    appendLong(0);
+                } else {
+                    appendLong(1);
+                    appendString(buffer, length);
+                }
+            }
+            break;
+
+        default:
+            appendLong(1);
+            appendString(data, fieldLength);
+        }
+    }
+
+    void AvroWriter::beginTran(typescn scn, typexid xid) {
+        commandBuffer->beginTran();
+    }
+
+    void AvroWriter::beginProvisional(typescn scn, typexid xid) {
+        commandBuffer->beginTran();
+    }
+
+    void AvroWriter::beginMarker(typescn scn, typexid xid) {
+        commandBuffer->beginTran();
+        appendEvent(AVRO_EVENT_BEGIN, scn, xid, 0, nullptr);
+        commandBuffer->commitTran();
+    }
+
+    void AvroWriter::endTran(typescn scn, typexid xid, bool rollback, bool partial) {
+        uint32_t event = AVRO_EVENT_COMMIT;
+        if (rollback)
+            event = AVRO_EVENT_ROLLBACK;
+        else if (partial)
+            event = AVRO_EVENT_PARTIAL_COMMIT;
+
+        commandBuffer->beginTran();
+        appendEvent(event, scn, xid, 0, nullptr);
+        commandBuffer->commitTran();
+    }
+
+    void AvroWriter::rollbackSavepoint(typescn scn, typexid xid, typeuba uba) {
+        commandBuffer->beginTran();
+        appendEvent(AVRO_EVENT_SAVEPOINT, scn, xid, uba, nullptr);
+        commandBuffer->commitTran();
+    }
+
+    //rows follow each other without separator
+    void AvroWriter::next() {
+    }
+
+    void AvroWriter::commitTran() {
+        commandBuffer->commitTran();
+    }
+
+    void AvroWriter::appendRowBegin(uint32_t type, OracleObject *object, uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot) {
+        rowType = type;
+        rowObject = object;
+        rowObjn = objn;
+        rowObjd = objd;
+        rowAfn = afn;
+        rowBdba = bdba;
+        rowSlot = slot;
+        before.present = false;
+        after.present = false;
+        image = nullptr;
+    }
+
+    void AvroWriter::appendRowEnd() {
+        AvroSchema *schema = getSchema(rowObject);
+
+        appendHeader(schema->fingerprint);
+        //enum index: insert, delete, update
+        appendLong(rowType - TRANSACTION_INSERT);
+        appendLong(tranScn);
+        appendLong(tranXid);
+        appendLong(tranSeq);
+        commandBuffer
+                ->append((char)(tranProvisional ? 1 : 0))
+                ->append((char)(18 << 1))
+                ->appendRowid(rowObjn, rowObjd, rowAfn, rowBdba, rowSlot);
+
+        appendImage(schema, before);
+        appendImage(schema, after);
+    }
+
+    void AvroWriter::appendImageBegin(bool after) {
+        image = after ? &this->after : &before;
+        image->present = true;
+        image->records.assign(rowObject->columns.size(), nullptr);
+        image->fieldPos.assign(rowObject->columns.size(), 0);
+        image->fieldLength.assign(rowObject->columns.size(), 0);
+    }
+
+    void AvroWriter::appendImageEnd() {
+        image = nullptr;
+    }
+
+    //values are encoded in column order when the row is complete
+    void AvroWriter::appendColumn(OracleObject *object, uint32_t colNum, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength,
+            bool &prevValue) {
+        if (image == nullptr || colNum >= image->records.size())
+            return;
+
+        if (redoLogRecord == nullptr || fieldLength == 0)
+            image->records[colNum] = nullptr;
+        else {
+            image->records[colNum] = redoLogRecord;
+            image->fieldPos[colNum] = fieldPos;
+            image->fieldLength[colNum] = fieldLength;
+        }
+    }
+
+    void AvroWriter::appendTruncate(OracleObject *object) {
+        appendEvent(AVRO_EVENT_TRUNCATE, tranScn, tranXid, 0, object);
+    }
+}
@@ -0,0 +1,123 @@
+/* Header for AvroWriter class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "types.h"
+#include "JsonWriter.h"
+
+#ifndef AVROWRITER_H_
+#define AVROWRITER_H_
+
+#define AVRO_COLUMN_NUMBER 0
+#define AVRO_COLUMN_TIMESTAMP 1
+#define AVRO_COLUMN_STRING 2
+#define AVRO_COLUMN_BYTES 3
+#define AVRO_COLUMN_INTERVAL 4
+
+#define AVRO_EVENT_BEGIN 0
+#define AVRO_EVENT_COMMIT 1
+#define AVRO_EVENT_ROLLBACK 2
+#define AVRO_EVENT_TRUNCATE 3
+#define AVRO_EVENT_SAVEPOINT 4
+#define AVRO_EVENT_PARTIAL_COMMIT 5
+
+#define AVRO_NUMBER_LENGTH_MAX 256
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    class RedoLogRecord;
+    class CommandBuffer;
+    class OracleObject;
+
+    //writer schema of table, built once from dictionary
+    struct AvroSchema {
+        uint64_t fingerprint;                       //CRC-64-AVRO of parsing canonical form
+        vector<uint32_t> columnTypes;
+        vector<uint32_t> typeNos;                   //Oracle type of column
+    };
+
+    //one image of a row, columns are encoded in schema order when the row is complete
+    struct AvroImage {
+        bool present;
+        vector<RedoLogRecord*> records;
+        vector<uint32_t> fieldPos;
+        vector<uint32_t> fieldLength;
+    };
+
+    //Avro single object encoding, rows are parsed by JsonWriter and encoded by own append functions
+    class AvroWriter : public JsonWriter {
+    protected:
+        string schemaDir;
+        unordered_map<OracleObject*, AvroSchema*> schemas;
+        uint64_t eventFingerprint;
+        bool eventSchemaWritten;
+
+        uint32_t rowType;
+        OracleObject *rowObject;
+        uint32_t rowObjn;
+        uint32_t rowObjd;
+        uint16_t rowAfn;
+        uint32_t rowBdba;
+        uint16_t rowSlot;
+        AvroImage before;
+        AvroImage after;
+        AvroImage *image;
+
+        static uint64_t fingerprint(const string &text);
+        static string avroName(const string &name);
+        AvroSchema *getSchema(OracleObject *object);
+        string schemaText(OracleObject *object, AvroSchema *schema, bool canonical);
+        void writeSchema(const string &name, uint64_t fingerprint, const string &text);
+
+        void appendLong(int64_t val);
+        void appendString(const uint8_t *data, uint32_t length);
+        void appendHeader(uint64_t fingerprint);
+        void appendEvent(uint32_t event, typescn scn, typexid xid, typeuba uba, OracleObject *object);
+        void appendImage(AvroSchema *schema, AvroImage &avroImage);
+        void appendAvroValue(uint32_t columnType, uint32_t typeNo, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength);
+
+        virtual void appendRowBegin(uint32_t type, OracleObject *object, uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot);
+        virtual void appendRowEnd();
+        virtual void appendImageBegin(bool after);
+        virtual void appendImageEnd();
+        virtual void appendColumn(OracleObject *object, uint32_t colNum, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength,
+                bool &prevValue);
+        virtual void appendTruncate(OracleObject *object);
+
+    public:
+        virtual void beginTran(typescn scn, typexid xid);
+        virtual void beginProvisional(typescn scn, typexid xid);
+        virtual void beginMarker(typescn scn, typexid xid);
+        virtual void endTran(typescn scn, typexid xid, bool rollback, bool partial);
+        virtual void rollbackSavepoint(typescn scn, typexid xid, typeuba uba);
+        virtual void next();
+        virtual void commitTran();
+        virtual Writer *clone(CommandBuffer *commandBuffer);
+
+        AvroWriter(const string alias, CommandBuffer *commandBuffer, uint32_t format, bool markers, const string schemaDir);
+        virtual ~AvroWriter();
+    };
+}
+
+#endif
@@ -17,22 +17,74 @@ You should have received a copy of the GNU General Public License
 along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
+
 #include <iostream>
+#include <chrono>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "types.h"
 #include "CommandBuffer.h"
+#include "JsonString.h"
 #include "RedoLogRecord.h"
+#include "OracleObject.h"
+#include "OracleNumber.h"
+#include "OracleTime.h"
 
 namespace OpenLogReplicator {
 
+    CommandBufferConsumer::CommandBufferConsumer(uint64_t posStart, uint32_t lagPolicy, uint32_t id, const set<string> &tables,
+            const string &spillDir, uint32_t route, uint32_t shard, uint32_t shards) :
+            posStart(posStart),
+            posRead(posStart),
+            state(CONSUMER_ACTIVE),
+            lagPolicy(lagPolicy),
+            id(id),
+            bit(1 << id),
+            route(route),
+            shard(shard),
+            shards(shards),
+            length(0),
+            tables(tables),
+            spillDir(spillDir),
+            spillFd(-1),
+            spillRead(0),
+            spillWrite(0),
+            spillBuffer(nullptr),
+            spillBufferSize(0) {
+    }
+
+    CommandBufferConsumer::~CommandBufferConsumer() {
+        if (spillFd != -1) {
+            close(spillFd);
+            spillFd = -1;
+        }
+        if (spillBuffer != nullptr) {
+            delete[] spillBuffer;
+            spillBuffer = nullptr;
+        }
+    }
+
     CommandBuffer::CommandBuffer() :
             shutdown(false),
+            posLimit(INTRA_THREAD_BUFFER_SIZE),
+            tranMask(COMMAND_BUFFER_ALL_CONSUMERS),
+            tranMaskSet(false),
+            tranKey(0),
+            tranFlags(0),
+            tranScn(0),
+            route(MESSAGE_ROUTE_NONE),
+            readersWaiting(0),
+            writerWaiting(false),
+            consumersCount(0),
+            posStartMin(0),
+            filterBuffer(this),
+            objectMasksCount(0),
             writer(nullptr),
-            posStart(0),
+            tranObject(nullptr),
             posEnd(0),
-            posEndTmp(0),
-            posSize(0) {
+            posEndTmp(0) {
         intraThreadBuffer = new uint8_t[INTRA_THREAD_BUFFER_SIZE];
     }
 
@@ -40,160 +92,412 @@ namespace OpenLogReplicator {
         this->shutdown = true;
     }
 
-    CommandBuffer* CommandBuffer::appendEscape(const uint8_t *str, uint32_t length) {
-        if (this->shutdown)
-            return this;
+    //consumer starts at the oldest message still kept in the buffer
+    uint32_t CommandBuffer::addConsumer(uint32_t lagPolicy, const set<string> &tables, const string &spillDir, uint32_t route, uint32_t shard,
+            uint32_t shards) {
+        unique_lock<mutex> lck(mtx);
+        uint32_t count = consumersCount.load();
+        if (count >= COMMAND_BUFFER_CONSUMERS_MAX) {
+            cerr << "ERROR: too many targets for one source, max: " << dec << COMMAND_BUFFER_CONSUMERS_MAX << endl;
+            return COMMAND_BUFFER_CONSUMERS_MAX;
+        }
 
-        {
-            unique_lock<mutex> lck(mtx);
-            while (posSize > 0 && posEndTmp + length * 2 >= posStart) {
-                cerr << "WARNING, JSON buffer full, log reader suspended (1)" << endl;
-                writerCond.wait(lck);
-                if (this->shutdown)
-                    return this;
-            }
-            if (this->shutdown)
-                return this;
+        consumers[count] = new CommandBufferConsumer(posStartMin, lagPolicy, count, tables, spillDir, route, shard, shards);
+        if (route > this->route)
+            this->route = route;
+        consumersCount = count + 1;
+        return count;
+    }
+
+    //operations are divided into messages by table or row when any consumer routes them
+    uint32_t CommandBuffer::messageRoute() {
+        return filterBuffer->route;
+    }
+
+    //bits of consumers which should receive operations of the table
+    uint32_t CommandBuffer::objectMask(OracleObject *object) {
+        if (object == nullptr)
+            return COMMAND_BUFFER_ALL_CONSUMERS;
+
+        uint32_t count = filterBuffer->consumersCount.load();
+        if (count != objectMasksCount) {
+            objectMasks.clear();
+            objectMasksCount = count;
         }
 
-        if (posEndTmp + length * 2 >= INTRA_THREAD_BUFFER_SIZE) {
-            cerr << "ERROR: JSON buffer overflow (1)" << endl;
-            return this;
+        auto it = objectMasks.find(object);
+        if (it != objectMasks.end())
+            return it->second;
+
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            CommandBufferConsumer *consumer = filterBuffer->consumers[i];
+            if (consumer->tables.empty() || consumer->tables.find(object->fullName) != consumer->tables.end())
+                mask |= consumer->bit;
         }
+        objectMasks[object] = mask;
+        return mask;
+    }
 
-        while (length > 0) {
-            if (*str == '"' || *str == '\\')
-                intraThreadBuffer[posEndTmp++] = '\\';
-            intraThreadBuffer[posEndTmp++] = *(str++);
-            --length;
+    //message is sent to consumers which are interested in any of its tables
+    CommandBuffer* CommandBuffer::addObject(OracleObject *object) {
+        if (tranMaskSet) {
+            tranMask |= objectMask(object);
+            if (tranObject != object)
+                tranObject = nullptr;
+        } else {
+            tranMask = objectMask(object);
+            tranObject = object;
         }
+        tranMaskSet = true;
+        return this;
+    }
 
+    CommandBuffer* CommandBuffer::addKey(uint32_t key) {
+        if ((tranFlags & MESSAGE_FLAG_KEY) != 0)
+            tranKey = tranKey * 31 + key;
+        else
+            tranKey = key;
+        tranFlags |= MESSAGE_FLAG_KEY;
         return this;
     }
 
-    CommandBuffer* CommandBuffer::appendHex(uint64_t val, uint32_t length) {
-        static const char* digits = "0123456789abcdef";
-        if (this->shutdown)
-            return this;
+    CommandBuffer* CommandBuffer::setScn(typescn scn) {
+        tranScn = scn;
+        return this;
+    }
 
-        {
-            unique_lock<mutex> lck(mtx);
-            while (posSize > 0 && posEndTmp + length >= posStart) {
-                cerr << "WARNING, JSON buffer full, log reader suspended (2)" << endl;
-                writerCond.wait(lck);
-                if (this->shutdown)
-                    return this;
+    //filter of tables and shard of the target thread
+    bool CommandBuffer::isForConsumer(CommandBufferConsumer *consumer, CommandBufferHeader *header, uint64_t pos) {
+        if ((header->mask & consumer->bit) == 0)
+            return false;
+        if (consumer->shards <= 1)
+            return true;
+
+        uint64_t hash;
+        if (consumer->route == MESSAGE_ROUTE_KEY && (header->flags & MESSAGE_FLAG_KEY) != 0)
+            hash = header->key;
+        else if (consumer->route != MESSAGE_ROUTE_NONE && header->object != nullptr)
+            hash = header->object->objn;
+        else
+            hash = pos >> 3;
+        hash *= 0x9E3779B97F4A7C15;
+        return ((hash >> 32) % consumer->shards) == consumer->shard;
+    }
+
+    //messages before pos are read, space is reclaimed when no message waits for acknowledgment
+    void CommandBuffer::advanceConsumer(CommandBufferConsumer *consumer, uint64_t pos) {
+        consumer->posRead = pos;
+        unique_lock<mutex> lck(consumer->ackMtx);
+        if (consumer->acks.empty())
+            consumer->posStart = pos;
+        else
+            consumer->acks.back().pos = pos;
+    }
+
+    //space for whole row can be reserved at once, appends below the limit don't synchronize
+    CommandBuffer* CommandBuffer::reserve(uint64_t length) {
+        if (posEndTmp + length > posLimit)
+            reserveSlow(length);
+        return this;
+    }
+
+    //position of the slowest active consumer, called with mtx locked
+    uint64_t CommandBuffer::slowestConsumer(CommandBufferConsumer *&slowest) {
+        uint32_t count = consumersCount.load();
+        uint64_t minStart = 0;
+        slowest = nullptr;
+
+        for (uint32_t i = 0; i < count; ++i) {
+            CommandBufferConsumer *consumer = consumers[i];
+            if (consumer->state.load() != CONSUMER_ACTIVE)
+                continue;
+            uint64_t start = consumer->posStart.load();
+            if (slowest == nullptr || start < minStart) {
+                minStart = start;
+                slowest = consumer;
             }
         }
 
-        if (posEndTmp + length >= INTRA_THREAD_BUFFER_SIZE) {
-            cerr << "ERROR: JSON buffer overflow (5)" << endl;
-            return this;
+        if (slowest != nullptr)
+            posStartMin = minStart;
+        return posStartMin;
+    }
+
+    bool CommandBuffer::reserveSlow(uint64_t length) {
+        uint64_t lapEnd = (posEndTmp / INTRA_THREAD_BUFFER_SIZE + 1) * INTRA_THREAD_BUFFER_SIZE;
+        if (posEndTmp + length > lapEnd) {
+            cerr << "ERROR: JSON buffer overflow" << endl;
+            return false;
         }
 
-        for (uint32_t i = 0, j = (length - 1) * 4; i < length; ++i, j -= 4)
-            intraThreadBuffer[posEndTmp + i] = digits[(val >> j) & 0xF];
-        posEndTmp += length;
+        while (!this->shutdown) {
+            CommandBufferConsumer *slowest;
+            {
+                unique_lock<mutex> lck(mtx);
+                writerWaiting = true;
+                posLimit = slowestConsumer(slowest) + INTRA_THREAD_BUFFER_SIZE;
+                if (posLimit > lapEnd)
+                    posLimit = lapEnd;
+                if (posEndTmp + length <= posLimit) {
+                    writerWaiting = false;
+                    return true;
+                }
+
+                //messages in flight are referenced by the target, consumer can't be moved to spill file or detached
+                if (slowest == nullptr || slowest->lagPolicy == CONSUMER_LAG_BLOCK ||
+                        slowest->posStart.load() < slowest->posRead.load()) {
+                    if (!this->shutdown) {
+                        cerr << "WARNING, JSON buffer full, log reader suspended" << endl;
+                        writerCond.wait(lck);
+                    }
+                    writerWaiting = false;
+                    continue;
+                }
+                writerWaiting = false;
+            }
+            lagConsumer(slowest);
+        }
+        posLimit = posEndTmp;
+        return false;
+    }
 
-        return this;
+    //slowest consumer doesn't stop the producer: it is detached or continues from the spill file
+    void CommandBuffer::lagConsumer(CommandBufferConsumer *consumer) {
+        unique_lock<mutex> lck(consumer->lagMtx);
+        if (consumer->state.load() != CONSUMER_ACTIVE)
+            return;
+        //consumer read more messages meanwhile, producer waits for acknowledgment
+        if (consumer->posStart.load() < consumer->posRead.load())
+            return;
+
+        if (consumer->lagPolicy == CONSUMER_LAG_DETACH) {
+            consumer->state = CONSUMER_DETACHED;
+            cerr << "WARNING, JSON buffer full, consumer " << dec << consumer->id << " detached" << endl;
+            notifyReaders();
+            return;
+        }
+
+        cerr << "WARNING, JSON buffer full, consumer " << dec << consumer->id << " spilled to disk" << endl;
+        uint64_t pos = consumer->posRead.load(), end = posEnd.load();
+        while (pos < end && consumer->state.load() == CONSUMER_ACTIVE) {
+            CommandBufferHeader *header = (CommandBufferHeader*)(intraThreadBuffer + (pos % INTRA_THREAD_BUFFER_SIZE));
+            if (header->length == 0) {
+                pos = (pos / INTRA_THREAD_BUFFER_SIZE + 1) * INTRA_THREAD_BUFFER_SIZE;
+                continue;
+            }
+            if (isForConsumer(consumer, header, pos))
+                spillWriteFile(consumer, header);
+            pos += (header->length + 7) & 0xFFFFFFF8;
+        }
+
+        if (consumer->state.load() == CONSUMER_ACTIVE)
+            consumer->state = CONSUMER_SPILLING;
+        else
+            notifyReaders();
     }
 
-    CommandBuffer* CommandBuffer::append(const string str) {
-        if (this->shutdown)
-            return this;
+    //called with lagMtx locked
+    void CommandBuffer::spillWriteFile(CommandBufferConsumer *consumer, CommandBufferHeader *header) {
+        if (consumer->spillFd == -1) {
+            string fileName = consumer->spillDir + "/OpenLogReplicator-consumer-XXXXXX";
+            char *fileNameTemplate = new char[fileName.length() + 1];
+            strcpy(fileNameTemplate, fileName.c_str());
+            consumer->spillFd = mkstemp(fileNameTemplate);
+            //file is removed as soon as it is closed
+            if (consumer->spillFd != -1)
+                unlink(fileNameTemplate);
+            delete[] fileNameTemplate;
+
+            if (consumer->spillFd == -1) {
+                cerr << "ERROR: can't create spill file in: " << consumer->spillDir << ", consumer " << dec << consumer->id << " detached" << endl;
+                consumer->state = CONSUMER_DETACHED;
+                return;
+            }
+        }
 
-        uint32_t length = str.length();
-        {
-            unique_lock<mutex> lck(mtx);
-            while (posSize > 0 && posEndTmp + length >= posStart) {
-                cerr << "WARNING, JSON buffer full, log reader suspended (2)" << endl;
-                writerCond.wait(lck);
-                if (this->shutdown)
-                    return this;
+        uint64_t spillWrite = consumer->spillWrite.load();
+        uint8_t *data = (uint8_t*)header;
+        uint32_t length = header->length, written = 0;
+        while (written < length) {
+            ssize_t ret = pwrite(consumer->spillFd, data + written, length - written, spillWrite + written);
+            if (ret <= 0) {
+                cerr << "ERROR: can't write spill file, size: " << dec << spillWrite << ", consumer " << dec << consumer->id << " detached" << endl;
+                consumer->state = CONSUMER_DETACHED;
+                return;
             }
+            written += ret;
         }
+        consumer->spillWrite = spillWrite + length;
+    }
 
-        if (posEndTmp + length >= INTRA_THREAD_BUFFER_SIZE) {
-            cerr << "ERROR: JSON buffer overflow (2)" << endl;
-            return this;
+    //message is not published yet, consumer which read the whole spill file continues from this message
+    void CommandBuffer::spillMessage(CommandBufferConsumer *consumer, CommandBufferHeader *header) {
+        unique_lock<mutex> lck(consumer->lagMtx);
+        if (consumer->state.load() != CONSUMER_SPILLING)
+            return;
+
+        if (consumer->spillRead.load() == consumer->spillWrite.load()) {
+            if (ftruncate(consumer->spillFd, 0) != 0)
+                cerr << "WARNING: can't truncate spill file" << endl;
+            consumer->spillRead = 0;
+            consumer->spillWrite = 0;
+            consumer->posStart = posEnd.load();
+            consumer->posRead = posEnd.load();
+            consumer->state = CONSUMER_ACTIVE;
+            cerr << "WARNING, consumer " << dec << consumer->id << " read spill file, continues from JSON buffer" << endl;
+            return;
         }
 
-        memcpy(intraThreadBuffer + posEndTmp, str.c_str(), length);
-        posEndTmp += length;
+        if (isForConsumer(consumer, header, posEnd.load()))
+            spillWriteFile(consumer, header);
+    }
+
+    void CommandBuffer::notifyReaders() {
+        if (readersWaiting > 0) {
+            unique_lock<mutex> lck(mtx);
+            readersCond.notify_all();
+        }
+    }
+
+    void CommandBuffer::notifyWriter() {
+        if (writerWaiting) {
+            unique_lock<mutex> lck(mtx);
+            writerCond.notify_all();
+        }
+    }
 
+    //space is reserved for the escaped length, text without special characters is copied at once
+    CommandBuffer* CommandBuffer::appendEscape(const uint8_t *str, uint32_t length) {
+        uint32_t specials = JsonString::specials(str, length);
+        if (specials == 0)
+            return append(str, length);
+
+        uint64_t maxLength = length + (uint64_t)specials * (JSON_STRING_ESCAPE_MAX - 1);
+        if (posEndTmp + maxLength > posLimit && !reserveSlow(maxLength))
+            return this;
+
+        posEndTmp += JsonString::escape(str, length, intraThreadBuffer + (posEndTmp % INTRA_THREAD_BUFFER_SIZE));
         return this;
     }
 
-    char CommandBuffer::translationMap[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    CommandBuffer* CommandBuffer::appendHex(uint64_t val, uint32_t length) {
+        static const char* digits = "0123456789abcdef";
+        if (posEndTmp + length > posLimit && !reserveSlow(length))
+            return this;
+
+        uint8_t *buffer = intraThreadBuffer + (posEndTmp % INTRA_THREAD_BUFFER_SIZE);
+        for (uint32_t i = 0, j = (length - 1) * 4; i < length; ++i, j -= 4)
+            buffer[i] = digits[(val >> j) & 0xF];
+        posEndTmp += length;
 
-    CommandBuffer* CommandBuffer::appendRowid(uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot) {
-        append(translationMap[(objd >> 30) & 0x3F]);
-        append(translationMap[(objd >> 24) & 0x3F]);
-        append(translationMap[(objd >> 18) & 0x3F]);
-        append(translationMap[(objd >> 12) & 0x3F]);
-        append(translationMap[(objd >> 6) & 0x3F]);
-        append(translationMap[objd & 0x3F]);
-        append(translationMap[(afn >> 12) & 0x3F]);
-        append(translationMap[(afn >> 6) & 0x3F]);
-        append(translationMap[afn & 0x3F]);
-        append(translationMap[(bdba >> 30) & 0x3F]);
-        append(translationMap[(bdba >> 24) & 0x3F]);
-        append(translationMap[(bdba >> 18) & 0x3F]);
-        append(translationMap[(bdba >> 12) & 0x3F]);
-        append(translationMap[(bdba >> 6) & 0x3F]);
-        append(translationMap[bdba & 0x3F]);
-        append(translationMap[(slot >> 12) & 0x3F]);
-        append(translationMap[(slot >> 6) & 0x3F]);
-        append(translationMap[slot & 0x3F]);
         return this;
     }
 
+    //NUMBER formatted in place, false for malformed value
+    bool CommandBuffer::appendNumber(const uint8_t *data, uint32_t length) {
+        uint32_t textLength = OracleNumber::length(data, length);
+        if (textLength == 0)
+            return false;
+        if (posEndTmp + textLength > posLimit && !reserveSlow(textLength))
+            return true;
+
+        if (OracleNumber::format(data, length, intraThreadBuffer + (posEndTmp % INTRA_THREAD_BUFFER_SIZE)) != textLength)
+            return false;
+        posEndTmp += textLength;
+        return true;
+    }
 
+    //date, time or interval formatted in place, false for malformed value
+    bool CommandBuffer::appendTime(uint32_t typeNo, const uint8_t *data, uint32_t length) {
+        if (posEndTmp + ORACLE_TIME_LENGTH_MAX > posLimit && !reserveSlow(ORACLE_TIME_LENGTH_MAX))
+            return true;
 
-    CommandBuffer* CommandBuffer::append(char chr) {
-        if (this->shutdown)
+        uint32_t textLength = OracleTime::format(typeNo, data, length, intraThreadBuffer + (posEndTmp % INTRA_THREAD_BUFFER_SIZE));
+        if (textLength == 0)
+            return false;
+        posEndTmp += textLength;
+        return true;
+    }
+
+    CommandBuffer* CommandBuffer::append(const string &str) {
+        return append((const uint8_t*)str.c_str(), str.length());
+    }
+
+    CommandBuffer* CommandBuffer::append(const uint8_t *str, uint32_t length) {
+        if (posEndTmp + length > posLimit && !reserveSlow(length))
             return this;
 
-        {
-            unique_lock<mutex> lck(mtx);
-            while (posSize > 0 && posEndTmp + 1 >= posStart) {
-                cerr << "WARNING, JSON buffer full, log reader suspended (3)" << endl;
-                writerCond.wait(lck);
-                if (this->shutdown)
-                    return this;
-            }
-        }
+        memcpy(intraThreadBuffer + (posEndTmp % INTRA_THREAD_BUFFER_SIZE), str, length);
+        posEndTmp += length;
+
+        return this;
+    }
 
-        if (posEndTmp + 1 >= INTRA_THREAD_BUFFER_SIZE) {
-            cerr << "ERROR: JSON buffer overflow (3)" << endl;
+    //copy of complete transaction formatted in other buffer
+    CommandBuffer* CommandBuffer::appendTran(CommandBufferHeader *header) {
+        rewind()
+                ->beginTran()
+                ->append((uint8_t*)header + COMMAND_BUFFER_HEADER, header->length - COMMAND_BUFFER_HEADER);
+        tranMask = header->mask;
+        tranMaskSet = true;
+        tranKey = header->key;
+        tranFlags = header->flags;
+        tranObject = header->object;
+        tranScn = header->scn;
+        return commitTran();
+    }
+
+    char CommandBuffer::translationMap[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    CommandBuffer* CommandBuffer::appendRowid(uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot) {
+        if (posEndTmp + 18 > posLimit && !reserveSlow(18))
             return this;
-        }
 
-        intraThreadBuffer[posEndTmp++] = chr;
+        uint8_t *buffer = intraThreadBuffer + (posEndTmp % INTRA_THREAD_BUFFER_SIZE);
+        buffer[0] = translationMap[(objd >> 30) & 0x3F];
+        buffer[1] = translationMap[(objd >> 24) & 0x3F];
+        buffer[2] = translationMap[(objd >> 18) & 0x3F];
+        buffer[3] = translationMap[(objd >> 12) & 0x3F];
+        buffer[4] = translationMap[(objd >> 6) & 0x3F];
+        buffer[5] = translationMap[objd & 0x3F];
+        buffer[6] = translationMap[(afn >> 12) & 0x3F];
+        buffer[7] = translationMap[(afn >> 6) & 0x3F];
+        buffer[8] = translationMap[afn & 0x3F];
+        buffer[9] = translationMap[(bdba >> 30) & 0x3F];
+        buffer[10] = translationMap[(bdba >> 24) & 0x3F];
+        buffer[11] = translationMap[(bdba >> 18) & 0x3F];
+        buffer[12] = translationMap[(bdba >> 12) & 0x3F];
+        buffer[13] = translationMap[(bdba >> 6) & 0x3F];
+        buffer[14] = translationMap[bdba & 0x3F];
+        buffer[15] = translationMap[(slot >> 12) & 0x3F];
+        buffer[16] = translationMap[(slot >> 6) & 0x3F];
+        buffer[17] = translationMap[slot & 0x3F];
+        posEndTmp += 18;
 
         return this;
     }
 
-    CommandBuffer* CommandBuffer::beginTran() {
-        if (this->shutdown)
+    CommandBuffer* CommandBuffer::append(char chr) {
+        if (posEndTmp + 1 > posLimit && !reserveSlow(1))
             return this;
 
-        {
-            unique_lock<mutex> lck(mtx);
-            while (posSize > 0 && posEndTmp + 4 >= posStart) {
-                cerr << "WARNING, JSON buffer full, log reader suspended (4)" << endl;
-                writerCond.wait(lck);
-                if (this->shutdown)
-                    return this;
-            }
-        }
+        intraThreadBuffer[posEndTmp % INTRA_THREAD_BUFFER_SIZE] = chr;
+        ++posEndTmp;
 
-        if (posEndTmp + 4 >= INTRA_THREAD_BUFFER_SIZE) {
-            cerr << "ERROR: JSON buffer overflow (4)" << endl;
+        return this;
+    }
+
+    CommandBuffer* CommandBuffer::beginTran() {
+        if (posEndTmp + COMMAND_BUFFER_HEADER > posLimit && !reserveSlow(COMMAND_BUFFER_HEADER))
             return this;
-        }
 
-        posEndTmp += 4;
+        posEndTmp += COMMAND_BUFFER_HEADER;
+        tranMask = 0;
+        tranMaskSet = false;
+        tranKey = 0;
+        tranFlags = 0;
+        tranObject = nullptr;
 
         return this;
     }
@@ -204,40 +508,38 @@ namespace OpenLogReplicator {
             return this;
         }
 
-        {
-            unique_lock<mutex> lck(mtx);
-            *((uint32_t*)(intraThreadBuffer + posEnd)) = posEndTmp - posEnd;
-            posEndTmp = (posEndTmp + 3) & 0xFFFFFFFC;
-            posEnd = posEndTmp;
+        CommandBufferHeader *header = (CommandBufferHeader*)(intraThreadBuffer + (posEnd % INTRA_THREAD_BUFFER_SIZE));
+        header->length = posEndTmp - posEnd;
+        header->mask = tranMaskSet ? tranMask : COMMAND_BUFFER_ALL_CONSUMERS;
+        header->key = tranKey;
+        header->flags = tranFlags;
+        header->object = tranMaskSet ? tranObject : nullptr;
+        header->scn = tranScn;
 
-            readersCond.notify_all();
-        }
+        uint32_t count = consumersCount.load();
+        for (uint32_t i = 0; i < count; ++i)
+            if (consumers[i]->state.load() == CONSUMER_SPILLING)
+                spillMessage(consumers[i], header);
 
-        if (posEndTmp + 1 >= INTRA_THREAD_BUFFER_SIZE) {
-            cerr << "ERROR: JSON buffer overflow (4)" << endl;
-            return this;
-        }
+        posEndTmp = (posEndTmp + 7) & 0xFFFFFFFFFFFFFFF8;
+        posEnd = posEndTmp;
+        notifyReaders();
 
         return this;
     }
 
+    //move to the beginning of the buffer when there is no space for the biggest transaction
     CommandBuffer* CommandBuffer::rewind() {
-        if (this->shutdown)
+        uint64_t lapPos = posEnd % INTRA_THREAD_BUFFER_SIZE;
+        if (lapPos < INTRA_THREAD_BUFFER_SIZE - MAX_TRANSACTION_SIZE)
             return this;
 
-        {
-            unique_lock<mutex> lck(mtx);
-            while (posSize > 0 || posStart == 0) {
-                cerr << "WARNING, JSON buffer full, log reader suspended (5)" << endl;
-                writerCond.wait(lck);
-                if (this->shutdown)
-                    return this;
-            }
-
-            posSize = posEnd;
-            posEnd = 0;
-            posEndTmp = 0;
-        }
+        if (posEndTmp + 4 > posLimit && !reserveSlow(4))
+            return this;
+        *((uint32_t*)(intraThreadBuffer + lapPos)) = 0;
+        posEndTmp = posEnd - lapPos + INTRA_THREAD_BUFFER_SIZE;
+        posEnd = posEndTmp;
+        notifyReaders();
 
         return this;
     }
@@ -246,8 +548,173 @@ namespace OpenLogReplicator {
         return posEndTmp - posEnd;
     }
 
+    bool CommandBuffer::hasTran(CommandBufferConsumer *consumer) {
+        switch (consumer->state.load()) {
+        case CONSUMER_ACTIVE:
+            return consumer->posRead.load() < posEnd.load();
+        case CONSUMER_SPILLING:
+            return consumer->spillRead.load() < consumer->spillWrite.load();
+        default:
+            return true;
+        }
+    }
+
+    //wait for next message of the consumer, returns nullptr on shutdown or when consumer is detached,
+    //consumer with spill or detach policy holds lagMtx until releaseTran
+    CommandBufferHeader *CommandBuffer::getTran(uint32_t consumer) {
+        return getTran(consumer, COMMAND_BUFFER_WAIT_INFINITE);
+    }
+
+    //returns nullptr when no message came in waitUs microseconds
+    CommandBufferHeader *CommandBuffer::getTran(uint32_t consumer, uint64_t waitUs) {
+        CommandBufferConsumer *c = consumers[consumer];
+        bool lag = (c->lagPolicy != CONSUMER_LAG_BLOCK);
+        chrono::steady_clock::time_point deadline;
+        if (waitUs != COMMAND_BUFFER_WAIT_INFINITE)
+            deadline = chrono::steady_clock::now() + chrono::microseconds(waitUs);
+
+        while (!this->shutdown) {
+            if (lag)
+                c->lagMtx.lock();
+            uint32_t state = c->state.load();
+            if (state == CONSUMER_DETACHED) {
+                if (lag)
+                    c->lagMtx.unlock();
+                return nullptr;
+            }
+
+            if (state == CONSUMER_SPILLING && c->spillRead.load() < c->spillWrite.load()) {
+                uint64_t spillRead = c->spillRead.load();
+                uint32_t length;
+                if (pread(c->spillFd, &length, sizeof(length), spillRead) != (ssize_t)sizeof(length)) {
+                    cerr << "ERROR: can't read spill file, consumer " << dec << c->id << " detached" << endl;
+                    c->state = CONSUMER_DETACHED;
+                    c->lagMtx.unlock();
+                    return nullptr;
+                }
+                if (length > c->spillBufferSize) {
+                    if (c->spillBuffer != nullptr)
+                        delete[] c->spillBuffer;
+                    c->spillBufferSize = length;
+                    c->spillBuffer = new uint8_t[c->spillBufferSize];
+                }
+
+                uint32_t read = 0;
+                while (read < length) {
+                    ssize_t ret = pread(c->spillFd, c->spillBuffer + read, length - read, spillRead + read);
+                    if (ret <= 0)
+                        break;
+                    read += ret;
+                }
+                if (read < length) {
+                    cerr << "ERROR: can't read spill file, consumer " << dec << c->id << " detached" << endl;
+                    c->state = CONSUMER_DETACHED;
+                    c->lagMtx.unlock();
+                    return nullptr;
+                }
+
+                c->spillRead = spillRead + length;
+                c->length = 0;
+                return (CommandBufferHeader*)c->spillBuffer;
+            }
+
+            if (state == CONSUMER_ACTIVE) {
+                uint64_t start = c->posRead.load();
+                if (start < posEnd.load()) {
+                    CommandBufferHeader *header = (CommandBufferHeader*)(intraThreadBuffer + (start % INTRA_THREAD_BUFFER_SIZE));
+
+                    if (header->length > 0 && isForConsumer(c, header, start)) {
+                        c->length = header->length;
+                        return header;
+                    }
+
+                    //rest of the buffer is not used or message is for other consumers
+                    if (header->length == 0)
+                        advanceConsumer(c, (start / INTRA_THREAD_BUFFER_SIZE + 1) * INTRA_THREAD_BUFFER_SIZE);
+                    else
+                        advanceConsumer(c, start + ((header->length + 7) & 0xFFFFFFF8));
+                    if (lag)
+                        c->lagMtx.unlock();
+                    notifyWriter();
+                    continue;
+                }
+            }
+            if (lag)
+                c->lagMtx.unlock();
+
+            bool timeout = false;
+            ++readersWaiting;
+            {
+                unique_lock<mutex> lck(mtx);
+                if (!hasTran(c) && !this->shutdown) {
+                    if (waitUs == COMMAND_BUFFER_WAIT_INFINITE)
+                        readersCond.wait(lck);
+                    else
+                        timeout = (readersCond.wait_until(lck, deadline) == cv_status::timeout);
+                }
+            }
+            --readersWaiting;
+            if (timeout)
+                break;
+        }
+
+        return nullptr;
+    }
+
+    void CommandBuffer::releaseTran(uint32_t consumer) {
+        CommandBufferConsumer *c = consumers[consumer];
+        if (c->length > 0) {
+            advanceConsumer(c, c->posRead.load() + ((c->length + 7) & 0xFFFFFFF8));
+            c->length = 0;
+        }
+
+        if (c->lagPolicy != CONSUMER_LAG_BLOCK)
+            c->lagMtx.unlock();
+        notifyWriter();
+    }
+
+    //message stays in the buffer until ackTran, it may be used without copying
+    CommandBufferAck *CommandBuffer::releaseTranDeferred(uint32_t consumer) {
+        CommandBufferConsumer *c = consumers[consumer];
+        uint64_t pos = c->posRead.load() + ((c->length + 7) & 0xFFFFFFF8);
+        CommandBufferAck *ack;
+        c->length = 0;
+        c->posRead = pos;
+        {
+            unique_lock<mutex> lck(c->ackMtx);
+            c->acks.push_back({pos, consumer, false});
+            ack = &c->acks.back();
+        }
+
+        if (c->lagPolicy != CONSUMER_LAG_BLOCK)
+            c->lagMtx.unlock();
+        return ack;
+    }
+
+    //acknowledgments may come in any order, space is reclaimed up to the oldest message in flight
+    void CommandBuffer::ackTran(CommandBufferAck *ack) {
+        CommandBufferConsumer *c = consumers[ack->consumer];
+        {
+            unique_lock<mutex> lck(c->ackMtx);
+            ack->acked = true;
+            while (!c->acks.empty() && c->acks.front().acked) {
+                c->posStart = c->acks.front().pos;
+                c->acks.pop_front();
+            }
+        }
+        notifyWriter();
+    }
+
+    //messages read from spill file are in consumer memory
+    bool CommandBuffer::isInBuffer(CommandBufferHeader *header) {
+        return (uint8_t*)header >= intraThreadBuffer && (uint8_t*)header < intraThreadBuffer + INTRA_THREAD_BUFFER_SIZE;
+    }
+
     CommandBuffer::~CommandBuffer() {
+        uint32_t count = consumersCount.load();
+        for (uint32_t i = 0; i < count; ++i)
+            delete consumers[i];
+        consumersCount = 0;
     }
 
 }
-
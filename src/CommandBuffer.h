@@ -17,8 +17,13 @@ You should have received a copy of the GNU General Public License
 along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
+
 #include <stdint.h>
 #include <string>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include "types.h"
@@ -26,37 +31,153 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #ifndef COMMANDBUFFER_H_
 #define COMMANDBUFFER_H_
 
+#define CACHE_LINE_SIZE 64
+#define COMMAND_BUFFER_HEADER (sizeof(struct CommandBufferHeader))
+#define COMMAND_BUFFER_CONSUMERS_MAX 32
+#define COMMAND_BUFFER_ALL_CONSUMERS 0xFFFFFFFF
+#define COMMAND_BUFFER_WAIT_INFINITE 0xFFFFFFFFFFFFFFFF
+
+//what to do with consumer which stops the producer
+#define CONSUMER_LAG_BLOCK 0
+#define CONSUMER_LAG_SPILL 1
+#define CONSUMER_LAG_DETACH 2
+
+#define CONSUMER_ACTIVE 0
+#define CONSUMER_SPILLING 1
+#define CONSUMER_DETACHED 2
+
+//how operations are divided into messages and messages between threads of a target
+#define MESSAGE_ROUTE_NONE 0
+#define MESSAGE_ROUTE_TABLE 1
+#define MESSAGE_ROUTE_KEY 2
+
+#define MESSAGE_FLAG_KEY 1
+
 using namespace std;
 
 namespace OpenLogReplicator {
 
     class Writer;
+    class OracleObject;
+
+    struct CommandBufferHeader {
+        uint32_t length;                            //with header, 0 - rest of the buffer is not used
+        uint32_t mask;                              //bits of consumers receiving the message
+        uint32_t key;                               //hash of row key
+        uint32_t flags;
+        OracleObject *object;                       //table of all operations, nullptr - many tables
+        typescn scn;                                //commit scn of transaction
+    };
 
+    //message read by consumer which is still referenced by the target
+    struct CommandBufferAck {
+        uint64_t pos;                               //after the message and following messages which don't need acknowledgment
+        uint32_t consumer;
+        bool acked;
+    };
+
+    class CommandBufferConsumer {
+    public:
+        uint8_t padding1[CACHE_LINE_SIZE];
+        atomic<uint64_t> posStart;                  //space before is not used by consumer
+        atomic<uint64_t> posRead;                   //next message to read
+        atomic<uint32_t> state;
+        uint32_t lagPolicy;
+        uint32_t id;
+        uint32_t bit;
+        uint32_t route;
+        uint32_t shard;                             //messages of the shard when target uses many threads
+        uint32_t shards;
+        uint32_t length;                            //message being processed
+        set<string> tables;                         //owner.table, empty - all tables
+        mutex lagMtx;                               //spill or detach policy: held by consumer while message is processed
+        string spillDir;
+        int spillFd;
+        atomic<uint64_t> spillRead;
+        atomic<uint64_t> spillWrite;
+        uint8_t *spillBuffer;
+        uint32_t spillBufferSize;
+        mutex ackMtx;
+        deque<CommandBufferAck> acks;               //messages waiting for acknowledgment, in buffer order
+
+        CommandBufferConsumer(uint64_t posStart, uint32_t lagPolicy, uint32_t id, const set<string> &tables, const string &spillDir,
+                uint32_t route, uint32_t shard, uint32_t shards);
+        virtual ~CommandBufferConsumer();
+    };
+
+    //ring buffer with one producer and many consumers, positions grow and are taken modulo buffer size,
+    //a message never wraps - message with length 0 moves consumers to the beginning of the buffer,
+    //space is reclaimed at the slowest consumer
     class CommandBuffer {
     protected:
         volatile bool shutdown;
+        uint64_t posLimit;                          //producer may write below without checking consumers
+        uint32_t tranMask;
+        bool tranMaskSet;
+        uint32_t tranKey;
+        uint32_t tranFlags;
+        typescn tranScn;                            //kept for all messages of transaction
+        uint32_t route;                             //finest routing of consumers
+        atomic<uint32_t> readersWaiting;
+        atomic<bool> writerWaiting;
+        CommandBufferConsumer *consumers[COMMAND_BUFFER_CONSUMERS_MAX];
+        atomic<uint32_t> consumersCount;
+        uint64_t posStartMin;                       //slowest consumer seen by producer
+        CommandBuffer *filterBuffer;                //consumers used for filters
+        unordered_map<OracleObject*, uint32_t> objectMasks;
+        uint32_t objectMasksCount;
+
+        bool reserveSlow(uint64_t length);
+        uint64_t slowestConsumer(CommandBufferConsumer *&slowest);
+        void lagConsumer(CommandBufferConsumer *consumer);
+        bool isForConsumer(CommandBufferConsumer *consumer, CommandBufferHeader *header, uint64_t pos);
+        void advanceConsumer(CommandBufferConsumer *consumer, uint64_t pos);
+        void spillMessage(CommandBufferConsumer *consumer, CommandBufferHeader *header);
+        void spillWriteFile(CommandBufferConsumer *consumer, CommandBufferHeader *header);
+        bool hasTran(CommandBufferConsumer *consumer);
+        void notifyReaders();
+        void notifyWriter();
     public:
         static char translationMap[65];
         Writer *writer;
+        OracleObject *tranObject;                   //table of all operations of current message
         uint8_t *intraThreadBuffer;
-        mutex mtx;
+        mutex mtx;                                  //only for waiting on full or empty buffer
         condition_variable readersCond;
         condition_variable writerCond;
-        volatile uint64_t posStart;
-        volatile uint64_t posEnd;
-        volatile uint64_t posEndTmp;
-        volatile uint32_t posSize;
+        uint8_t padding1[CACHE_LINE_SIZE];
+        atomic<uint64_t> posEnd;
+        uint64_t posEndTmp;
+        uint8_t padding2[CACHE_LINE_SIZE - sizeof(atomic<uint64_t>) - sizeof(uint64_t)];
 
         void terminate(void);
+        uint32_t addConsumer(uint32_t lagPolicy, const set<string> &tables, const string &spillDir, uint32_t route, uint32_t shard,
+                uint32_t shards);
+        uint32_t messageRoute();
+        uint32_t objectMask(OracleObject *object);
+        CommandBuffer* addObject(OracleObject *object);
+        CommandBuffer* addKey(uint32_t key);
+        CommandBuffer* setScn(typescn scn);
+        CommandBuffer* reserve(uint64_t length);
         CommandBuffer* appendRowid(uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot);
         CommandBuffer* appendEscape(const uint8_t *str, uint32_t length);
-        CommandBuffer* append(const string str);
+        CommandBuffer* append(const string &str);
+        CommandBuffer* append(const uint8_t *str, uint32_t length);
         CommandBuffer* append(char chr);
         CommandBuffer* appendHex(uint64_t val, uint32_t length);
+        bool appendNumber(const uint8_t *data, uint32_t length);
+        bool appendTime(uint32_t typeNo, const uint8_t *data, uint32_t length);
         CommandBuffer* beginTran();
         CommandBuffer* commitTran();
-        CommandBuffer* rewind();
+        CommandBuffer* appendTran(CommandBufferHeader *header);
+        virtual CommandBuffer* rewind();
         uint32_t currentTranSize();
+        CommandBufferHeader *getTran(uint32_t consumer);
+        CommandBufferHeader *getTran(uint32_t consumer, uint64_t waitUs);
+        void releaseTran(uint32_t consumer);
+        CommandBufferAck *releaseTranDeferred(uint32_t consumer);
+        void ackTran(CommandBufferAck *ack);
+        bool isInBuffer(CommandBufferHeader *header);
 
         CommandBuffer();
         virtual ~CommandBuffer();
@@ -0,0 +1,194 @@
+/* Worker pool compressing messages of writers
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <iostream>
+#include <iomanip>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zstd.h>
+#include <lz4frame.h>
+#include "Compressor.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    Compressor::Compressor(uint32_t type, int level, uint32_t workers) :
+        type(type),
+        level(level),
+        workers(workers),
+        pthreads(nullptr),
+        shutdown(false),
+        jobsDone(0),
+        bytesIn(0),
+        bytesOut(0),
+        cpuNs(0) {
+    }
+
+    Compressor::~Compressor() {
+        {
+            unique_lock<mutex> lck(mtx);
+            shutdown = true;
+            jobsCond.notify_all();
+        }
+
+        if (pthreads != nullptr) {
+            for (uint32_t i = 0; i < workers; ++i)
+                pthread_join(pthreads[i], nullptr);
+            delete[] pthreads;
+            pthreads = nullptr;
+        }
+
+        //jobs not taken by workers are left uncompressed
+        for (CompressorJob *job : jobs)
+            job->done = true;
+        jobs.clear();
+    }
+
+    int Compressor::initialize() {
+        if (workers == 0)
+            workers = 1;
+
+        pthreads = new pthread_t[workers];
+        for (uint32_t i = 0; i < workers; ++i)
+            pthread_create(&pthreads[i], nullptr, &Compressor::runStatic, (void*)this);
+        return 1;
+    }
+
+    void *Compressor::runStatic(void *context) {
+        ((Compressor*)context)->run();
+        return nullptr;
+    }
+
+    void Compressor::run() {
+        ZSTD_CCtx *cctx = nullptr;
+        if (type == COMPRESSION_ZSTD)
+            cctx = ZSTD_createCCtx();
+
+        while (true) {
+            CompressorJob *job;
+            {
+                unique_lock<mutex> lck(mtx);
+                while (jobs.empty() && !shutdown)
+                    jobsCond.wait(lck);
+                if (jobs.empty())
+                    break;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            struct timespec start, end;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+            job->output = nullptr;
+            job->outputLength = 0;
+            if (type == COMPRESSION_ZSTD && cctx != nullptr) {
+                size_t bound = ZSTD_compressBound(job->length);
+                job->output = (uint8_t*)malloc(bound);
+                if (job->output != nullptr) {
+                    size_t size = ZSTD_compressCCtx(cctx, job->output, bound, job->data, job->length, level);
+                    if (ZSTD_isError(size)) {
+                        cerr << "ERROR: zstd compression: " << ZSTD_getErrorName(size) << endl;
+                        free(job->output);
+                        job->output = nullptr;
+                    } else
+                        job->outputLength = size;
+                }
+            } else if (type == COMPRESSION_LZ4) {
+                //frame format keeps the content size, so the message can be decoded alone
+                LZ4F_preferences_t preferences;
+                memset(&preferences, 0, sizeof(preferences));
+                preferences.compressionLevel = level;
+                preferences.frameInfo.contentSize = job->length;
+                size_t bound = LZ4F_compressFrameBound(job->length, &preferences);
+                job->output = (uint8_t*)malloc(bound);
+                if (job->output != nullptr) {
+                    size_t size = LZ4F_compressFrame(job->output, bound, job->data, job->length, &preferences);
+                    if (LZ4F_isError(size)) {
+                        cerr << "ERROR: lz4 compression: " << LZ4F_getErrorName(size) << endl;
+                        free(job->output);
+                        job->output = nullptr;
+                    } else
+                        job->outputLength = size;
+                }
+            }
+
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+            cpuNs += (end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+            bytesIn += job->length;
+            bytesOut += (job->output != nullptr) ? job->outputLength : job->length;
+            ++jobsDone;
+
+            {
+                unique_lock<mutex> lck(mtx);
+                job->done = true;
+                doneCond.notify_all();
+            }
+        }
+
+        if (cctx != nullptr)
+            ZSTD_freeCCtx(cctx);
+    }
+
+    void Compressor::submit(CompressorJob *job) {
+        job->done = false;
+        job->output = nullptr;
+        job->outputLength = 0;
+
+        unique_lock<mutex> lck(mtx);
+        if (shutdown) {
+            job->done = true;
+            return;
+        }
+        jobs.push_back(job);
+        jobsCond.notify_one();
+    }
+
+    void Compressor::wait(CompressorJob *job) {
+        unique_lock<mutex> lck(mtx);
+        while (!job->done)
+            doneCond.wait(lck);
+    }
+
+    uint32_t Compressor::getType() {
+        return type;
+    }
+
+    //marks compressed messages for consumers
+    const char *Compressor::getName() {
+        if (type == COMPRESSION_ZSTD)
+            return "zstd";
+        if (type == COMPRESSION_LZ4)
+            return "lz4";
+        return "none";
+    }
+
+    void Compressor::report(const string &alias) {
+        uint64_t in = bytesIn, out = bytesOut, ns = cpuNs;
+        if (in == 0)
+            return;
+
+        cout << "Compression for: " << alias << " messages: " << dec << jobsDone << ", in: " << (in / 1024) << "kB, out: " << (out / 1024) <<
+                "kB, ratio: " << fixed << setprecision(2) << ((double)in / (out > 0 ? out : 1)) << ", cpu: " << (ns / 1000000) << "ms";
+        if (ns > 0)
+            cout << " (" << setprecision(1) << ((double)in * 1000 / ns) << "MB/s per core)";
+        cout << defaultfloat << endl;
+    }
+}
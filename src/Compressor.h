@@ -0,0 +1,85 @@
+/* Header for Compressor class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <pthread.h>
+#include "types.h"
+
+#ifndef COMPRESSOR_H_
+#define COMPRESSOR_H_
+
+#define COMPRESSION_NONE 0
+#define COMPRESSION_ZSTD 1
+#define COMPRESSION_LZ4 2
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //sealed message, input stays valid until the job is sent, output is allocated with malloc, nullptr when compression failed
+    struct CompressorJob {
+        uint8_t *data;
+        uint32_t length;
+        uint8_t *output;
+        uint32_t outputLength;
+        atomic<bool> done;
+
+        virtual ~CompressorJob() {};
+    };
+
+    //worker pool compressing messages of writers before they reach the sink
+    class Compressor {
+    protected:
+        uint32_t type;
+        int level;
+        uint32_t workers;
+        pthread_t *pthreads;
+        volatile bool shutdown;
+        mutex mtx;
+        condition_variable jobsCond;
+        condition_variable doneCond;
+        deque<CompressorJob*> jobs;
+
+        atomic<uint64_t> jobsDone;
+        atomic<uint64_t> bytesIn;
+        atomic<uint64_t> bytesOut;
+        atomic<uint64_t> cpuNs;
+
+        static void *runStatic(void *context);
+        void run();
+
+    public:
+        void submit(CompressorJob *job);
+        void wait(CompressorJob *job);
+        void report(const string &alias);
+        uint32_t getType();
+        const char *getName();
+        int initialize();
+
+        Compressor(uint32_t type, int level, uint32_t workers);
+        virtual ~Compressor();
+    };
+}
+
+#endif
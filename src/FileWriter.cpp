@@ -0,0 +1,360 @@
+/* Thread writing to segmented local files
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "types.h"
+#include "FileWriter.h"
+#include "CommandBuffer.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    static char fileWriterNewLine = '\n';
+
+    FileWriter::FileWriter(const string alias, CommandBuffer *commandBuffer, Writer *formatter, const string dir, const string name,
+            uint64_t segmentBytes, uint32_t segmentSeconds, uint32_t fsyncMs, bool lengthPrefix) :
+        SinkWriter(alias, commandBuffer, formatter),
+        dir(dir.c_str()),
+        name(name.c_str()),
+        segmentBytes(segmentBytes),
+        segmentSeconds(segmentSeconds),
+        fsyncMs(fsyncMs),
+        lengthPrefix(lengthPrefix),
+        fd(-1),
+        indexFd(-1),
+        segment(0),
+        segmentOffset(0),
+        syncOffset(0),
+        failed(false),
+        indexOffset(0),
+        iovCount(0),
+        pendingBytes(0) {
+    }
+
+    //messages not synced are never acknowledged
+    FileWriter::~FileWriter() {
+        closeSegment();
+        freeCopies();
+        for (SinkWriterJob *job : written) {
+            job->ack = nullptr;
+            freeJob(job);
+        }
+        written.clear();
+    }
+
+    void FileWriter::freeCopies() {
+        for (uint8_t *dataCopy : copies)
+            delete[] dataCopy;
+        copies.clear();
+    }
+
+    //segments are never appended after restart, numbering continues after the last one in the directory
+    int FileWriter::initialize() {
+        DIR *dirp = opendir(dir.c_str());
+        if (dirp == nullptr) {
+            cerr << "ERROR: can't open directory: " << dir << endl;
+            return 0;
+        }
+
+        string prefix = name + ".";
+        struct dirent *ent;
+        while ((ent = readdir(dirp)) != nullptr) {
+            uint32_t length = strlen(ent->d_name);
+            if (length <= prefix.length() + 4 || strncmp(ent->d_name, prefix.c_str(), prefix.length()) != 0 ||
+                    strcmp(ent->d_name + length - 4, ".log") != 0)
+                continue;
+
+            char *end;
+            uint64_t number = strtoull(ent->d_name + prefix.length(), &end, 10);
+            if (end == ent->d_name + length - 4 && number > segment)
+                segment = number;
+        }
+        closedir(dirp);
+
+        if (!openSegment(segment + 1))
+            return 0;
+        return 1;
+    }
+
+    void *FileWriter::run() {
+        cout << "- File Writer for: " << dir << "/" << name << endl;
+
+        while (!this->shutdown) {
+            //compressed messages are written in order, too many waiting stop the thread
+            if (!jobs.empty())
+                writeJobs(SINK_WRITER_JOBS_MAX - 1);
+
+            //collected messages are written when no more come, fsync waits for the end of group commit interval
+            uint64_t waitUs = COMMAND_BUFFER_WAIT_INFINITE;
+            if (iovCount > 0)
+                waitUs = 0;
+            else if (pendingSync()) {
+                chrono::steady_clock::time_point now = chrono::steady_clock::now();
+                waitUs = 0;
+                if (now < syncEnd)
+                    waitUs = chrono::duration_cast<chrono::microseconds>(syncEnd - now).count();
+            }
+            if (!jobs.empty() && waitUs > SINK_WRITER_JOBS_POLL_US)
+                waitUs = SINK_WRITER_JOBS_POLL_US;
+
+            CommandBufferHeader *header = commandBuffer->getTran(consumer, waitUs);
+            if (header == nullptr) {
+                writeBuffered();
+                if (pendingSync() && (fsyncMs == 0 || chrono::steady_clock::now() >= syncEnd))
+                    sync();
+                continue;
+            }
+
+            appendMessage(header);
+            if (fsyncMs > 0 && pendingSync() && chrono::steady_clock::now() >= syncEnd)
+                sync();
+        }
+
+        writeJobs(0);
+        sync();
+        return 0;
+    }
+
+    string FileWriter::segmentName(uint64_t segment, const char *extension) {
+        char number[24];
+        snprintf(number, sizeof(number), "%010llu", (unsigned long long)segment);
+        return dir + "/" + name + "." + number + extension;
+    }
+
+    bool FileWriter::openSegment(uint64_t segment) {
+        string fileName = segmentName(segment, ".log");
+        fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            cerr << "ERROR: can't create file: " << fileName << endl;
+            return false;
+        }
+
+        string indexName = segmentName(segment, ".idx");
+        indexFd = open(indexName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (indexFd == -1) {
+            cerr << "ERROR: can't create file: " << indexName << endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        //new directory entries are durable too
+        int dirFd = open(dir.c_str(), O_RDONLY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+
+        this->segment = segment;
+        segmentOffset = 0;
+        syncOffset = 0;
+        indexOffset = 0;
+        segmentEnd = chrono::steady_clock::now() + chrono::seconds(segmentSeconds);
+        return true;
+    }
+
+    void FileWriter::closeSegment() {
+        if (fd == -1)
+            return;
+
+        sync();
+        fsync(indexFd);
+        close(indexFd);
+        indexFd = -1;
+        close(fd);
+        fd = -1;
+    }
+
+    //message in the buffer is written without copying, space is released after fsync,
+    //message read from spill file is overwritten by next read and waits for fsync in a copy
+    void FileWriter::appendMessage(CommandBufferHeader *header) {
+        if (compressor != nullptr) {
+            compressTran(header);
+            return;
+        }
+
+        uint8_t *data = (uint8_t*)header + COMMAND_BUFFER_HEADER;
+        uint32_t length = header->length - COMMAND_BUFFER_HEADER;
+        bool inBuffer = commandBuffer->isInBuffer(header);
+        if (!prepareAppend(header->scn, length)) {
+            commandBuffer->releaseTran(consumer);
+            return;
+        }
+
+        if (!inBuffer) {
+            uint8_t *dataCopy = new uint8_t[length];
+            memcpy(dataCopy, data, length);
+            copies.push_back(dataCopy);
+            data = dataCopy;
+        }
+        appendData(data, length, COMPRESSION_NONE);
+
+        if (inBuffer)
+            acks.push_back(commandBuffer->releaseTranDeferred(consumer));
+        else
+            commandBuffer->releaseTran(consumer);
+    }
+
+    //compressed message is kept with its input until fsync, message which didn't compress is written plain
+    void FileWriter::writeCompressed(SinkWriterJob *job) {
+        uint32_t length = (job->output != nullptr) ? job->outputLength : job->length;
+        if (!prepareAppend(job->scn, length)) {
+            freeJob(job);
+            return;
+        }
+
+        if (job->output != nullptr)
+            appendData(job->output, job->outputLength, compressor->getType());
+        else
+            appendData(job->data, job->length, COMPRESSION_NONE);
+        written.push_back(job);
+    }
+
+    //rotates the segment when the message doesn't fit, false when the writer is stopped
+    bool FileWriter::prepareAppend(typescn scn, uint32_t length) {
+        uint64_t pos = segmentOffset + pendingBytes;
+        if (pos > 0 && (pos + length + sizeof(FileWriterPrefix) > segmentBytes ||
+                (segmentSeconds > 0 && chrono::steady_clock::now() >= segmentEnd))) {
+            closeSegment();
+            if (!failed && !openSegment(segment + 1))
+                stop();
+            if (failed)
+                return false;
+            pos = 0;
+        }
+
+        if (pos == 0 || pos >= indexOffset + FILE_WRITER_INDEX_INTERVAL) {
+            index.push_back({scn, pos});
+            indexOffset = pos;
+        }
+
+        if (!pendingSync() && iovCount == 0)
+            syncEnd = chrono::steady_clock::now() + chrono::milliseconds(fsyncMs);
+
+        if (iovCount + 2 > FILE_WRITER_IOV)
+            writeBuffered();
+        return true;
+    }
+
+    //with compression every message is prefixed with length and COMPRESSION_* of the message
+    void FileWriter::appendData(uint8_t *data, uint32_t length, uint32_t compression) {
+        if (lengthPrefix || compressor != nullptr) {
+            FileWriterPrefix *prefix = &prefixes[iovCount / 2];
+            prefix->length = length;
+            prefix->compression = compression;
+            iov[iovCount].iov_base = prefix;
+            iov[iovCount++].iov_len = (compressor != nullptr) ? sizeof(FileWriterPrefix) : sizeof(uint32_t);
+            iov[iovCount].iov_base = data;
+            iov[iovCount++].iov_len = length;
+            pendingBytes += iov[iovCount - 2].iov_len + length;
+        } else {
+            iov[iovCount].iov_base = data;
+            iov[iovCount++].iov_len = length;
+            iov[iovCount].iov_base = &fileWriterNewLine;
+            iov[iovCount++].iov_len = 1;
+            pendingBytes += length + 1;
+        }
+
+        if (pendingBytes >= FILE_WRITER_WRITE_BYTES)
+            writeBuffered();
+    }
+
+    bool FileWriter::pendingSync() {
+        return !acks.empty() || !copies.empty() || !written.empty();
+    }
+
+    //acknowledgments are kept, messages not written stay in the buffer
+    void FileWriter::stop() {
+        cerr << "ERROR: writer " << alias << " stopped" << endl;
+        failed = true;
+        this->shutdown = true;
+    }
+
+    bool FileWriter::writeBuffered() {
+        uint32_t start = 0;
+        while (start < iovCount && !failed) {
+            ssize_t written = writev(fd, iov + start, iovCount - start);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                cerr << "ERROR: writing file: " << segmentName(segment, ".log") << ", errno: " << dec << errno << endl;
+                stop();
+                break;
+            }
+            segmentOffset += written;
+
+            //partial write continues from the middle of the vector
+            while (start < iovCount && (size_t)written >= iov[start].iov_len) {
+                written -= iov[start].iov_len;
+                ++start;
+            }
+            if (start < iovCount) {
+                iov[start].iov_base = (uint8_t*)iov[start].iov_base + written;
+                iov[start].iov_len -= written;
+            }
+        }
+
+        iovCount = 0;
+        pendingBytes = 0;
+        return !failed;
+    }
+
+    //group commit: one fsync for all messages written since the last one,
+    //after failed fsync state of written data is unknown and it is never retried
+    bool FileWriter::sync() {
+        if (!writeBuffered())
+            return false;
+        if (fd == -1 || segmentOffset == syncOffset)
+            return true;
+
+        if (fdatasync(fd) != 0) {
+            cerr << "ERROR: fsync of file: " << segmentName(segment, ".log") << ", errno: " << dec << errno << endl;
+            stop();
+            return false;
+        }
+        syncOffset = segmentOffset;
+
+        //index points only to synced data
+        if (index.size() > 0) {
+            ssize_t length = index.size() * sizeof(FileWriterIndex);
+            if (write(indexFd, index.data(), length) != length)
+                cerr << "ERROR: writing file: " << segmentName(segment, ".idx") << endl;
+            index.clear();
+        }
+
+        for (CommandBufferAck *ack : acks)
+            commandBuffer->ackTran(ack);
+        acks.clear();
+        freeCopies();
+        for (SinkWriterJob *job : written)
+            freeJob(job);
+        written.clear();
+        return true;
+    }
+}
@@ -0,0 +1,108 @@
+/* Header for FileWriter class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "types.h"
+#include "SinkWriter.h"
+
+#ifndef FILEWRITER_H_
+#define FILEWRITER_H_
+
+#define FILE_WRITER_IOV 1024
+#define FILE_WRITER_WRITE_BYTES 4194304
+#define FILE_WRITER_INDEX_INTERVAL 65536
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    class RedoLogRecord;
+    class CommandBuffer;
+    struct CommandBufferAck;
+    struct CommandBufferHeader;
+    class OracleEnvironment;
+
+    //entry of segment index, file <name>.<segment>.idx
+    struct FileWriterIndex {
+        uint64_t scn;
+        uint64_t offset;
+    };
+
+    //prefix of binary or compressed message, compression only when the target compresses messages
+    struct FileWriterPrefix {
+        uint32_t length;
+        uint32_t compression;                       //COMPRESSION_*
+    };
+
+    class FileWriter : public SinkWriter {
+    protected:
+        string dir;
+        string name;
+        uint64_t segmentBytes;
+        uint32_t segmentSeconds;                    //0 - rotate only by size
+        uint32_t fsyncMs;                           //group commit interval, 0 - after every write
+        bool lengthPrefix;                          //binary messages are prefixed with length instead of new line, always with compression
+
+        int fd;
+        int indexFd;
+        uint64_t segment;
+        uint64_t segmentOffset;                     //written to the file
+        uint64_t syncOffset;                        //written and synced
+        bool failed;                                //write or fsync error, written messages are never acknowledged
+        uint64_t indexOffset;                       //last indexed message
+        chrono::steady_clock::time_point segmentEnd;
+        chrono::steady_clock::time_point syncEnd;
+
+        struct iovec iov[FILE_WRITER_IOV];
+        uint32_t iovCount;
+        FileWriterPrefix prefixes[FILE_WRITER_IOV / 2];
+        uint64_t pendingBytes;                      //in iov, not written yet
+        vector<CommandBufferAck*> acks;             //written, released after fsync
+        vector<uint8_t*> copies;                    //messages read from spill file, freed after fsync
+        vector<SinkWriterJob*> written;             //compressed messages, freed after fsync
+        vector<FileWriterIndex> index;
+
+        string segmentName(uint64_t segment, const char *extension);
+        bool openSegment(uint64_t segment);
+        void closeSegment();
+        void appendMessage(CommandBufferHeader *header);
+        virtual void writeCompressed(SinkWriterJob *job);
+        bool prepareAppend(typescn scn, uint32_t length);
+        void appendData(uint8_t *data, uint32_t length, uint32_t compression);
+        bool pendingSync();
+        bool writeBuffered();
+        bool sync();
+        void stop();
+        void freeCopies();
+
+    public:
+        virtual void *run();
+        virtual int initialize();
+
+        FileWriter(const string alias, CommandBuffer *commandBuffer, Writer *formatter, const string dir, const string name,
+                uint64_t segmentBytes, uint32_t segmentSeconds, uint32_t fsyncMs, bool lengthPrefix);
+        virtual ~FileWriter();
+    };
+}
+
+#endif
@@ -0,0 +1,169 @@
+/* Escaping of JSON string values
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "types.h"
+#include "JsonString.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //character after backslash, 'u' - \u00XX, 0 - copied as is
+    const uint8_t JsonString::escapeMap[256] = {
+            'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+            'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+            0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    bool JsonString::avx2 = JsonString::detectAvx2();
+
+    bool JsonString::detectAvx2() {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+#if defined(__x86_64__)
+    //byte is special when equal to quote or backslash or not above 0x1F
+    __attribute__((target("avx2,popcnt")))
+    static uint32_t jsonStringSpecialsAvx2(const uint8_t *str, uint32_t length, uint32_t &pos) {
+        const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\'), control = _mm256_set1_epi8(0x1F);
+        uint32_t count = 0;
+        for (; pos + 32 <= length; pos += 32) {
+            __m256i chars = _mm256_loadu_si256((const __m256i*)(str + pos));
+            __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chars, quote), _mm256_cmpeq_epi8(chars, backslash)),
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(chars, control), chars));
+            count += __builtin_popcount((uint32_t)_mm256_movemask_epi8(special));
+        }
+        return count;
+    }
+
+    __attribute__((target("avx2")))
+    static uint32_t jsonStringNextAvx2(const uint8_t *str, uint32_t pos, uint32_t length) {
+        const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\'), control = _mm256_set1_epi8(0x1F);
+        for (; pos + 32 <= length; pos += 32) {
+            __m256i chars = _mm256_loadu_si256((const __m256i*)(str + pos));
+            __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chars, quote), _mm256_cmpeq_epi8(chars, backslash)),
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(chars, control), chars));
+            uint32_t mask = _mm256_movemask_epi8(special);
+            if (mask != 0)
+                return pos + __builtin_ctz(mask);
+        }
+        return pos;
+    }
+
+    //SSE2 is part of every x86-64 cpu
+    static uint32_t jsonStringSpecialsSse(const uint8_t *str, uint32_t length, uint32_t &pos) {
+        const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1F);
+        uint32_t count = 0;
+        for (; pos + 16 <= length; pos += 16) {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(str + pos));
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(chars, control), chars));
+            count += __builtin_popcount((uint32_t)_mm_movemask_epi8(special));
+        }
+        return count;
+    }
+
+    static uint32_t jsonStringNextSse(const uint8_t *str, uint32_t pos, uint32_t length) {
+        const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1F);
+        for (; pos + 16 <= length; pos += 16) {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(str + pos));
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(chars, control), chars));
+            uint32_t mask = _mm_movemask_epi8(special);
+            if (mask != 0)
+                return pos + __builtin_ctz(mask);
+        }
+        return pos;
+    }
+#endif
+
+    //position of next character to escape or length
+    uint32_t JsonString::nextSpecial(const uint8_t *str, uint32_t pos, uint32_t length) {
+#if defined(__x86_64__)
+        if (avx2)
+            pos = jsonStringNextAvx2(str, pos, length);
+        pos = jsonStringNextSse(str, pos, length);
+#endif
+        while (pos < length && escapeMap[str[pos]] == 0)
+            ++pos;
+        return pos;
+    }
+
+    //number of characters to escape, output is at most length + specials * (JSON_STRING_ESCAPE_MAX - 1)
+    uint32_t JsonString::specials(const uint8_t *str, uint32_t length) {
+        uint32_t count = 0, pos = 0;
+#if defined(__x86_64__)
+        if (avx2)
+            count += jsonStringSpecialsAvx2(str, length, pos);
+        count += jsonStringSpecialsSse(str, length, pos);
+#endif
+        for (; pos < length; ++pos)
+            if (escapeMap[str[pos]] != 0)
+                ++count;
+        return count;
+    }
+
+    //runs without special characters are copied at once
+    uint32_t JsonString::escape(const uint8_t *str, uint32_t length, uint8_t *out) {
+        static const char *digits = "0123456789abcdef";
+        uint32_t pos = 0, outPos = 0;
+
+        while (pos < length) {
+            uint32_t next = nextSpecial(str, pos, length);
+            memcpy(out + outPos, str + pos, next - pos);
+            outPos += next - pos;
+            if (next == length)
+                break;
+
+            uint8_t chr = str[next], escaped = escapeMap[chr];
+            out[outPos++] = '\\';
+            out[outPos++] = escaped;
+            if (escaped == 'u') {
+                out[outPos++] = '0';
+                out[outPos++] = '0';
+                out[outPos++] = digits[chr >> 4];
+                out[outPos++] = digits[chr & 0xF];
+            }
+            pos = next + 1;
+        }
+        return outPos;
+    }
+}
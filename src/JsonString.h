@@ -0,0 +1,48 @@
+/* Header for JsonString class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdint.h>
+#include "types.h"
+
+#ifndef JSONSTRING_H_
+#define JSONSTRING_H_
+
+//longest escape sequence: \u00XX
+#define JSON_STRING_ESCAPE_MAX 6
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //escaping of string values: quote, backslash and characters below 0x20, searched 16 or 32 bytes at a time
+    class JsonString {
+    protected:
+        static const uint8_t escapeMap[256];
+        static bool avx2;
+
+        static bool detectAvx2();
+        static uint32_t nextSpecial(const uint8_t *str, uint32_t pos, uint32_t length);
+
+    public:
+        static uint32_t specials(const uint8_t *str, uint32_t length);
+        static uint32_t escape(const uint8_t *str, uint32_t length, uint8_t *out);
+    };
+}
+
+#endif
@@ -0,0 +1,727 @@
+/* Formatter of transactions as JSON messages
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "JsonWriter.h"
+#include "OracleEnvironment.h"
+#include "CommandBuffer.h"
+#include "OracleColumn.h"
+#include "OracleObject.h"
+#include "RedoLogRecord.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    JsonWriter::JsonWriter(const string alias, CommandBuffer *commandBuffer, uint32_t format, bool markers) :
+        Writer(alias, commandBuffer, format, markers) {
+    }
+
+    JsonWriter::~JsonWriter() {
+    }
+
+    //formatter has no thread, messages are consumed by targets of the source
+    void *JsonWriter::run() {
+        return 0;
+    }
+
+    //formatter writing to other buffer
+    Writer *JsonWriter::clone(CommandBuffer *commandBuffer) {
+        return new JsonWriter(alias, commandBuffer, format, markers);
+    }
+
+    void JsonWriter::beginTran(typescn scn, typexid xid) {
+        commandBuffer
+                ->beginTran()
+                ->append("{\"scn\": \"")
+                ->append(to_string(scn))
+                ->append("\", \"xid\": \"0x")
+                ->appendHex(USN(xid), 4)
+                ->append('.')
+                ->appendHex(SLT(xid), 3)
+                ->append('.')
+                ->appendHex(SQN(xid), 8);
+
+        //every row in own message, numbered in transaction
+        if (format == MESSAGE_FORMAT_ROW)
+            commandBuffer
+                    ->append("\", \"seq\": ")
+                    ->append(to_string(tranSeq))
+                    ->append(", dml: [");
+        else
+            commandBuffer->append("\", dml: [");
+    }
+
+    //part of transaction sent before commit
+    void JsonWriter::beginProvisional(typescn scn, typexid xid) {
+        commandBuffer
+                ->beginTran()
+                ->append("{\"scn\": \"")
+                ->append(to_string(scn))
+                ->append("\", \"xid\": \"0x")
+                ->appendHex(USN(xid), 4)
+                ->append('.')
+                ->appendHex(SLT(xid), 3)
+                ->append('.')
+                ->appendHex(SQN(xid), 8)
+                ->append("\", \"provisional\": true");
+
+        if (format == MESSAGE_FORMAT_ROW)
+            commandBuffer
+                    ->append(", \"seq\": ")
+                    ->append(to_string(tranSeq));
+        commandBuffer->append(", dml: [");
+    }
+
+    //first message of transaction sent row by row
+    void JsonWriter::beginMarker(typescn scn, typexid xid) {
+        commandBuffer
+                ->beginTran()
+                ->append("{\"scn\": \"")
+                ->append(to_string(scn))
+                ->append("\", \"xid\": \"0x")
+                ->appendHex(USN(xid), 4)
+                ->append('.')
+                ->appendHex(SLT(xid), 3)
+                ->append('.')
+                ->appendHex(SQN(xid), 8)
+                ->append("\", \"begin\": true}")
+                ->commitTran();
+    }
+
+    //closes transaction which was sent as provisional
+    //partial - some provisional operations were rolled back to savepoint later
+    void JsonWriter::endTran(typescn scn, typexid xid, bool rollback, bool partial) {
+        commandBuffer
+                ->beginTran()
+                ->append("{\"scn\": \"")
+                ->append(to_string(scn))
+                ->append("\", \"xid\": \"0x")
+                ->appendHex(USN(xid), 4)
+                ->append('.')
+                ->appendHex(SLT(xid), 3)
+                ->append('.')
+                ->appendHex(SQN(xid), 8);
+
+        if (rollback)
+            commandBuffer->append("\", \"rollback\": true}");
+        else if (partial)
+            commandBuffer->append("\", \"commit\": true, \"partial\": true}");
+        else
+            commandBuffer->append("\", \"commit\": true}");
+        commandBuffer->commitTran();
+    }
+
+    //provisional operation with undo block address uba is undone by rollback to savepoint
+    void JsonWriter::rollbackSavepoint(typescn scn, typexid xid, typeuba uba) {
+        commandBuffer
+                ->beginTran()
+                ->append("{\"scn\": \"")
+                ->append(to_string(scn))
+                ->append("\", \"xid\": \"0x")
+                ->appendHex(USN(xid), 4)
+                ->append('.')
+                ->appendHex(SLT(xid), 3)
+                ->append('.')
+                ->appendHex(SQN(xid), 8)
+                ->append("\", \"provisional\": true, \"rollback\": \"savepoint\", \"uba\": \"0x")
+                ->appendHex(BLOCK(uba), 8)
+                ->append('.')
+                ->appendHex(SEQUENCE(uba), 4)
+                ->append('.')
+                ->appendHex(RECORD(uba), 2)
+                ->append("\"}")
+                ->commitTran();
+    }
+
+    void JsonWriter::next() {
+        commandBuffer->append(", ");
+    }
+
+    void JsonWriter::commitTran() {
+        commandBuffer
+                ->append("]}")
+                ->commitTran();
+    }
+
+    //table part is prebuilt when the dictionary is loaded
+    void JsonWriter::appendRowBegin(uint32_t type, OracleObject *object, uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot) {
+        if (type == TRANSACTION_INSERT)
+            commandBuffer->append(object->jsonInsert);
+        else if (type == TRANSACTION_DELETE)
+            commandBuffer->append(object->jsonDelete);
+        else
+            commandBuffer->append(object->jsonUpdate);
+
+        commandBuffer
+                ->appendRowid(objn, objd, afn, bdba, slot)
+                ->append('"');
+    }
+
+    void JsonWriter::appendRowEnd() {
+        commandBuffer->append("}");
+    }
+
+    void JsonWriter::appendImageBegin(bool after) {
+        if (after)
+            commandBuffer->append(", \"after\": {");
+        else
+            commandBuffer->append(", \"before\": {");
+    }
+
+    void JsonWriter::appendImageEnd() {
+        commandBuffer->append("}");
+    }
+
+    //column without value is null
+    void JsonWriter::appendColumn(OracleObject *object, uint32_t colNum, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength,
+            bool &prevValue) {
+        //key is prebuilt with separator, first one skips it
+        const string &jsonName = object->columns[colNum]->jsonName;
+        if (prevValue)
+            commandBuffer->append(jsonName);
+        else {
+            commandBuffer->append((const uint8_t*)jsonName.c_str() + 2, jsonName.length() - 2);
+            prevValue = true;
+        }
+
+        if (redoLogRecord != nullptr && fieldLength > 0)
+            appendValue(redoLogRecord, object->columns[colNum]->typeNo, fieldPos, fieldLength);
+
+        commandBuffer->append('"');
+    }
+
+    void JsonWriter::appendTruncate(OracleObject *object) {
+        commandBuffer->append(object->jsonTruncate);
+    }
+
+    //0x05010B0B
+    void JsonWriter::parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) {
+        uint32_t pos = 0;
+        uint32_t fieldPos = redoLogRecord2->fieldPos, fieldPosStart;
+        bool prevValue;
+        uint16_t fieldLength;
+
+        for (uint32_t i = 1; i < 4; ++i) {
+            fieldLength = oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->fieldLengthsDelta + i * 2);
+            fieldPos += (fieldLength + 3) & 0xFFFC;
+        }
+        fieldPosStart = fieldPos;
+
+        for (uint32_t r = 0; r < redoLogRecord2->nrow; ++r) {
+            if (r > 0)
+                nextRow(redoLogRecord2->object);
+
+            pos = 0;
+            prevValue = false;
+            fieldPos = fieldPosStart;
+            uint8_t jcc = redoLogRecord2->data[fieldPos + pos + 2];
+            pos = 3;
+
+            appendRowBegin(TRANSACTION_INSERT, redoLogRecord2->object, redoLogRecord1->objn, redoLogRecord1->objd, redoLogRecord2->afn,
+                    redoLogRecord2->bdba - oracleEnvironment->getBase(), oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->slotsDelta + r * 2));
+            appendImageBegin(true);
+            beginKey(redoLogRecord2->object, redoLogRecord1->objd, redoLogRecord2->bdba,
+                    oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->slotsDelta + r * 2));
+
+            for (uint32_t i = 0; i < redoLogRecord2->object->columns.size(); ++i) {
+                bool isNull = false;
+
+                if (i >= jcc)
+                    isNull = true;
+                else {
+                    fieldLength = redoLogRecord2->data[fieldPos + pos];
+                    ++pos;
+                    if (fieldLength == 0xFF) {
+                        isNull = true;
+                    } else
+                    if (fieldLength == 0xFE) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord2->data + fieldPos + pos);
+                        pos += 2;
+                    }
+                }
+
+                //NULL values
+                if (!isNull) {
+                    appendColumn(redoLogRecord2->object, i, redoLogRecord2, fieldPos + pos, fieldLength, prevValue);
+                    addKey(redoLogRecord2->object->columns[i], redoLogRecord2, fieldPos + pos, fieldLength);
+
+                    pos += fieldLength;
+                }
+            }
+
+            appendImageEnd();
+            appendRowEnd();
+            endKey();
+
+            fieldPosStart += oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->rowLenghsDelta + r * 2);
+        }
+    }
+
+    //0x05010B0C
+    void JsonWriter::parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) {
+        uint32_t pos = 0;
+        uint32_t fieldPos = redoLogRecord1->fieldPos, fieldPosStart;
+        bool prevValue;
+        uint16_t fieldLength;
+        //uint16_t rowLengths;
+
+        for (uint32_t i = 1; i < 6; ++i) {
+            fieldLength = oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + i * 2);
+            fieldPos += (fieldLength + 3) & 0xFFFC;
+            //if (i == 5)
+            //    rowLengths = fieldPos;
+        }
+        fieldPosStart = fieldPos;
+
+        for (uint32_t r = 0; r < redoLogRecord1->nrow; ++r) {
+            if (r > 0)
+                nextRow(redoLogRecord1->object);
+
+            pos = 0;
+            prevValue = false;
+            fieldPos = fieldPosStart;
+            uint8_t jcc = redoLogRecord1->data[fieldPos + pos + 2];
+            pos = 3;
+
+            appendRowBegin(TRANSACTION_DELETE, redoLogRecord1->object, redoLogRecord1->objn, redoLogRecord1->objd, redoLogRecord2->afn,
+                    redoLogRecord2->bdba - oracleEnvironment->getBase(), oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->slotsDelta + r * 2));
+            appendImageBegin(false);
+            beginKey(redoLogRecord1->object, redoLogRecord1->objd, redoLogRecord2->bdba,
+                    oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->slotsDelta + r * 2));
+
+            for (uint32_t i = 0; i < redoLogRecord1->object->columns.size(); ++i) {
+                bool isNull = false;
+
+                if (i >= jcc)
+                    isNull = true;
+                else {
+                    fieldLength = redoLogRecord1->data[fieldPos + pos];
+                    ++pos;
+                    if (fieldLength == 0xFF) {
+                        isNull = true;
+                    } else
+                    if (fieldLength == 0xFE) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + pos);
+                        pos += 2;
+                    }
+                }
+
+                //NULL values
+                if (!isNull) {
+                    appendColumn(redoLogRecord1->object, i, redoLogRecord1, fieldPos + pos, fieldLength, prevValue);
+                    addKey(redoLogRecord1->object->columns[i], redoLogRecord1, fieldPos + pos, fieldLength);
+
+                    pos += fieldLength;
+                }
+            }
+
+            appendImageEnd();
+            appendRowEnd();
+            endKey();
+
+            fieldPosStart += oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->rowLenghsDelta + r * 2);
+        }
+    }
+
+    void JsonWriter::parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment) {
+        appendRowBegin(type, redoLogRecord2->object, redoLogRecord1->objn, redoLogRecord1->objd, redoLogRecord2->afn,
+                redoLogRecord2->suppLogBdba - oracleEnvironment->getBase(), redoLogRecord2->suppLogSlot);
+        //key of inserted row is taken from after image, of other rows from before image
+        beginKey(redoLogRecord1->object, redoLogRecord1->objd, redoLogRecord2->suppLogBdba, redoLogRecord2->suppLogSlot);
+
+        uint32_t fieldPos, colNum, colShift, cc, headerSize;
+        uint16_t fieldLength;
+        uint8_t *nulls, bits, *colNums;
+        bool prevValue;
+        RedoLogRecord *redoLogRecord;
+        uint32_t *afterPos = nullptr, *beforePos = nullptr;
+        uint16_t *afterLen = nullptr, *beforeLen = nullptr;
+        RedoLogRecord **beforeRecord, **afterRecord;
+        if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
+            afterPos = new uint32_t[redoLogRecord1->object->totalCols * sizeof(uint32_t)];
+            memset(afterPos, 0, redoLogRecord1->object->totalCols * sizeof(uint32_t));
+            beforePos = new uint32_t[redoLogRecord1->object->totalCols * sizeof(uint32_t)];
+            memset(beforePos, 0, redoLogRecord1->object->totalCols * sizeof(uint32_t));
+            afterLen = new uint16_t[redoLogRecord1->object->totalCols * sizeof(uint16_t)];
+            beforeLen = new uint16_t[redoLogRecord1->object->totalCols * sizeof(uint16_t)];
+            beforeRecord = new RedoLogRecord*[redoLogRecord1->object->totalCols * sizeof(RedoLogRecord *)];
+            afterRecord = new RedoLogRecord*[redoLogRecord1->object->totalCols * sizeof(RedoLogRecord *)];
+
+        }
+
+        if (type == TRANSACTION_DELETE || type == TRANSACTION_UPDATE) {
+            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
+                appendImageBegin(false);
+            redoLogRecord = redoLogRecord1;
+            prevValue = false;
+            colNums = nullptr;
+
+            while (redoLogRecord != nullptr) {
+                if (oracleEnvironment->trace >= TRACE_FULL)
+                    redoLogRecord->dumpHex(cerr, oracleEnvironment);
+
+                if (redoLogRecord->opCode == 0x0501) {
+                    fieldPos = redoLogRecord->fieldPos;
+                    nulls = redoLogRecord->data + redoLogRecord->nullsDelta;
+                    bits = 1;
+                    cc = redoLogRecord->cc;
+                    if (redoLogRecord->colNumsDelta > 0) {
+                        colNums = redoLogRecord->data + redoLogRecord->colNumsDelta;
+                        headerSize = 5;
+                        colShift = redoLogRecord->suppLogBefore - 1 - oracleEnvironment->read16(colNums);
+                    } else {
+                        colNums = nullptr;
+                        headerSize = 4;
+                        colShift = redoLogRecord->suppLogBefore - 1;
+                    }
+
+                    for (uint32_t i = 1; i <= headerSize; ++i) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + i * 2);
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                    }
+
+                    for (uint32_t i = 0; i < cc; ++i) {
+                        if (i + headerSize + 1 > redoLogRecord->fieldCnt) {
+                            cerr << "ERROR: reached out of columns" << endl;
+                            break;
+                        }
+                        if (colNums != nullptr) {
+                            colNum = oracleEnvironment->read16(colNums) + colShift;
+                            colNums += 2;
+                        } else
+                            colNum = i + colShift;
+
+                        if (colNum > redoLogRecord->object->columns.size()) {
+                            cerr << "ERROR: too big column id: " << dec << colNum << endl;
+                            break;
+                        }
+
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (i + headerSize + 1) * 2);
+                        if (((*nulls & bits) != 0 || fieldLength == 0) && type == TRANSACTION_DELETE) {
+                            //null
+                        } else {
+                            if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
+                                if (fieldLength != 0) {
+                                    beforePos[colNum] = fieldPos;
+                                    beforeLen[colNum] = fieldLength;
+                                    beforeRecord[colNum] = redoLogRecord;
+                                }
+                            } else {
+                                if ((*nulls & bits) == 0 && fieldLength > 0) {
+                                    appendColumn(redoLogRecord->object, colNum, redoLogRecord, fieldPos, fieldLength, prevValue);
+                                    addKey(redoLogRecord->object->columns[colNum], redoLogRecord, fieldPos, fieldLength);
+                                } else
+                                    appendColumn(redoLogRecord->object, colNum, nullptr, 0, 0, prevValue);
+                            }
+                        }
+
+                        bits <<= 1;
+                        if (bits == 0) {
+                            bits = 1;
+                            ++nulls;
+                        }
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                    }
+
+                    //supplemental columns
+                    if (cc + headerSize + 1 <= redoLogRecord->fieldCnt) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 1) * 2);
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+
+                        if (redoLogRecord->suppLogCC > 0 && redoLogRecord->cc + headerSize + 4 <= redoLogRecord->fieldCnt) {
+                            fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 2) * 2);
+                            colNums = redoLogRecord->data + fieldPos;
+                            fieldPos += (fieldLength + 3) & 0xFFFC;
+
+                            fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 3) * 2);
+                            uint8_t* colSizes = redoLogRecord->data + fieldPos;
+                            fieldPos += (fieldLength + 3) & 0xFFFC;
+
+                            for (uint32_t i = 0; i < redoLogRecord->suppLogCC; ++i) {
+                                fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 4 + i) * 2);
+                                colNum = oracleEnvironment->read16(colNums) + colShift - 1;
+                                colNums += 2;
+                                uint16_t colLength = oracleEnvironment->read16(colSizes);
+
+                                if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
+
+                                    beforePos[colNum] = fieldPos;
+                                    beforeRecord[colNum] = redoLogRecord;
+                                    if (colLength != 0xFFFF) {
+                                        beforeLen[colNum] = colLength;
+                                    } else
+                                        beforeLen[colNum] = 0;
+                                } else {
+                                    if (colLength == 0xFFFF) {
+                                        appendColumn(redoLogRecord->object, colNum, nullptr, 0, 0, prevValue);
+                                    } else {
+                                        appendColumn(redoLogRecord->object, colNum, redoLogRecord, fieldPos, colLength, prevValue);
+                                        addKey(redoLogRecord->object->columns[colNum], redoLogRecord, fieldPos, colLength);
+                                    }
+                                }
+
+                                colSizes += 2;
+                                fieldPos += (fieldLength + 3) & 0xFFFC;
+                            }
+                        }
+                    }
+                }
+
+                redoLogRecord = redoLogRecord->next;
+            }
+            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
+                appendImageEnd();
+        }
+
+        if (type == TRANSACTION_INSERT || type == TRANSACTION_UPDATE) {
+            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
+                appendImageBegin(true);
+            redoLogRecord = redoLogRecord2;
+            prevValue = false;
+
+            while (redoLogRecord != nullptr) {
+                if (oracleEnvironment->trace >= TRACE_FULL)
+                    redoLogRecord->dumpHex(cerr, oracleEnvironment);
+
+                if (redoLogRecord->opCode == 0x0B02) {
+                    fieldPos = redoLogRecord->fieldPos;
+                    nulls = redoLogRecord->data + redoLogRecord->nullsDelta;
+                    bits = 1;
+                    cc = redoLogRecord->cc;
+                    colNum = redoLogRecord->suppLogAfter - 1;
+
+                    for (uint32_t i = 1; i <= 2; ++i) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + i * 2);
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                    }
+
+                    for (uint32_t i = 0; i < cc; ++i) {
+                        if (i + 3 > redoLogRecord->fieldCnt) {
+                            cerr << "ERROR: reached out of columns" << endl;
+                            break;
+                        }
+                        if (colNum > redoLogRecord->object->columns.size()) {
+                            cerr << "ERROR: too big column id: " << dec << colNum << endl;
+                            break;
+                        }
+
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (i + 3) * 2);
+                        if ((*nulls & bits) != 0 || fieldLength == 0) {
+                            //null
+                        } else {
+                            if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
+                                afterPos[colNum] = fieldPos;
+                                afterLen[colNum] = fieldLength;
+                                afterRecord[colNum] = redoLogRecord;
+                            } else {
+                                appendColumn(redoLogRecord->object, colNum, redoLogRecord, fieldPos, fieldLength, prevValue);
+                                if (type == TRANSACTION_INSERT)
+                                    addKey(redoLogRecord->object->columns[colNum], redoLogRecord, fieldPos, fieldLength);
+                            }
+                        }
+
+                        bits <<= 1;
+                        if (bits == 0) {
+                            bits = 1;
+                            ++nulls;
+                        }
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                        ++colNum;
+                    }
+
+                } else if (redoLogRecord->opCode == 0x0B05 || redoLogRecord->opCode == 0x0B06) {
+                    fieldPos = redoLogRecord->fieldPos;
+                    nulls = redoLogRecord->data + redoLogRecord->nullsDelta;
+                    if (redoLogRecord->colNumsDelta > 0) {
+                        colNums = redoLogRecord->data + redoLogRecord->colNumsDelta;
+                        colShift = redoLogRecord->suppLogAfter - 1 - oracleEnvironment->read16(colNums);
+                        headerSize = 3;
+                    } else {
+                        colNums = nullptr;
+                        colShift = redoLogRecord->suppLogAfter - 1;
+                        headerSize = 2;
+                    }
+                    bits = 1;
+
+                    for (uint32_t i = 1; i <= headerSize; ++i) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + i * 2);
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                    }
+
+                    for (uint32_t i = 0; i < redoLogRecord->cc && i + headerSize + 1 <= redoLogRecord->fieldCnt; ++i) {
+                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (i + headerSize + 1) * 2);
+                        if (colNums != nullptr) {
+                            colNum = oracleEnvironment->read16(colNums) + colShift;
+                            colNums += 2;
+                        } else
+                            colNum = i + colShift;
+
+                        if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
+                            if (fieldLength != 0) {
+                                afterPos[colNum] = fieldPos;
+                                afterLen[colNum] = fieldLength;
+                                afterRecord[colNum] = redoLogRecord;
+                            }
+                        } else {
+                            if ((*nulls & bits) != 0 || fieldLength == 0) {
+                                appendColumn(redoLogRecord->object, colNum, nullptr, 0, 0, prevValue);
+                            } else {
+                                appendColumn(redoLogRecord->object, colNum, redoLogRecord, fieldPos, fieldLength, prevValue);
+                            }
+                        }
+
+                        bits <<= 1;
+                        if (bits == 0) {
+                            bits = 1;
+                            ++nulls;
+                        }
+                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                    }
+
+                }
+
+                redoLogRecord = redoLogRecord->next;
+            }
+            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
+                appendImageEnd();
+        }
+
+        if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
+            if (oracleEnvironment->sortCols >= 2) {
+                for (uint32_t i = 0; i < redoLogRecord1->object->totalCols; ++i) {
+                    if (redoLogRecord1->object->columns[i]->numPk == 0) {
+                        if (beforePos[i] > 0 && afterPos[i] > 0 && beforeLen[i] == afterLen[i]) {
+                            if (beforeLen[i] == 0 || memcmp(beforeRecord[i]->data + beforePos[i], afterRecord[i]->data + afterPos[i], beforeLen[i]) == 0) {
+                                beforePos[i] = 0;
+                                afterPos[i] = 0;
+                                beforeLen[i] = 0;
+                                afterLen[i] = 0;
+                            }
+                        }
+                    }
+                }
+            }
+
+            appendImageBegin(false);
+            for (uint32_t i = 0; i < redoLogRecord1->object->totalCols; ++i) {
+                if (beforePos[i] > 0 || afterPos[i] > 0) {
+                    if (beforePos[i] == 0 || beforeLen[i] == 0) {
+                        appendColumn(redoLogRecord1->object, i, nullptr, 0, 0, prevValue);
+                    } else {
+                        appendColumn(redoLogRecord1->object, i, beforeRecord[i], beforePos[i], beforeLen[i], prevValue);
+                        addKey(redoLogRecord1->object->columns[i], beforeRecord[i], beforePos[i], beforeLen[i]);
+                    }
+                }
+            }
+            appendImageEnd();
+            prevValue = false;
+            appendImageBegin(true);
+            for (uint32_t i = 0; i < redoLogRecord1->object->totalCols; ++i) {
+                if (afterPos[i] > 0 || redoLogRecord1->object->columns[i]->numPk > 0) {
+                    //for PK value is only present before
+                    if (afterPos[i] == 0 && redoLogRecord1->object->columns[i]->numPk > 0) {
+                        if (beforeLen[i] == 0) {
+                            appendColumn(redoLogRecord1->object, i, nullptr, 0, 0, prevValue);
+                        } else {
+                            appendColumn(redoLogRecord1->object, i, beforeRecord[i], beforePos[i], beforeLen[i], prevValue);
+                        }
+                    } else {
+                        if (afterLen[i] == 0) {
+                            appendColumn(redoLogRecord1->object, i, nullptr, 0, 0, prevValue);
+                        } else {
+                            appendColumn(redoLogRecord1->object, i, afterRecord[i], afterPos[i], afterLen[i], prevValue);
+                        }
+                    }
+                }
+            }
+            appendImageEnd();
+
+            delete afterRecord;
+            delete beforeRecord;
+            delete afterLen;
+            delete beforeLen;
+            delete afterPos;
+            delete beforePos;
+        }
+
+        appendRowEnd();
+        endKey();
+    }
+
+    //0x18010000
+    void JsonWriter::parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment) {
+        uint32_t fieldPos = redoLogRecord1->fieldPos;
+        uint16_t seq = 0, cnt = 0, type;
+
+        uint16_t fieldLength;
+        for (uint32_t i = 1; i <= redoLogRecord1->fieldCnt; ++i) {
+            fieldLength = oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + i * 2);
+            if (i == 1) {
+                type = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 12);
+                seq = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 18);
+                cnt = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 20);
+                if (oracleEnvironment->trace >= TRACE_DETAIL) {
+                    cerr << "SEQ: " << dec << seq << "/" << dec << cnt << endl;
+                }
+            } else if (i == 8) {
+                //DDL text
+                if (oracleEnvironment->trace >= TRACE_FULL) {
+                    cerr << "DDL[" << dec << fieldLength << "]: ";
+                    for (uint32_t j = 0; j < fieldLength; ++j) {
+                        cerr << *(redoLogRecord1->data + fieldPos + j);
+                    }
+                    cerr << endl;
+                }
+            } else if (i == 9) {
+                //owner
+                if (oracleEnvironment->trace >= TRACE_FULL) {
+                    cerr << "OWNER[" << dec << fieldLength << "]: ";
+                    for (uint32_t j = 0; j < fieldLength; ++j) {
+                        cerr << *(redoLogRecord1->data + fieldPos + j);
+                    }
+                    cerr << endl;
+                }
+            } else if (i == 10) {
+                //table
+                if (oracleEnvironment->trace >= TRACE_FULL) {
+                    cerr << "TABLE[" << fieldLength << "]: ";
+                    for (uint32_t j = 0; j < fieldLength; ++j) {
+                        cerr << *(redoLogRecord1->data + fieldPos + j);
+                    }
+                    cerr << endl;
+                }
+            } else if (i == 12) {
+                redoLogRecord1->objn = oracleEnvironment->read32(redoLogRecord1->data + fieldPos + 0);
+                if (oracleEnvironment->trace >= TRACE_FULL) {
+                    cerr << "OBJN: " << dec << redoLogRecord1->objn << endl;
+                }
+            }
+
+            fieldPos += (fieldLength + 3) & 0xFFFC;
+        }
+
+        if (type == 85)
+            appendTruncate(redoLogRecord1->object);
+    }
+}
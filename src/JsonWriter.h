@@ -0,0 +1,69 @@
+/* Header for JsonWriter class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <stdint.h>
+#include "types.h"
+#include "Writer.h"
+
+#ifndef JSONWRITER_H_
+#define JSONWRITER_H_
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    class RedoLogRecord;
+    class CommandBuffer;
+    class OracleEnvironment;
+    class OracleObject;
+
+    //formats transactions as JSON messages in the buffer of the source, has no thread and no connection to a target
+    class JsonWriter : public Writer {
+    protected:
+        virtual void appendRowBegin(uint32_t type, OracleObject *object, uint32_t objn, uint32_t objd, uint16_t afn, uint32_t bdba, uint16_t slot);
+        virtual void appendRowEnd();
+        virtual void appendImageBegin(bool after);
+        virtual void appendImageEnd();
+        virtual void appendColumn(OracleObject *object, uint32_t colNum, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength,
+                bool &prevValue);
+        virtual void appendTruncate(OracleObject *object);
+
+    public:
+        virtual void *run();
+
+        virtual void beginTran(typescn scn, typexid xid);
+        virtual void beginProvisional(typescn scn, typexid xid);
+        virtual void beginMarker(typescn scn, typexid xid);
+        virtual void endTran(typescn scn, typexid xid, bool rollback, bool partial);
+        virtual void rollbackSavepoint(typescn scn, typexid xid, typeuba uba);
+        virtual void next();
+        virtual void commitTran();
+        virtual void parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment);
+        virtual void parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment);
+        virtual void parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment);
+        virtual void parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment);
+        virtual Writer *clone(CommandBuffer *commandBuffer);
+
+        JsonWriter(const string alias, CommandBuffer *commandBuffer, uint32_t format, bool markers);
+        virtual ~JsonWriter();
+    };
+}
+
+#endif
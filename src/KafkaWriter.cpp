@@ -19,35 +19,44 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 
 #include <sys/stat.h>
 #include <string>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <cstdio>
 #include <mutex>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <librdkafka/rdkafkacpp.h>
 #include "types.h"
 #include "KafkaWriter.h"
-#include "OracleEnvironment.h"
 #include "CommandBuffer.h"
-#include "OracleColumn.h"
 #include "OracleObject.h"
-#include "RedoLogRecord.h"
 
 using namespace std;
 using namespace RdKafka;
 
 namespace OpenLogReplicator {
 
-    KafkaWriter::KafkaWriter(const string alias, const string brokers, const string topic, CommandBuffer *commandBuffer, uint32_t trace) :
-        Writer(alias, commandBuffer),
+    KafkaWriter::KafkaWriter(const string alias, const string brokers, const string topic, CommandBuffer *commandBuffer, Writer *formatter, uint32_t trace,
+            uint32_t threads, uint32_t route, bool topicPerTable, uint32_t batchCount, uint32_t batchBytes, uint32_t batchLinger,
+            bool batchLines) :
+        SinkWriter(alias, commandBuffer, formatter),
         conf(nullptr),
         tconf(nullptr),
         brokers(brokers.c_str()),
         topic(topic.c_str()),
         producer(nullptr),
         ktopic(nullptr),
-        trace(trace){
+        trace(trace),
+        threads(threads),
+        route(route),
+        topicPerTable(topicPerTable),
+        batchCount(batchCount),
+        batchBytes(batchBytes),
+        batchLinger(batchLinger),
+        batchLines(batchLines) {
     }
 
     KafkaWriter::~KafkaWriter() {
@@ -72,716 +81,322 @@ namespace OpenLogReplicator {
     void *KafkaWriter::run() {
         cout << "- Kafka Writer for: " << brokers << " topic: " << topic << endl;
 
-        while (!this->shutdown) {
-            uint32_t length;
-            {
-                unique_lock<mutex> lck(commandBuffer->mtx);
-                while (commandBuffer->posStart == commandBuffer->posEnd) {
-                    commandBuffer->readersCond.wait(lck);
-
-                    if (this->shutdown)
-                        break;
-                }
-                if (this->shutdown)
-                    break;
-
-                if (commandBuffer->posStart == commandBuffer->posSize && commandBuffer->posSize > 0) {
-                    commandBuffer->posStart = 0;
-                    commandBuffer->posSize = 0;
-                }
-                length = *((uint32_t*)(commandBuffer->intraThreadBuffer + commandBuffer->posStart));
-            }
-            //cout << "Buffer: " << commandBuffer->posStart << " - " << commandBuffer->posEnd << endl;
+        KafkaWriterThread *shards = new KafkaWriterThread[threads];
+        for (uint32_t i = 0; i < threads; ++i) {
+            shards[i].kafkaWriter = this;
+            shards[i].shard = i;
+            pthread_create(&shards[i].pthread, nullptr, &KafkaWriter::runShardStatic, (void*)&shards[i]);
+        }
 
-            if (trace <= 0) {
-                if (producer->produce(
-                        ktopic, Topic::PARTITION_UA, Producer::RK_MSG_COPY, commandBuffer->intraThreadBuffer + commandBuffer->posStart + 4,
-                        length - 4, nullptr, nullptr)) {
-                    cerr << "ERROR: writing to topic " << endl;
-                }
-            } else {
-                cout << "KAFKA: ";
-                for (uint32_t i = 0; i < length - 4; ++i)
-                    cout << commandBuffer->intraThreadBuffer[commandBuffer->posStart + 4 + i];
-                cout << endl;
+        //delivery reports release space in the buffer
+        chrono::steady_clock::time_point report = chrono::steady_clock::now() + chrono::seconds(KAFKA_WRITER_REPORT_SEC);
+        while (!this->shutdown) {
+            if (producer != nullptr)
+                producer->poll(100);
+            else
+                usleep(100000);
+
+            if (compressor != nullptr && chrono::steady_clock::now() >= report) {
+                compressor->report(alias);
+                report += chrono::seconds(KAFKA_WRITER_REPORT_SEC);
             }
+        }
 
-            {
-                unique_lock<mutex> lck(commandBuffer->mtx);
-                commandBuffer->posStart += (length + 3) & 0xFFFFFFFC;
-
-                if (commandBuffer->posStart == commandBuffer->posSize && commandBuffer->posSize > 0) {
-                    commandBuffer->posStart = 0;
-                    commandBuffer->posSize = 0;
-                }
+        for (uint32_t i = 0; i < threads; ++i)
+            pthread_join(shards[i].pthread, nullptr);
+        delete[] shards;
+        if (compressor != nullptr)
+            compressor->report(alias);
 
-                commandBuffer->writerCond.notify_all();
-            }
-        }
+        if (producer != nullptr)
+            producer->flush(1000);
 
         return 0;
     }
 
-    int KafkaWriter::initialize() {
-        string errstr;
-        Conf *conf = Conf::create(Conf::CONF_GLOBAL);
-        Conf *tconf = Conf::create(Conf::CONF_TOPIC);
-        conf->set("metadata.broker.list", brokers, errstr);
-
-        if (trace <= 0) {
-            producer = Producer::create(conf, errstr);
-            if (producer == nullptr) {
-                std::cerr << "ERROR: creating Kafka producer: " << errstr << endl;
-                return 0;
-            }
-
-            ktopic = Topic::create(producer, topic, tconf, errstr);
-            if (ktopic == nullptr) {
-                std::cerr << "ERROR: Failed to create Kafka topic: " << errstr << endl;
-                return 0;
-            }
-        }
-
-        return 1;
+    void *KafkaWriter::runShardStatic(void *context) {
+        KafkaWriterThread *kafkaWriterThread = (KafkaWriterThread *)context;
+        kafkaWriterThread->kafkaWriter->runShard(kafkaWriterThread->shard);
+        return nullptr;
     }
 
-    void KafkaWriter::beginTran(typescn scn, typexid xid) {
-        commandBuffer
-                ->beginTran()
-                ->append("{\"scn\": \"")
-                ->append(to_string(scn))
-                ->append("\", \"xid\": \"0x")
-                ->appendHex(USN(xid), 4)
-                ->append('.')
-                ->appendHex(SLT(xid), 3)
-                ->append('.')
-                ->appendHex(SQN(xid), 8)
-                ->append("\", dml: [");
-    }
+    //undelivered message keeps its buffer space, so nothing after it is released either
+    void KafkaWriter::dr_cb(Message &message) {
+        if (message.err() != ERR_NO_ERROR) {
+            cerr << "ERROR: Kafka delivery failed: " << message.errstr() << ", writer " << alias << " stopped" << endl;
+            this->shutdown = true;
+            return;
+        }
 
-    void KafkaWriter::next() {
-        commandBuffer->append(", ");
+        CommandBufferAck *ack = (CommandBufferAck*)message.msg_opaque();
+        if (ack != nullptr)
+            commandBuffer->ackTran(ack);
     }
 
-    void KafkaWriter::commitTran() {
-        commandBuffer
-                ->append("]}")
-                ->commitTran();
+    void KafkaWriter::stopOnError(ErrorCode err, uint32_t messages) {
+        cerr << "ERROR: writing to topic: " << err2str(err) << ", transactions: " << dec << messages << ", writer " << alias << " stopped" << endl;
+        this->shutdown = true;
     }
 
-    //0x05010B0B
-    void KafkaWriter::parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) {
-        uint32_t pos = 0;
-        uint32_t fieldPos = redoLogRecord2->fieldPos, fieldPosStart;
-        bool prevValue;
-        uint16_t fieldLength;
+    //messages of one key or table are always read by the same thread, so they keep their order
+    void KafkaWriter::runShard(uint32_t shard) {
+        unordered_map<OracleObject*, Topic*> topics;
+        KafkaWriterBatch batch = {nullptr, 0, 0, nullptr, 0, false, nullptr};
+        if (batchCount > 1 && trace <= 0)
+            batch.data = new uint8_t[batchBytes];
 
-        for (uint32_t i = 1; i < 4; ++i) {
-            fieldLength = oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->fieldLengthsDelta + i * 2);
-            fieldPos += (fieldLength + 3) & 0xFFFC;
-        }
-        fieldPosStart = fieldPos;
-
-        for (uint32_t r = 0; r < redoLogRecord2->nrow; ++r) {
-            if (r > 0)
-                commandBuffer->append(", ");
-
-            pos = 0;
-            prevValue = false;
-            fieldPos = fieldPosStart;
-            uint8_t jcc = redoLogRecord2->data[fieldPos + pos + 2];
-            pos = 3;
-
-            commandBuffer
-                    ->append("{\"operation\": \"insert\", \"table\": \"")
-                    ->append(redoLogRecord2->object->owner)
-                    ->append('.')
-                    ->append(redoLogRecord2->object->objectName)
-                    ->append("\", \"rowid\": \"")
-                    ->appendRowid(redoLogRecord1->objn, redoLogRecord1->objd, redoLogRecord2->afn, redoLogRecord2->bdba - oracleEnvironment->getBase(),
-                            oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->slotsDelta + r * 2))
-                    ->append("\", \"after\": {");
-
-            for (uint32_t i = 0; i < redoLogRecord2->object->columns.size(); ++i) {
-                bool isNull = false;
-
-                if (i >= jcc)
-                    isNull = true;
-                else {
-                    fieldLength = redoLogRecord2->data[fieldPos + pos];
-                    ++pos;
-                    if (fieldLength == 0xFF) {
-                        isNull = true;
-                    } else
-                    if (fieldLength == 0xFE) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord2->data + fieldPos + pos);
-                        pos += 2;
-                    }
+        while (!this->shutdown) {
+            CommandBufferHeader *header;
+            //compressed messages are sent in order, too many waiting stop the thread
+            if (!batch.jobs.empty())
+                sendJobs(batch, KAFKA_WRITER_JOBS_MAX - 1);
+
+            //batch is sent when no new message comes until the end of linger time
+            if (batch.messages > 0 || !batch.jobs.empty()) {
+                chrono::steady_clock::time_point now = chrono::steady_clock::now();
+                uint64_t waitUs = KAFKA_WRITER_JOBS_POLL_US;
+                if (batch.messages > 0) {
+                    uint64_t lingerUs = 0;
+                    if (now < batch.end)
+                        lingerUs = chrono::duration_cast<chrono::microseconds>(batch.end - now).count();
+                    if (batch.jobs.empty() || lingerUs < waitUs)
+                        waitUs = lingerUs;
                 }
-
-                //NULL values
-                if (!isNull) {
-                    if (prevValue)
-                        commandBuffer->append(", ");
-                    else
-                        prevValue = true;
-
-                    commandBuffer
-                            ->append('"')
-                            ->append(redoLogRecord2->object->columns[i]->columnName)
-                            ->append("\": \"");
-
-                    appendValue(redoLogRecord2, redoLogRecord2->object->columns[i]->typeNo, fieldPos + pos, fieldLength);
-                    commandBuffer->append('"');
-
-                    pos += fieldLength;
+                header = commandBuffer->getTran(consumer + shard, waitUs);
+                if (header == nullptr) {
+                    if (batch.messages > 0 && chrono::steady_clock::now() >= batch.end)
+                        sendBatch(batch);
+                    continue;
                 }
+            } else {
+                header = commandBuffer->getTran(consumer + shard);
+                if (header == nullptr)
+                    break;
+            }
+            uint8_t *data = (uint8_t*)header + COMMAND_BUFFER_HEADER;
+            uint32_t length = header->length - COMMAND_BUFFER_HEADER;
+
+            //same key goes to the same partition
+            uint32_t key = 0;
+            bool hasKey = false;
+            if (route == MESSAGE_ROUTE_KEY && (header->flags & MESSAGE_FLAG_KEY) != 0) {
+                key = header->key;
+                hasKey = true;
+            } else if (route != MESSAGE_ROUTE_NONE && header->object != nullptr) {
+                key = header->object->objn;
+                hasKey = true;
             }
 
-            commandBuffer->append("}}");
-
-            fieldPosStart += oracleEnvironment->read16(redoLogRecord2->data + redoLogRecord2->rowLenghsDelta + r * 2);
-        }
-    }
-
-    //0x05010B0C
-    void KafkaWriter::parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) {
-        uint32_t pos = 0;
-        uint32_t fieldPos = redoLogRecord1->fieldPos, fieldPosStart;
-        bool prevValue;
-        uint16_t fieldLength;
-        //uint16_t rowLengths;
-
-        for (uint32_t i = 1; i < 6; ++i) {
-            fieldLength = oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + i * 2);
-            fieldPos += (fieldLength + 3) & 0xFFFC;
-            //if (i == 5)
-            //    rowLengths = fieldPos;
-        }
-        fieldPosStart = fieldPos;
-
-        for (uint32_t r = 0; r < redoLogRecord1->nrow; ++r) {
-            if (r > 0)
-                commandBuffer->append(", ");
-
-            pos = 0;
-            prevValue = false;
-            fieldPos = fieldPosStart;
-            uint8_t jcc = redoLogRecord1->data[fieldPos + pos + 2];
-            pos = 3;
-
-            commandBuffer
-                    ->append("{\"operation\": \"delete\", \"table\": \"")
-                    ->append(redoLogRecord1->object->owner)
-                    ->append('.')
-                    ->append(redoLogRecord1->object->objectName)
-                    ->append("\", \"rowid\": \"")
-                    ->appendRowid(redoLogRecord1->objn, redoLogRecord1->objd, redoLogRecord2->afn, redoLogRecord2->bdba - oracleEnvironment->getBase(),
-                            oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->slotsDelta + r * 2))
-                    ->append("\", \"before\": {");
-
-            for (uint32_t i = 0; i < redoLogRecord1->object->columns.size(); ++i) {
-                bool isNull = false;
-
-                if (i >= jcc)
-                    isNull = true;
-                else {
-                    fieldLength = redoLogRecord1->data[fieldPos + pos];
-                    ++pos;
-                    if (fieldLength == 0xFF) {
-                        isNull = true;
-                    } else
-                    if (fieldLength == 0xFE) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + pos);
-                        pos += 2;
-                    }
-                }
-
-                //NULL values
-                if (!isNull) {
-                    if (prevValue)
-                        commandBuffer->append(", ");
+            if (trace <= 0) {
+                Topic *messageTopic = ktopic;
+                if (topicPerTable && header->object != nullptr)
+                    messageTopic = getTopic(topics, header->object);
+
+                //small messages of the same topic and key are copied to one message, one transaction per line
+                if (batch.data != nullptr && length < batchBytes) {
+                    if (batch.messages > 0 && (batch.topic != messageTopic || batch.hasKey != hasKey || batch.key != key ||
+                            batch.length + (batchLines ? 1 : 0) + length > batchBytes))
+                        sendBatch(batch);
+
+                    if (batch.messages == 0) {
+                        batch.topic = messageTopic;
+                        batch.key = key;
+                        batch.hasKey = hasKey;
+                        batch.end = chrono::steady_clock::now() + chrono::milliseconds(batchLinger);
+                    } else if (batchLines)
+                        batch.data[batch.length++] = '\n';
+                    memcpy(batch.data + batch.length, data, length);
+                    batch.length += length;
+                    ++batch.messages;
+                    //ack of the first message covers following messages, they are released after it
+                    if (batch.ack == nullptr && commandBuffer->isInBuffer(header))
+                        batch.ack = commandBuffer->releaseTranDeferred(consumer + shard);
                     else
-                        prevValue = true;
+                        commandBuffer->releaseTran(consumer + shard);
 
-                    commandBuffer
-                            ->append('"')
-                            ->append(redoLogRecord1->object->columns[i]->columnName)
-                            ->append("\": \"");
-
-                    appendValue(redoLogRecord1, redoLogRecord1->object->columns[i]->typeNo, fieldPos + pos, fieldLength);
-                    commandBuffer->append('"');
-
-                    pos += fieldLength;
+                    if (batch.messages >= batchCount)
+                        sendBatch(batch);
+                    continue;
                 }
-            }
-
-            commandBuffer->append("}}");
-
-            fieldPosStart += oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->rowLenghsDelta + r * 2);
-        }
-    }
-
-    void KafkaWriter::parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment) {
-        if (type == TRANSACTION_INSERT)
-            commandBuffer->append("{\"operation\": \"insert\", \"table\": \"");
-        else if (type == TRANSACTION_DELETE)
-            commandBuffer->append("{\"operation\": \"delete\", \"table\": \"");
-        else
-            commandBuffer->append("{\"operation\": \"update\", \"table\": \"");
-
-        commandBuffer
-                ->append(redoLogRecord2->object->owner)
-                ->append('.')
-                ->append(redoLogRecord2->object->objectName)
-                ->append("\", \"rowid\": \"")
-                ->appendRowid(redoLogRecord1->objn, redoLogRecord1->objd, redoLogRecord2->afn, redoLogRecord2->suppLogBdba - oracleEnvironment->getBase(), redoLogRecord2->suppLogSlot)
-                ->append("\"");
-
-        uint32_t fieldPos, colNum, colShift, cc, headerSize;
-        uint16_t fieldLength;
-        uint8_t *nulls, bits, *colNums;
-        bool prevValue;
-        RedoLogRecord *redoLogRecord;
-        uint32_t *afterPos = nullptr, *beforePos = nullptr;
-        uint16_t *afterLen = nullptr, *beforeLen = nullptr;
-        RedoLogRecord **beforeRecord, **afterRecord;
-        if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
-            afterPos = new uint32_t[redoLogRecord1->object->totalCols * sizeof(uint32_t)];
-            memset(afterPos, 0, redoLogRecord1->object->totalCols * sizeof(uint32_t));
-            beforePos = new uint32_t[redoLogRecord1->object->totalCols * sizeof(uint32_t)];
-            memset(beforePos, 0, redoLogRecord1->object->totalCols * sizeof(uint32_t));
-            afterLen = new uint16_t[redoLogRecord1->object->totalCols * sizeof(uint16_t)];
-            beforeLen = new uint16_t[redoLogRecord1->object->totalCols * sizeof(uint16_t)];
-            beforeRecord = new RedoLogRecord*[redoLogRecord1->object->totalCols * sizeof(RedoLogRecord *)];
-            afterRecord = new RedoLogRecord*[redoLogRecord1->object->totalCols * sizeof(RedoLogRecord *)];
-
-        }
-
-        if (type == TRANSACTION_DELETE || type == TRANSACTION_UPDATE) {
-            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
-                commandBuffer->append(", \"before\": {");
-            redoLogRecord = redoLogRecord1;
-            prevValue = false;
-            colNums = nullptr;
-
-            while (redoLogRecord != nullptr) {
-                if (oracleEnvironment->trace >= TRACE_FULL)
-                    redoLogRecord->dumpHex(cerr, oracleEnvironment);
-
-                if (redoLogRecord->opCode == 0x0501) {
-                    fieldPos = redoLogRecord->fieldPos;
-                    nulls = redoLogRecord->data + redoLogRecord->nullsDelta;
-                    bits = 1;
-                    cc = redoLogRecord->cc;
-                    if (redoLogRecord->colNumsDelta > 0) {
-                        colNums = redoLogRecord->data + redoLogRecord->colNumsDelta;
-                        headerSize = 5;
-                        colShift = redoLogRecord->suppLogBefore - 1 - oracleEnvironment->read16(colNums);
-                    } else {
-                        colNums = nullptr;
-                        headerSize = 4;
-                        colShift = redoLogRecord->suppLogBefore - 1;
-                    }
-
-                    for (uint32_t i = 1; i <= headerSize; ++i) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + i * 2);
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
-                    }
-
-                    for (uint32_t i = 0; i < cc; ++i) {
-                        if (i + headerSize + 1 > redoLogRecord->fieldCnt) {
-                            cerr << "ERROR: reached out of columns" << endl;
-                            break;
-                        }
-                        if (colNums != nullptr) {
-                            colNum = oracleEnvironment->read16(colNums) + colShift;
-                            colNums += 2;
-                        } else
-                            colNum = i + colShift;
-
-                        if (colNum > redoLogRecord->object->columns.size()) {
-                            cerr << "ERROR: too big column id: " << dec << colNum << endl;
-                            break;
-                        }
-
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (i + headerSize + 1) * 2);
-                        if (((*nulls & bits) != 0 || fieldLength == 0) && type == TRANSACTION_DELETE) {
-                            //null
-                        } else {
-                            if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
-                                if (fieldLength != 0) {
-                                    beforePos[colNum] = fieldPos;
-                                    beforeLen[colNum] = fieldLength;
-                                    beforeRecord[colNum] = redoLogRecord;
-                                }
-                            } else {
-                                if (prevValue) {
-                                    commandBuffer->append(", ");
-                                } else
-                                    prevValue = true;
-
-                                commandBuffer
-                                        ->append('"')
-                                        ->append(redoLogRecord->object->columns[colNum]->columnName)
-                                        ->append("\": \"");
-
-                                if ((*nulls & bits) == 0 && fieldLength > 0)
-                                    appendValue(redoLogRecord, redoLogRecord->object->columns[colNum]->typeNo, fieldPos, fieldLength);
-
-                                commandBuffer->append('"');
-                            }
-                        }
-
-                        bits <<= 1;
-                        if (bits == 0) {
-                            bits = 1;
-                            ++nulls;
-                        }
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
+                if (batch.messages > 0)
+                    sendBatch(batch);
+
+                //message in the buffer is compressed without copying, message from spill file is overwritten by next read
+                if (compressor != nullptr) {
+                    if (commandBuffer->isInBuffer(header))
+                        compressMessage(batch, messageTopic, data, length, key, hasKey, 1, false,
+                                commandBuffer->releaseTranDeferred(consumer + shard));
+                    else {
+                        uint8_t *dataCopy = new uint8_t[length];
+                        memcpy(dataCopy, data, length);
+                        compressMessage(batch, messageTopic, dataCopy, length, key, hasKey, 1, true, nullptr);
+                        commandBuffer->releaseTran(consumer + shard);
                     }
+                    continue;
+                }
 
-                    //supplemental columns
-                    if (cc + headerSize + 1 <= redoLogRecord->fieldCnt) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 1) * 2);
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
-
-                        if (redoLogRecord->suppLogCC > 0 && redoLogRecord->cc + headerSize + 4 <= redoLogRecord->fieldCnt) {
-                            fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 2) * 2);
-                            colNums = redoLogRecord->data + fieldPos;
-                            fieldPos += (fieldLength + 3) & 0xFFFC;
-
-                            fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 3) * 2);
-                            uint8_t* colSizes = redoLogRecord->data + fieldPos;
-                            fieldPos += (fieldLength + 3) & 0xFFFC;
-
-                            for (uint32_t i = 0; i < redoLogRecord->suppLogCC; ++i) {
-                                fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (redoLogRecord->cc + headerSize + 4 + i) * 2);
-                                colNum = oracleEnvironment->read16(colNums) + colShift - 1;
-                                colNums += 2;
-                                uint16_t colLength = oracleEnvironment->read16(colSizes);
-
-                                if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
-
-                                    beforePos[colNum] = fieldPos;
-                                    beforeRecord[colNum] = redoLogRecord;
-                                    if (colLength != 0xFFFF) {
-                                        beforeLen[colNum] = colLength;
-                                    } else
-                                        beforeLen[colNum] = 0;
-                                } else {
-                                    if (prevValue) {
-                                        commandBuffer->append(", ");
-                                    } else
-                                        prevValue = true;
-
-                                    commandBuffer
-                                            ->append('"')
-                                            ->append(redoLogRecord->object->columns[colNum]->columnName)
-                                            ->append("\": \"");
-
-                                    if (colLength == 0xFFFF) {
-                                        //null
-                                    } else {
-                                        appendValue(redoLogRecord, redoLogRecord->object->columns[colNum]->typeNo, fieldPos, colLength);
-                                    }
-
-                                    commandBuffer
-                                            ->append('"');
-                                }
-
-                                colSizes += 2;
-                                fieldPos += (fieldLength + 3) & 0xFFFC;
-                            }
-                        }
-                    }
+                //message in the buffer is sent without copying, space is released by delivery report
+                CommandBufferAck *ack = nullptr;
+                int msgflags = Producer::RK_MSG_COPY;
+                if (commandBuffer->isInBuffer(header)) {
+                    ack = commandBuffer->releaseTranDeferred(consumer + shard);
+                    msgflags = 0;
                 }
 
-                redoLogRecord = redoLogRecord->next;
+                ErrorCode err = produce(messageTopic, msgflags, data, length, hasKey ? &key : nullptr, ack, nullptr);
+                if (err != ERR_NO_ERROR)
+                    stopOnError(err, 1);
+                if (ack == nullptr)
+                    commandBuffer->releaseTran(consumer + shard);
+            } else {
+                cout << "KAFKA: ";
+                for (uint32_t i = 0; i < length; ++i)
+                    cout << data[i];
+                cout << endl;
+                commandBuffer->releaseTran(consumer + shard);
             }
-            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
-                commandBuffer->append("}");
         }
 
-        if (type == TRANSACTION_INSERT || type == TRANSACTION_UPDATE) {
-            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
-                commandBuffer->append(", \"after\": {");
-            redoLogRecord = redoLogRecord2;
-            prevValue = false;
-
-            while (redoLogRecord != nullptr) {
-                if (oracleEnvironment->trace >= TRACE_FULL)
-                    redoLogRecord->dumpHex(cerr, oracleEnvironment);
-
-                if (redoLogRecord->opCode == 0x0B02) {
-                    fieldPos = redoLogRecord->fieldPos;
-                    nulls = redoLogRecord->data + redoLogRecord->nullsDelta;
-                    bits = 1;
-                    cc = redoLogRecord->cc;
-                    colNum = redoLogRecord->suppLogAfter - 1;
-
-                    for (uint32_t i = 1; i <= 2; ++i) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + i * 2);
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
-                    }
+        if (batch.messages > 0)
+            sendBatch(batch);
+        sendJobs(batch, 0);
+        if (batch.data != nullptr)
+            delete[] batch.data;
 
-                    for (uint32_t i = 0; i < cc; ++i) {
-                        if (i + 3 > redoLogRecord->fieldCnt) {
-                            cerr << "ERROR: reached out of columns" << endl;
-                            break;
-                        }
-                        if (colNum > redoLogRecord->object->columns.size()) {
-                            cerr << "ERROR: too big column id: " << dec << colNum << endl;
-                            break;
-                        }
-
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (i + 3) * 2);
-                        if ((*nulls & bits) != 0 || fieldLength == 0) {
-                            //null
-                        } else {
-                            if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
-                                afterPos[colNum] = fieldPos;
-                                afterLen[colNum] = fieldLength;
-                                afterRecord[colNum] = redoLogRecord;
-                            } else {
-                                if (prevValue)
-                                    commandBuffer->append(", ");
-                                else
-                                    prevValue = true;
-
-                                commandBuffer
-                                        ->append('"')
-                                        ->append(redoLogRecord->object->columns[colNum]->columnName)
-                                        ->append("\": \"");
-
-                                appendValue(redoLogRecord, redoLogRecord->object->columns[colNum]->typeNo, fieldPos, fieldLength);
-
-                                commandBuffer->append('"');
-                            }
-                        }
-
-                        bits <<= 1;
-                        if (bits == 0) {
-                            bits = 1;
-                            ++nulls;
-                        }
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
-                        ++colNum;
-                    }
+        for (auto it : topics)
+            if (it.second != ktopic)
+                delete it.second;
+    }
 
-                } else if (redoLogRecord->opCode == 0x0B05 || redoLogRecord->opCode == 0x0B06) {
-                    fieldPos = redoLogRecord->fieldPos;
-                    nulls = redoLogRecord->data + redoLogRecord->nullsDelta;
-                    if (redoLogRecord->colNumsDelta > 0) {
-                        colNums = redoLogRecord->data + redoLogRecord->colNumsDelta;
-                        colShift = redoLogRecord->suppLogAfter - 1 - oracleEnvironment->read16(colNums);
-                        headerSize = 3;
-                    } else {
-                        colNums = nullptr;
-                        colShift = redoLogRecord->suppLogAfter - 1;
-                        headerSize = 2;
-                    }
-                    bits = 1;
+    //full producer queue stops the thread until delivery reports free some space,
+    //target with compression marks every message with header: zstd, lz4 or none when compression failed
+    ErrorCode KafkaWriter::produce(Topic *messageTopic, int msgflags, uint8_t *data, uint32_t length, uint32_t *key, CommandBufferAck *ack,
+            const char *compression) {
+        ErrorCode err;
+        while (true) {
+            if (compression == nullptr)
+                err = producer->produce(messageTopic, Topic::PARTITION_UA, msgflags, data, length,
+                        key, key != nullptr ? sizeof(*key) : 0, ack);
+            else {
+                //headers are owned by the producer only when the message is accepted
+                Headers *headers = Headers::create();
+                headers->add(KAFKA_WRITER_HEADER_COMPRESSION, compression);
+                err = producer->produce(messageTopic->name(), Topic::PARTITION_UA, msgflags, data, length,
+                        key, key != nullptr ? sizeof(*key) : 0, 0, headers, ack);
+                if (err != ERR_NO_ERROR)
+                    delete headers;
+            }
 
-                    for (uint32_t i = 1; i <= headerSize; ++i) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + i * 2);
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
-                    }
+            if (err != ERR__QUEUE_FULL || this->shutdown)
+                return err;
+            producer->poll(100);
+        }
+    }
 
-                    for (uint32_t i = 0; i < redoLogRecord->cc && i + headerSize + 1 <= redoLogRecord->fieldCnt; ++i) {
-                        fieldLength = oracleEnvironment->read16(redoLogRecord->data + redoLogRecord->fieldLengthsDelta + (i + headerSize + 1) * 2);
-                        if (colNums != nullptr) {
-                            colNum = oracleEnvironment->read16(colNums) + colShift;
-                            colNums += 2;
-                        } else
-                            colNum = i + colShift;
-
-                        if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
-                            if (fieldLength != 0) {
-                                afterPos[colNum] = fieldPos;
-                                afterLen[colNum] = fieldLength;
-                                afterRecord[colNum] = redoLogRecord;
-                            }
-                        } else {
-                            if (prevValue)
-                                commandBuffer->append(", ");
-                            else
-                                prevValue = true;
-
-                            commandBuffer
-                                    ->append('"')
-                                    ->append(redoLogRecord->object->columns[colNum]->columnName)
-                                    ->append("\": \"");
-
-                            if ((*nulls & bits) != 0 || fieldLength == 0) {
-                                //nulls
-                            } else {
-                                appendValue(redoLogRecord, redoLogRecord->object->columns[colNum]->typeNo, fieldPos, fieldLength);
-
-                            }
-
-                            commandBuffer->append('"');
-                        }
-
-                        bits <<= 1;
-                        if (bits == 0) {
-                            bits = 1;
-                            ++nulls;
-                        }
-                        fieldPos += (fieldLength + 3) & 0xFFFC;
-                    }
+    void KafkaWriter::sendBatch(KafkaWriterBatch &batch) {
+        //batch buffer is handed to the compression job
+        if (compressor != nullptr) {
+            compressMessage(batch, batch.topic, batch.data, batch.length, batch.key, batch.hasKey, batch.messages, true, batch.ack);
+            batch.data = new uint8_t[batchBytes];
+        } else {
+            ErrorCode err = produce(batch.topic, Producer::RK_MSG_COPY, batch.data, batch.length, batch.hasKey ? &batch.key : nullptr, batch.ack,
+                    nullptr);
+            if (err != ERR_NO_ERROR)
+                stopOnError(err, batch.messages);
+        }
+        batch.length = 0;
+        batch.messages = 0;
+        batch.ack = nullptr;
+    }
 
-                }
+    //data is not copied, buffer space of the message is released by delivery report of compressed message
+    void KafkaWriter::compressMessage(KafkaWriterBatch &batch, Topic *messageTopic, uint8_t *data, uint32_t length, uint32_t key, bool hasKey,
+            uint32_t messages, bool ownsData, CommandBufferAck *ack) {
+        KafkaWriterJob *job = new KafkaWriterJob();
+        job->data = data;
+        job->length = length;
+        job->topic = messageTopic;
+        job->key = key;
+        job->hasKey = hasKey;
+        job->messages = messages;
+        job->ownsData = ownsData;
+        job->ack = ack;
+
+        compressor->submit(job);
+        batch.jobs.push_back(job);
+    }
 
-                redoLogRecord = redoLogRecord->next;
+    //sends compressed messages from the front of the queue, waits while more than keep are left
+    void KafkaWriter::sendJobs(KafkaWriterBatch &batch, uint32_t keep) {
+        while (!batch.jobs.empty()) {
+            KafkaWriterJob *job = batch.jobs.front();
+            if (!job->done) {
+                if (batch.jobs.size() <= keep)
+                    break;
+                compressor->wait(job);
             }
-            if (type != TRANSACTION_UPDATE || oracleEnvironment->sortCols == 0)
-                commandBuffer->append("}");
+            batch.jobs.pop_front();
+
+            ErrorCode err;
+            //output is freed by the producer after delivery
+            if (job->output != nullptr) {
+                err = produce(job->topic, Producer::RK_MSG_FREE, job->output, job->outputLength, job->hasKey ? &job->key : nullptr, job->ack,
+                        compressor->getName());
+                if (err != ERR_NO_ERROR)
+                    free(job->output);
+            } else
+                err = produce(job->topic, Producer::RK_MSG_COPY, job->data, job->length, job->hasKey ? &job->key : nullptr, job->ack, "none");
+            if (err != ERR_NO_ERROR)
+                stopOnError(err, job->messages);
+
+            if (job->ownsData)
+                delete[] job->data;
+            delete job;
         }
+    }
 
-        if (type == TRANSACTION_UPDATE && oracleEnvironment->sortCols > 0) {
-            if (oracleEnvironment->sortCols >= 2) {
-                for (uint32_t i = 0; i < redoLogRecord1->object->totalCols; ++i) {
-                    if (redoLogRecord1->object->columns[i]->numPk == 0) {
-                        if (beforePos[i] > 0 && afterPos[i] > 0 && beforeLen[i] == afterLen[i]) {
-                            if (beforeLen[i] == 0 || memcmp(beforeRecord[i]->data + beforePos[i], afterRecord[i]->data + afterPos[i], beforeLen[i]) == 0) {
-                                beforePos[i] = 0;
-                                afterPos[i] = 0;
-                                beforeLen[i] = 0;
-                                afterLen[i] = 0;
-                            }
-                        }
-                    }
-                }
-            }
-
-            commandBuffer->append(", \"before\": {");
-            for (uint32_t i = 0; i < redoLogRecord1->object->totalCols; ++i) {
-                if (beforePos[i] > 0 || afterPos[i] > 0) {
-                    if (prevValue)
-                        commandBuffer->append(", ");
-                    else
-                        prevValue = true;
-
-                    commandBuffer
-                            ->append('"')
-                            ->append(redoLogRecord1->object->columns[i]->columnName)
-                            ->append("\": \"");
-
-                    if (beforePos[i] == 0 || beforeLen[i] == 0) {
-                        //nulls
-                    } else {
-                        appendValue(beforeRecord[i], redoLogRecord1->object->columns[i]->typeNo, beforePos[i], beforeLen[i]);
-                    }
+    //topic for table: <topic>.<owner>.<table>, handles are cached by every thread
+    Topic *KafkaWriter::getTopic(unordered_map<OracleObject*, Topic*> &topics, OracleObject *object) {
+        auto it = topics.find(object);
+        if (it != topics.end())
+            return it->second;
 
-                    commandBuffer->append('"');
-                }
-            }
-            commandBuffer->append("}");
-            prevValue = false;
-            commandBuffer->append(", \"after\": {");
-            for (uint32_t i = 0; i < redoLogRecord1->object->totalCols; ++i) {
-                if (afterPos[i] > 0 || redoLogRecord1->object->columns[i]->numPk > 0) {
-                    if (prevValue)
-                        commandBuffer->append(", ");
-                    else
-                        prevValue = true;
-
-                    commandBuffer
-                            ->append('"')
-                            ->append(redoLogRecord1->object->columns[i]->columnName)
-                            ->append("\": \"");
-
-                    //for PK value is only present before
-                    if (afterPos[i] == 0 && redoLogRecord1->object->columns[i]->numPk > 0) {
-                        if (beforeLen[i] == 0) {
-                            //nulls
-                        } else {
-                            appendValue(beforeRecord[i], redoLogRecord1->object->columns[i]->typeNo, beforePos[i], beforeLen[i]);
-                        }
-                    } else {
-                        if (afterLen[i] == 0) {
-                            //nulls
-                        } else {
-                            appendValue(afterRecord[i], redoLogRecord1->object->columns[i]->typeNo, afterPos[i], afterLen[i]);
-                        }
-                    }
+        string name = topic + "." + object->owner + "." + object->objectName;
+        for (uint32_t i = topic.length(); i < name.length(); ++i)
+            if (!isalnum(name[i]) && name[i] != '.' && name[i] != '_' && name[i] != '-')
+                name[i] = '_';
 
-                    commandBuffer->append('"');
-                }
-            }
-            commandBuffer->append("}");
-
-            delete afterRecord;
-            delete beforeRecord;
-            delete afterLen;
-            delete beforeLen;
-            delete afterPos;
-            delete beforePos;
+        string errstr;
+        Topic *tableTopic = Topic::create(producer, name, nullptr, errstr);
+        if (tableTopic == nullptr) {
+            cerr << "ERROR: Failed to create Kafka topic: " << name << ", " << errstr << endl;
+            tableTopic = ktopic;
         }
-
-        commandBuffer->append("}");
+        topics[object] = tableTopic;
+        return tableTopic;
     }
 
-    //0x18010000
-    void KafkaWriter::parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment) {
-        uint32_t fieldPos = redoLogRecord1->fieldPos;
-        uint16_t seq = 0, cnt = 0, type;
-
-        uint16_t fieldLength;
-        for (uint32_t i = 1; i <= redoLogRecord1->fieldCnt; ++i) {
-            fieldLength = oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + i * 2);
-            if (i == 1) {
-                type = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 12);
-                seq = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 18);
-                cnt = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 20);
-                if (oracleEnvironment->trace >= TRACE_DETAIL) {
-                    cerr << "SEQ: " << dec << seq << "/" << dec << cnt << endl;
-                }
-            } else if (i == 8) {
-                //DDL text
-                if (oracleEnvironment->trace >= TRACE_FULL) {
-                    cerr << "DDL[" << dec << fieldLength << "]: ";
-                    for (uint32_t j = 0; j < fieldLength; ++j) {
-                        cerr << *(redoLogRecord1->data + fieldPos + j);
-                    }
-                    cerr << endl;
-                }
-            } else if (i == 9) {
-                //owner
-                if (oracleEnvironment->trace >= TRACE_FULL) {
-                    cerr << "OWNER[" << dec << fieldLength << "]: ";
-                    for (uint32_t j = 0; j < fieldLength; ++j) {
-                        cerr << *(redoLogRecord1->data + fieldPos + j);
-                    }
-                    cerr << endl;
-                }
-            } else if (i == 10) {
-                //table
-                if (oracleEnvironment->trace >= TRACE_FULL) {
-                    cerr << "TABLE[" << fieldLength << "]: ";
-                    for (uint32_t j = 0; j < fieldLength; ++j) {
-                        cerr << *(redoLogRecord1->data + fieldPos + j);
-                    }
-                    cerr << endl;
-                }
-            } else if (i == 12) {
-                redoLogRecord1->objn = oracleEnvironment->read32(redoLogRecord1->data + fieldPos + 0);
-                if (oracleEnvironment->trace >= TRACE_FULL) {
-                    cerr << "OBJN: " << dec << redoLogRecord1->objn << endl;
-                }
+    int KafkaWriter::initialize() {
+        string errstr;
+        Conf *conf = Conf::create(Conf::CONF_GLOBAL);
+        Conf *tconf = Conf::create(Conf::CONF_TOPIC);
+        conf->set("metadata.broker.list", brokers, errstr);
+        conf->set("dr_cb", this, errstr);
+
+        if (trace <= 0) {
+            producer = Producer::create(conf, errstr);
+            if (producer == nullptr) {
+                std::cerr << "ERROR: creating Kafka producer: " << errstr << endl;
+                return 0;
             }
 
-            fieldPos += (fieldLength + 3) & 0xFFFC;
+            ktopic = Topic::create(producer, topic, tconf, errstr);
+            if (ktopic == nullptr) {
+                std::cerr << "ERROR: Failed to create Kafka topic: " << errstr << endl;
+                return 0;
+            }
         }
 
-        if (type == 85) {
-            commandBuffer
-                    ->append("{\"operation\": \"truncate\", \"table\": \"")
-                    ->append(redoLogRecord1->object->owner)
-                    ->append('.')
-                    ->append(redoLogRecord1->object->objectName)
-                    ->append("\"}");
-       }
+        return 1;
     }
 }
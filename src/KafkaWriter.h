@@ -19,15 +19,23 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 
 #include <set>
 #include <queue>
+#include <unordered_map>
+#include <chrono>
 #include <stdint.h>
 #include <occi.h>
 #include <librdkafka/rdkafkacpp.h>
 #include "types.h"
-#include "Writer.h"
+#include "SinkWriter.h"
+#include "Compressor.h"
 
 #ifndef KAFKAWRITER_H_
 #define KAFKAWRITER_H_
 
+#define KAFKA_WRITER_JOBS_MAX 16
+#define KAFKA_WRITER_JOBS_POLL_US 1000
+#define KAFKA_WRITER_REPORT_SEC 60
+#define KAFKA_WRITER_HEADER_COMPRESSION "compression"
+
 using namespace std;
 using namespace RdKafka;
 
@@ -35,8 +43,41 @@ namespace OpenLogReplicator {
 
     class RedoLogRecord;
     class CommandBuffer;
+    struct CommandBufferAck;
+    class OracleObject;
+    class KafkaWriter;
+
+    struct KafkaWriterThread {
+        KafkaWriter *kafkaWriter;
+        uint32_t shard;
+        pthread_t pthread;
+    };
+
+    //sealed message waiting for compression
+    struct KafkaWriterJob : public CompressorJob {
+        Topic *topic;
+        uint32_t key;
+        bool hasKey;
+        uint32_t messages;
+        bool ownsData;                              //false - data is in command buffer until ack
+        CommandBufferAck *ack;
+    };
 
-    class KafkaWriter : public Writer {
+    //transactions sent together in one Kafka message
+    struct KafkaWriterBatch {
+        uint8_t *data;
+        uint32_t length;
+        uint32_t messages;
+        Topic *topic;
+        uint32_t key;
+        bool hasKey;
+        CommandBufferAck *ack;                      //buffer space of batched messages, released by delivery report
+        chrono::steady_clock::time_point end;
+        deque<KafkaWriterJob*> jobs;                //sent in order when compressed
+    };
+
+    //messages formatted by formatter are sent to Kafka topic
+    class KafkaWriter : public SinkWriter, public DeliveryReportCb {
     protected:
         Conf *conf;
         Conf *tconf;
@@ -45,22 +86,35 @@ namespace OpenLogReplicator {
         Producer *producer;
         Topic *ktopic;
         uint32_t trace;
+        uint32_t threads;                           //producer threads, each reads own shard of messages
+        uint32_t route;
+        bool topicPerTable;
+        uint32_t batchCount;                        //transactions in one message, 1 - no batching
+        uint32_t batchBytes;
+        uint32_t batchLinger;                       //ms to wait for more transactions
+        bool batchLines;                            //batched transactions separated by new line
+
+        void runShard(uint32_t shard);
+        ErrorCode produce(Topic *messageTopic, int msgflags, uint8_t *data, uint32_t length, uint32_t *key, CommandBufferAck *ack,
+                const char *compression);
+        void sendBatch(KafkaWriterBatch &batch);
+        void compressMessage(KafkaWriterBatch &batch, Topic *messageTopic, uint8_t *data, uint32_t length, uint32_t key, bool hasKey,
+                uint32_t messages, bool ownsData, CommandBufferAck *ack);
+        void sendJobs(KafkaWriterBatch &batch, uint32_t keep);
+        void stopOnError(ErrorCode err, uint32_t messages);
+        Topic *getTopic(unordered_map<OracleObject*, Topic*> &topics, OracleObject *object);
 
     public:
         virtual void *run();
+        static void *runShardStatic(void *context);
+        virtual void dr_cb(Message &message);
 
         void addTable(string mask);
-        int initialize();
-
-        virtual void beginTran(typescn scn, typexid xid);
-        virtual void next();
-        virtual void commitTran();
-        virtual void parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment);
-        virtual void parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment);
-        virtual void parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment);
-        virtual void parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment);
+        virtual int initialize();
 
-        KafkaWriter(const string alias, const string brokers, const string topic, CommandBuffer *commandBuffer, uint32_t trace);
+        KafkaWriter(const string alias, const string brokers, const string topic, CommandBuffer *commandBuffer, Writer *formatter, uint32_t trace,
+                uint32_t threads, uint32_t route, bool topicPerTable, uint32_t batchCount, uint32_t batchBytes, uint32_t batchLinger,
+                bool batchLines);
         virtual ~KafkaWriter();
     };
 }
@@ -23,6 +23,8 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include <fstream>
 #include <streambuf>
 #include <list>
+#include <map>
+#include <set>
 #include <mutex>
 #include <signal.h>
 #include <unistd.h>
@@ -34,7 +36,12 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include "CommandBuffer.h"
 #include "OracleEnvironment.h"
 #include "OracleReader.h"
+#include "JsonWriter.h"
 #include "KafkaWriter.h"
+#include "AvroWriter.h"
+#include "Compressor.h"
+#include "FileWriter.h"
+#include "ShmWriter.h"
 
 using namespace std;
 using namespace rapidjson;
@@ -56,6 +63,135 @@ const Value& getJSONfield(const Document& document, const char* field) {
     return document[field];
 }
 
+//options common to all targets, transactions of a source are formatted once, by the formatter of its first target
+struct TargetOptions {
+    string alias;
+    CommandBuffer *commandBuffer;
+    uint32_t lagPolicy;
+    string spillDir;
+    set<string> tables;
+    uint32_t format;
+    bool markers;
+    bool avro;
+    string schemaDir;
+    uint32_t compression;
+    int compressionLevel;
+    uint32_t compressionThreads;
+};
+
+bool parseTargetOptions(const Value& target, list<Thread *> &readers, map<CommandBuffer*, TargetOptions> &targetOptions, TargetOptions &options) {
+    options.alias = getJSONfield(target, "alias").GetString();
+    const Value& source = getJSONfield(target, "source");
+    options.commandBuffer = nullptr;
+    for (auto reader : readers)
+        if (reader->alias.compare(source.GetString()) == 0)
+            options.commandBuffer = reader->commandBuffer;
+    if (options.commandBuffer == nullptr)
+        {cerr << "ERROR: Alias " << options.alias << " not found!" << endl; return false;}
+
+    //optional: what to do when target stops the source: block, spill, detach
+    options.lagPolicy = CONSUMER_LAG_BLOCK;
+    if (target.HasMember("lagpolicy")) {
+        const char *lagPolicy = target["lagpolicy"].GetString();
+        if (strcmp(lagPolicy, "spill") == 0)
+            options.lagPolicy = CONSUMER_LAG_SPILL;
+        else if (strcmp(lagPolicy, "detach") == 0)
+            options.lagPolicy = CONSUMER_LAG_DETACH;
+        else if (strcmp(lagPolicy, "block") != 0)
+            {cerr << "ERROR: bad JSON, lagpolicy should be block, spill or detach!" << endl; return false;}
+    }
+    options.spillDir = ".";
+    if (target.HasMember("spilldir"))
+        options.spillDir = target["spilldir"].GetString();
+
+    //optional: tables sent to this target, default - all tables of the source
+    if (target.HasMember("tables")) {
+        const Value& tables = target["tables"];
+        if (!tables.IsArray())
+            {cerr << "ERROR: bad JSON, objects should be array!" << endl; return false;}
+        for (SizeType j = 0; j < tables.Size(); ++j) {
+            const Value& table = getJSONfield(tables[j], "table");
+            options.tables.insert(table.GetString());
+        }
+    }
+
+    //optional: message for every transaction or for every row
+    options.format = MESSAGE_FORMAT_TRANSACTION;
+    if (target.HasMember("format")) {
+        const char *format = target["format"].GetString();
+        if (strcmp(format, "row") == 0)
+            options.format = MESSAGE_FORMAT_ROW;
+        else if (strcmp(format, "transaction") != 0)
+            {cerr << "ERROR: bad JSON, format should be transaction or row!" << endl; return false;}
+    }
+
+    //optional: begin and commit messages around rows of transaction
+    options.markers = false;
+    if (target.HasMember("markers") && strcmp(target["markers"].GetString(), "1") == 0)
+        options.markers = true;
+
+    //optional: binary Avro messages, schemas written to schemadir
+    options.avro = false;
+    if (target.HasMember("encoding")) {
+        const char *encoding = target["encoding"].GetString();
+        if (strcmp(encoding, "avro") == 0)
+            options.avro = true;
+        else if (strcmp(encoding, "json") != 0)
+            {cerr << "ERROR: bad JSON, encoding should be json or avro!" << endl; return false;}
+    }
+    options.schemaDir = "";
+    if (target.HasMember("schemadir"))
+        options.schemaDir = target["schemadir"].GetString();
+
+    //optional: messages compressed by worker threads before sending
+    options.compression = COMPRESSION_NONE;
+    options.compressionLevel = 0;
+    options.compressionThreads = 2;
+    if (target.HasMember("compression")) {
+        const char *compression = target["compression"].GetString();
+        if (strcmp(compression, "zstd") == 0) {
+            options.compression = COMPRESSION_ZSTD;
+            options.compressionLevel = 3;
+        } else if (strcmp(compression, "lz4") == 0)
+            options.compression = COMPRESSION_LZ4;
+        else if (strcmp(compression, "none") != 0)
+            {cerr << "ERROR: bad JSON, compression should be none, zstd or lz4!" << endl; return false;}
+    }
+    if (target.HasMember("compressionlevel"))
+        options.compressionLevel = atoi(target["compressionlevel"].GetString());
+    if (target.HasMember("compressionthreads"))
+        options.compressionThreads = atoi(target["compressionthreads"].GetString());
+
+    auto it = targetOptions.find(options.commandBuffer);
+    if (it == targetOptions.end()) {
+        targetOptions[options.commandBuffer] = options;
+        return true;
+    }
+
+    if (it->second.avro != options.avro || it->second.format != options.format || it->second.markers != options.markers ||
+            (options.avro && it->second.schemaDir.compare(options.schemaDir) != 0)) {
+        cerr << "ERROR: bad JSON, target " << options.alias << " should have the same encoding, format, markers and schemadir as target " <<
+                it->second.alias << " of the same source!" << endl;
+        return false;
+    }
+    return true;
+}
+
+Writer *createFormatter(const TargetOptions &options) {
+    if (options.avro)
+        return new AvroWriter(options.alias, options.commandBuffer, options.format, options.markers, options.schemaDir);
+    return new JsonWriter(options.alias, options.commandBuffer, options.format, options.markers);
+}
+
+//compression is per target, the same messages can be sent compressed and plain to different targets
+Compressor *createCompressor(const TargetOptions &options) {
+    if (options.compression == COMPRESSION_NONE)
+        return nullptr;
+    Compressor *compressor = new Compressor(options.compression, options.compressionLevel, options.compressionThreads);
+    compressor->initialize();
+    return compressor;
+}
+
 mutex mainMtx;
 condition_variable mainThread;
 void signalHandler(int s) {
@@ -83,6 +219,7 @@ int main() {
     Document document;
     list<Thread *> readers, writers;
     list<CommandBuffer *> buffers;
+    map<CommandBuffer*, TargetOptions> targetOptions;
 
     if (configJSON.length() == 0 || document.Parse(configJSON.c_str()).HasParseError())
         {cerr << "ERROR: parsing OpenLogReplicator.json" << endl; return 1;}
@@ -113,6 +250,10 @@ int main() {
     uint32_t sortColsInt = 0;
     sortColsInt = atoi(sortCols.GetString());
 
+    //optional: memory (MB) for transactions of all sources, 0 - unlimited
+    if (document.HasMember("globalmemorymax"))
+        TransactionBuffer::globalMemoryMax = (uint64_t)atoi(document["globalmemorymax"].GetString()) * 1024 * 1024;
+
     //iterate through sources
     const Value& sources = getJSONfield(document, "sources");
     if (!sources.IsArray())
@@ -132,12 +273,37 @@ int main() {
             if (!tables.IsArray())
                 {cerr << "ERROR: bad JSON, objects should be array!" << endl; return 1;}
 
+            //optional: memory (MB) for transactions of this source, 0 - default
+            uint32_t maxMemoryInt = 0;
+            if (source.HasMember("memorymax"))
+                maxMemoryInt = atoi(source["memorymax"].GetString());
+
+            //optional: memory (MB) used by transactions before spilling to disk, 0 - default
+            uint32_t spillMemoryInt = 0;
+            if (source.HasMember("spillmemory"))
+                spillMemoryInt = atoi(source["spillmemory"].GetString());
+            string spillDirStr = ".";
+            if (source.HasMember("spilldir"))
+                spillDirStr = source["spilldir"].GetString();
+
+            //optional: threads formatting committed transactions, 0 - reader thread
+            uint32_t serializerThreadsInt = 0;
+            if (source.HasMember("serializerthreads"))
+                serializerThreadsInt = atoi(source["serializerthreads"].GetString());
+
+            //optional: size (MB) of open transaction sent before commit as provisional, 0 - disabled
+            uint32_t streamMemoryInt = 0;
+            if (source.HasMember("streammemory"))
+                streamMemoryInt = atoi(source["streammemory"].GetString());
+
             cout << "Adding source: " << name.GetString() << endl;
             CommandBuffer *commandBuffer = new CommandBuffer();
 
             buffers.push_back(commandBuffer);
             OracleReader *oracleReader = new OracleReader(commandBuffer, alias.GetString(), name.GetString(), user.GetString(),
-                    password.GetString(), server.GetString(), traceInt, dumpLogFileInt, dumpDataBool, directReadBool, sortColsInt);
+                    password.GetString(), server.GetString(), traceInt, dumpLogFileInt, dumpDataBool, directReadBool, sortColsInt,
+                    maxMemoryInt, spillMemoryInt, spillDirStr, serializerThreadsInt,
+                    streamMemoryInt);
             readers.push_back(oracleReader);
 
             //initialize
@@ -152,9 +318,6 @@ int main() {
                 const Value& table = getJSONfield(tables[j], "table");
                 oracleReader->addTable(table.GetString(), 0);
             }
-
-            //run
-            pthread_create(&oracleReader->pthread, nullptr, &OracleReader::runStatic, (void*)oracleReader);
         }
     }
 
@@ -170,22 +333,71 @@ int main() {
             const Value& alias = getJSONfield(target, "alias");
             const Value& brokers = getJSONfield(target, "brokers");
             const Value& topic = getJSONfield(target, "topic");
-            const Value& source = getJSONfield(target, "source");
             const Value& traceKafka = getJSONfield(target, "trace");
-            CommandBuffer *commandBuffer = nullptr;
-
-            for (auto reader : readers)
-                if (reader->alias.compare(source.GetString()) == 0)
-                    commandBuffer = reader->commandBuffer;
-            if (commandBuffer == nullptr)
-                {cerr << "ERROR: Alias " << alias.GetString() << " not found!" << endl; return 1;}
+            TargetOptions options;
+            if (!parseTargetOptions(target, readers, targetOptions, options))
+                return 1;
+            CommandBuffer *commandBuffer = options.commandBuffer;
 
             int traceKafkaInt = 0;
             traceKafkaInt = atoi(traceKafka.GetString());
 
+            //optional: producer threads, messages are divided between them by routing
+            uint32_t threadsInt = 1;
+            if (target.HasMember("threads"))
+                threadsInt = atoi(target["threads"].GetString());
+            if (threadsInt == 0)
+                threadsInt = 1;
+
+            //optional: partitioning of messages: none, table, key - primary key or rowid
+            uint32_t routingInt = MESSAGE_ROUTE_NONE;
+            if (target.HasMember("routing")) {
+                const char *routing = target["routing"].GetString();
+                if (strcmp(routing, "table") == 0)
+                    routingInt = MESSAGE_ROUTE_TABLE;
+                else if (strcmp(routing, "key") == 0)
+                    routingInt = MESSAGE_ROUTE_KEY;
+                else if (strcmp(routing, "none") != 0)
+                    {cerr << "ERROR: bad JSON, routing should be none, table or key!" << endl; return 1;}
+            }
+
+            //optional: topic <topic>.<owner>.<table> for every table
+            bool topicPerTableBool = false;
+            if (target.HasMember("topicpertable") && strcmp(target["topicpertable"].GetString(), "1") == 0) {
+                topicPerTableBool = true;
+                if (routingInt == MESSAGE_ROUTE_NONE)
+                    routingInt = MESSAGE_ROUTE_TABLE;
+            }
+
+            //optional: consecutive small transactions sent in one message, one per line
+            uint32_t batchCountInt = 1, batchBytesInt = 1048576, batchLingerInt = 0;
+            if (target.HasMember("batchcount"))
+                batchCountInt = atoi(target["batchcount"].GetString());
+            if (batchCountInt == 0)
+                batchCountInt = 1;
+            if (target.HasMember("batchbytes"))
+                batchBytesInt = atoi(target["batchbytes"].GetString());
+            if (target.HasMember("batchlinger"))
+                batchLingerInt = atoi(target["batchlinger"].GetString());
+
             cout << "Adding target: " << alias.GetString() << endl;
-            KafkaWriter *kafkaWriter = new KafkaWriter(alias.GetString(), brokers.GetString(), topic.GetString(), commandBuffer, traceKafkaInt);
-            commandBuffer->writer = kafkaWriter;
+            //Avro single object encoding is self-delimiting, batched json messages are separated by new line
+            Writer *formatter = createFormatter(options);
+            KafkaWriter *kafkaWriter = new KafkaWriter(alias.GetString(), brokers.GetString(), topic.GetString(), commandBuffer, formatter,
+                    traceKafkaInt, threadsInt, routingInt, topicPerTableBool, batchCountInt, batchBytesInt, batchLingerInt, !options.avro);
+            kafkaWriter->compressor = createCompressor(options);
+            for (uint32_t j = 0; j < threadsInt; ++j) {
+                uint32_t consumer = commandBuffer->addConsumer(options.lagPolicy, options.tables, options.spillDir, routingInt, j, threadsInt);
+                if (consumer >= COMMAND_BUFFER_CONSUMERS_MAX) {
+                    delete kafkaWriter;
+                    return 1;
+                }
+                if (j == 0)
+                    kafkaWriter->consumer = consumer;
+            }
+            //transactions are formatted once by the first target of the source, others have the same format
+            if (commandBuffer->writer == nullptr)
+                commandBuffer->writer = formatter;
             writers.push_back(kafkaWriter);
 
             //initialize
@@ -198,9 +410,82 @@ int main() {
 
             //run
             pthread_create(&kafkaWriter->pthread, nullptr, &KafkaWriter::runStatic, (void*)kafkaWriter);
+
+        } else if (strcmp("FILE", type.GetString()) == 0 || strcmp("SHM", type.GetString()) == 0) {
+            bool fileBool = (strcmp("FILE", type.GetString()) == 0);
+            const Value& alias = getJSONfield(target, "alias");
+            TargetOptions options;
+            if (!parseTargetOptions(target, readers, targetOptions, options))
+                return 1;
+            CommandBuffer *commandBuffer = options.commandBuffer;
+
+            string dirStr = "";
+            if (fileBool)
+                dirStr = getJSONfield(target, "dir").GetString();
+
+            //optional: file name <name>.<segment>.log or shared memory /dev/shm/<name>, default - alias
+            string nameStr = alias.GetString();
+            if (target.HasMember("name"))
+                nameStr = target["name"].GetString();
+
+            //optional: segment rotation by size in MB and time in seconds, fsync interval in ms
+            uint64_t segmentBytesInt = 1024;
+            uint32_t segmentSecondsInt = 3600, fsyncMsInt = 100;
+            if (target.HasMember("segmentsize"))
+                segmentBytesInt = atoi(target["segmentsize"].GetString());
+            if (segmentBytesInt == 0)
+                segmentBytesInt = 1;
+            segmentBytesInt *= 1024 * 1024;
+            if (target.HasMember("segmenttime"))
+                segmentSecondsInt = atoi(target["segmenttime"].GetString());
+            if (target.HasMember("fsync"))
+                fsyncMsInt = atoi(target["fsync"].GetString());
+
+            //optional: size of shared memory ring in MB
+            uint64_t sizeInt = 64;
+            if (target.HasMember("size"))
+                sizeInt = atoi(target["size"].GetString());
+            if (sizeInt == 0)
+                sizeInt = 1;
+            sizeInt *= 1024 * 1024;
+
+            cout << "Adding target: " << alias.GetString() << endl;
+            //json messages one per line, Avro messages prefixed with length
+            Writer *formatter = createFormatter(options);
+            SinkWriter *sinkWriter;
+            if (fileBool)
+                sinkWriter = new FileWriter(alias.GetString(), commandBuffer, formatter, dirStr, nameStr,
+                        segmentBytesInt, segmentSecondsInt, fsyncMsInt, options.avro);
+            else
+                sinkWriter = new ShmWriter(alias.GetString(), commandBuffer, formatter, nameStr, sizeInt);
+            sinkWriter->compressor = createCompressor(options);
+            sinkWriter->consumer = commandBuffer->addConsumer(options.lagPolicy, options.tables, options.spillDir, MESSAGE_ROUTE_NONE, 0, 1);
+            if (sinkWriter->consumer >= COMMAND_BUFFER_CONSUMERS_MAX) {
+                delete sinkWriter;
+                return 1;
+            }
+            //transactions are formatted once by the first target of the source, others have the same format
+            if (commandBuffer->writer == nullptr)
+                commandBuffer->writer = formatter;
+            writers.push_back(sinkWriter);
+
+            //initialize
+            if (!sinkWriter->initialize()) {
+                delete sinkWriter;
+                sinkWriter = nullptr;
+                cerr << "ERROR: starting writer " << alias.GetString() << endl;
+                return -1;
+            }
+
+            //run
+            pthread_create(&sinkWriter->pthread, nullptr, &SinkWriter::runStatic, (void*)sinkWriter);
         }
     }
 
+    //readers start when all targets are connected
+    for (auto reader : readers)
+        pthread_create(&reader->pthread, nullptr, &OracleReader::runStatic, (void*)reader);
+
     //sleep until killed
     {
         unique_lock<mutex> lck(mainMtx);
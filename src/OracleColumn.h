@@ -35,6 +35,7 @@ namespace OpenLogReplicator {
         uint32_t typeNo;
         uint32_t length;
         uint32_t numPk;
+        string jsonName;                            //prebuilt JSON key: , "<columnName>": "
 
         OracleColumn(uint32_t colNo, uint32_t segSolNo, string columnName, uint32_t typeNo, uint32_t length, uint32_t numPk);
         virtual ~OracleColumn();
@@ -18,17 +18,29 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
 #include <iostream>
+#include <iomanip>
+#include <pthread.h>
 #include <sys/stat.h>
 #include "OracleEnvironment.h"
 #include "OracleObject.h"
 #include "Transaction.h"
+#include "TransactionSerializer.h"
 
 using namespace std;
 
 namespace OpenLogReplicator {
 
-    OracleEnvironment::OracleEnvironment(CommandBuffer *commandBuffer, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols) :
+    OracleEnvironment::OracleEnvironment(CommandBuffer *commandBuffer, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols,
+            uint32_t maxMemory, uint32_t spillMemory, const string &spillDir, uint32_t serializerThreads,
+            uint32_t streamMemory) :
         DatabaseEnvironment(),
+        transactionBuffer(maxMemory, spillMemory, spillDir, trace),
+        serializerThreads(serializerThreads),
+        streamSize((uint64_t)streamMemory * 1024 * 1024),
+        checkpointScn(0),
+        serializeTicket(0),
+        serializeInFlight(0),
+        publishTicket(0),
         redoBuffer(new uint8_t[REDO_LOG_BUFFER_SIZE * 2]),
         headerBuffer(new uint8_t[REDO_PAGE_SIZE_MAX * 2]),
         recordBuffer(new uint8_t[REDO_RECORD_MAX_SIZE]),
@@ -39,10 +51,10 @@ namespace OpenLogReplicator {
         trace(trace),
         version(0),
         sortCols(sortCols) {
-        transactionHeap.initialize(MAX_CONCURRENT_TRANSACTIONS);
     }
 
     OracleEnvironment::~OracleEnvironment() {
+        stopSerializers();
 
         for (auto it : objectMap) {
             OracleObject *object = it.second;
@@ -83,6 +95,119 @@ namespace OpenLogReplicator {
         }
     }
 
+    void OracleEnvironment::spillTransactions() {
+        //move chunks of largest open transactions to disk until enough memory is free
+        while (!transactionBuffer.spillDone()) {
+            Transaction *largest = nullptr;
+            uint64_t largestSize = 0;
+
+            for (uint32_t i = 0; i < transactionTracker.size(); ++i) {
+                Transaction *transaction = transactionTracker.at(i);
+                uint64_t size = transaction->memorySize();
+                if (size > largestSize) {
+                    largest = transaction;
+                    largestSize = size;
+                }
+            }
+
+            if (largest == nullptr) {
+                if (trace >= TRACE_WARN)
+                    cerr << "WARNING: no transaction to spill, used memory: " << dec << transactionBuffer.getUsedMemory() << endl;
+                return;
+            }
+
+            if (trace >= TRACE_INFO)
+                cerr << "INFO: spilling transaction xid: " << PRINTXID(largest->xid) << ", size: " << dec << largestSize << endl;
+            largest->spill(&transactionBuffer);
+        }
+    }
+
+    //hand over committed transaction to serializer threads, output is published in order of tickets
+    void OracleEnvironment::serializeTransaction(Transaction *transaction) {
+        if (serializers.empty()) {
+            for (uint32_t i = 0; i < serializerThreads; ++i) {
+                TransactionSerializer *serializer = new TransactionSerializer("serializer", commandBuffer, this);
+                serializers.push_back(serializer);
+                pthread_create(&serializer->pthread, nullptr, &TransactionSerializer::runStatic, (void*)serializer);
+            }
+        }
+
+        //limit memory of transactions waiting for publication
+        while (serializeInFlight >= serializerThreads * 2)
+            releaseTransactions(true);
+
+        unique_lock<mutex> lck(serializeMtx);
+        transaction->ticket = serializeTicket++;
+        ++serializeInFlight;
+        serializeQueue.push(transaction);
+        serializeCond.notify_one();
+    }
+
+    //provisional output is written by reader thread, after all transactions committed earlier
+    void OracleEnvironment::streamTransaction(Transaction *transaction) {
+        while (serializeInFlight > 0)
+            releaseTransactions(true);
+
+        transaction->stream(this, &transactionBuffer);
+    }
+
+    //rollback to savepoint of operation already streamed, event is ordered the same way as provisional output
+    bool OracleEnvironment::rollbackStreamed(Transaction *transaction, typescn scn, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci) {
+        while (serializeInFlight > 0)
+            releaseTransactions(true);
+
+        return transaction->rollbackSentOp(this, scn, uba, dba, slt, rci);
+    }
+
+    void OracleEnvironment::releaseTransactions(bool wait) {
+        while (true) {
+            Transaction *transaction;
+            {
+                unique_lock<mutex> lck(serializeMtx);
+                if (serializedQueue.empty()) {
+                    if (!wait)
+                        return;
+                    publishCond.wait(lck);
+                    continue;
+                }
+                transaction = serializedQueue.front();
+                serializedQueue.pop();
+            }
+
+            transaction->free(&transactionBuffer);
+            delete transaction;
+            --serializeInFlight;
+            wait = false;
+        }
+    }
+
+    void OracleEnvironment::stopSerializers() {
+        if (serializers.empty())
+            return;
+
+        for (TransactionSerializer *serializer : serializers)
+            serializer->terminate();
+        {
+            unique_lock<mutex> lck(serializeMtx);
+            serializeCond.notify_all();
+            publishCond.notify_all();
+        }
+        for (TransactionSerializer *serializer : serializers) {
+            pthread_join(serializer->pthread, nullptr);
+            delete serializer;
+        }
+        serializers.clear();
+
+        releaseTransactions(false);
+        while (!serializeQueue.empty()) {
+            Transaction *transaction = serializeQueue.front();
+            serializeQueue.pop();
+            transaction->free(&transactionBuffer);
+            delete transaction;
+            --serializeInFlight;
+        }
+    }
+
     uint32_t OracleEnvironment::getBase() {
         if (version >= 12000)
             return 0x00800000;
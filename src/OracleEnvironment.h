@@ -18,6 +18,9 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
 #include <unordered_map>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -26,7 +29,7 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include "types.h"
 #include "DatabaseEnvironment.h"
 #include "TransactionMap.h"
-#include "TransactionHeap.h"
+#include "TransactionTracker.h"
 #include "TransactionBuffer.h"
 
 #ifndef ORACLEENVIRONMENT_H_
@@ -44,14 +47,29 @@ namespace OpenLogReplicator {
 
     class OracleObject;
     class Transaction;
+    class TransactionSerializer;
 
     class OracleEnvironment : public DatabaseEnvironment {
     public:
         unordered_map<uint32_t, OracleObject*> objectMap;
         unordered_map<typexid, Transaction*> xidTransactionMap;
+        unordered_map<uint32_t, Transaction*> slotTransactionMap;     //open transactions by undo segment & slot
         TransactionMap lastOpTransactionMap;
-        TransactionHeap transactionHeap;
+        TransactionTracker transactionTracker;
+        priority_queue<Transaction*, vector<Transaction*>, TransactionCommitCompare> commitQueue;
         TransactionBuffer transactionBuffer;
+        vector<TransactionSerializer*> serializers;
+        uint32_t serializerThreads;                                     //0 - transactions formatted by reader thread
+        uint64_t streamSize;                                            //0 - transactions are sent after commit
+        typescn checkpointScn;                                          //restart has to read redo from here, 0 - unknown
+        uint64_t serializeTicket;
+        uint64_t serializeInFlight;
+        queue<Transaction*> serializeQueue;                             //committed, waiting for serializer thread
+        queue<Transaction*> serializedQueue;                            //published, chunks to be returned to the pool
+        mutex serializeMtx;
+        condition_variable serializeCond;
+        volatile uint64_t publishTicket;
+        condition_variable publishCond;
         uint8_t *redoBuffer;
         uint8_t *headerBuffer;
         uint8_t *recordBuffer;
@@ -68,9 +86,17 @@ namespace OpenLogReplicator {
         void addToDict(OracleObject *object);
         void transactionNew(typexid xid);
         void transactionAppend(typexid xid);
+        void spillTransactions();
+        void serializeTransaction(Transaction *transaction);
+        void streamTransaction(Transaction *transaction);
+        bool rollbackStreamed(Transaction *transaction, typescn scn, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci);
+        void releaseTransactions(bool wait);
+        void stopSerializers();
         uint32_t getBase();
 
-        OracleEnvironment(CommandBuffer *commandBuffer, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols);
+        OracleEnvironment(CommandBuffer *commandBuffer, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols,
+                uint32_t maxMemory, uint32_t spillMemory, const string &spillDir, uint32_t serializerThreads,
+                uint32_t streamMemory);
         virtual ~OracleEnvironment();
     };
 }
@@ -0,0 +1,199 @@
+/* Decoding of Oracle NUMBER values
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string.h>
+#include "types.h"
+#include "OracleNumber.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    const char OracleNumber::digitPairs[201] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+    //length of decimal text, depends only on exponent, number of digits and first and last digit; 0 - malformed value
+    uint32_t OracleNumber::length(const uint8_t *data, uint32_t length) {
+        if (length == 0)
+            return 0;
+        if (data[0] == 0x80)
+            return 1;
+
+        bool negative = (data[0] < 0x80);
+        int32_t exponent, digits = length - 1;
+        uint32_t first, last, textLength = 0;
+        if (negative) {
+            exponent = 0x3E - data[0];
+            if (digits >= 1 && data[digits] == 0x66)
+                --digits;
+            if (digits == 0)
+                return 0;
+            first = 101 - data[1];
+            last = 101 - data[digits];
+            textLength = 1;
+        } else {
+            exponent = data[0] - 0xC1;
+            if (digits == 0)
+                return 0;
+            first = data[1] - 1;
+            last = data[digits] - 1;
+        }
+        if (first > 99 || last > 99)
+            return 0;
+
+        //part of the total, digits above the last one are zeros
+        if (exponent < 0)
+            textLength += 1;
+        else
+            textLength += 2 * (exponent + 1) - (first < 10 ? 1 : 0);
+
+        //fraction part, omitting 0 at the end
+        if (digits > exponent + 1)
+            textLength += 1 + 2 * (digits - exponent - 1) - ((last % 10) == 0 ? 1 : 0);
+        return textLength;
+    }
+
+    //writes exactly length() bytes, returns 0 for malformed value
+    uint32_t OracleNumber::format(const uint8_t *data, uint32_t length, uint8_t *out) {
+        if (length == 0)
+            return 0;
+        if (data[0] == 0x80) {
+            out[0] = '0';
+            return 1;
+        }
+
+        bool negative = (data[0] < 0x80);
+        int32_t exponent, digits = length - 1;
+        uint32_t pos = 0, invalid = 0;
+        //digit of positive number is stored +1, of negative 101 - digit; other values wrap above 99
+        uint32_t base = 0xFFFFFFFF, sign = 1;
+        if (negative) {
+            exponent = 0x3E - data[0];
+            if (digits >= 1 && data[digits] == 0x66)
+                --digits;
+            base = 101;
+            sign = 0xFFFFFFFF;
+            out[pos++] = '-';
+        } else
+            exponent = data[0] - 0xC1;
+        if (digits == 0)
+            return 0;
+
+        //part of the total
+        int32_t k = 0;
+        if (exponent < 0)
+            out[pos++] = '0';
+        else {
+            uint32_t digit = base + sign * data[1];
+            invalid |= (digit > 99);
+            if (digit < 10)
+                out[pos++] = '0' + digit;
+            else {
+                memcpy(out + pos, digitPairs + (digit > 99 ? 0 : digit * 2), 2);
+                pos += 2;
+            }
+
+            int32_t kMax = (exponent < digits - 1) ? exponent : digits - 1;
+            for (k = 1; k <= kMax; ++k) {
+                digit = base + sign * data[k + 1];
+                invalid |= (digit > 99);
+                memcpy(out + pos, digitPairs + (digit > 99 ? 0 : digit * 2), 2);
+                pos += 2;
+            }
+            for (; k <= exponent; ++k) {
+                memcpy(out + pos, "00", 2);
+                pos += 2;
+            }
+        }
+
+        //fraction part, leading zeros for small numbers, omitting 0 at the end
+        if (digits > exponent + 1) {
+            out[pos++] = '.';
+            for (k = exponent + 1; k < 0; ++k) {
+                memcpy(out + pos, "00", 2);
+                pos += 2;
+            }
+            for (; k < digits; ++k) {
+                uint32_t digit = base + sign * data[k + 1];
+                invalid |= (digit > 99);
+                memcpy(out + pos, digitPairs + (digit > 99 ? 0 : digit * 2), 2);
+                pos += 2;
+            }
+            if (out[pos - 1] == '0')
+                --pos;
+        }
+
+        if (invalid)
+            return 0;
+        return pos;
+    }
+
+    //integer which fits in 64 bits, for binary formats
+    bool OracleNumber::decode(const uint8_t *data, uint32_t length, int64_t &val) {
+        if (length == 0)
+            return false;
+        if (data[0] == 0x80) {
+            val = 0;
+            return true;
+        }
+
+        bool negative = (data[0] < 0x80);
+        int32_t exponent, digits = length - 1;
+        if (negative) {
+            exponent = 0x3E - data[0];
+            if (digits >= 1 && data[digits] == 0x66)
+                --digits;
+        } else
+            exponent = data[0] - 0xC1;
+
+        //fraction or more than 20 decimal digits
+        if (digits == 0 || exponent < 0 || exponent > 9 || digits > exponent + 1)
+            return false;
+
+        uint64_t abs = 0;
+        for (int32_t k = 0; k <= exponent; ++k) {
+            uint32_t digit = 0;
+            if (k < digits)
+                digit = negative ? 101 - data[k + 1] : data[k + 1] - 1;
+            if (digit > 99 || abs > (0xFFFFFFFFFFFFFFFF - 99) / 100)
+                return false;
+            abs = abs * 100 + digit;
+        }
+
+        if (negative) {
+            if (abs > 0x8000000000000000)
+                return false;
+            val = (int64_t)(0 - abs);
+        } else {
+            if (abs > 0x7FFFFFFFFFFFFFFF)
+                return false;
+            val = (int64_t)abs;
+        }
+        return true;
+    }
+}
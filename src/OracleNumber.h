@@ -0,0 +1,41 @@
+/* Header for OracleNumber class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdint.h>
+#include "types.h"
+
+#ifndef ORACLENUMBER_H_
+#define ORACLENUMBER_H_
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //decoding of NUMBER: exponent byte and base 100 digits, negative numbers have digits inverted and 0x66 at the end
+    class OracleNumber {
+    public:
+        static const char digitPairs[201];          //"00" to "99"
+
+        static uint32_t length(const uint8_t *data, uint32_t length);
+        static uint32_t format(const uint8_t *data, uint32_t length, uint8_t *out);
+        static bool decode(const uint8_t *data, uint32_t length, int64_t &val);
+    };
+}
+
+#endif
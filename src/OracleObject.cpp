@@ -20,6 +20,7 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include <string>
 #include <iostream>
 #include "types.h"
+#include "JsonString.h"
 #include "OracleColumn.h"
 #include "OracleObject.h"
 
@@ -35,7 +36,13 @@ namespace OpenLogReplicator {
         totalPk(0),
         options(options),
         owner(owner),
-        objectName(objectName) {
+        objectName(objectName),
+        fullName(owner + "." + objectName) {
+        string table = jsonEscape(fullName);
+        jsonInsert = "{\"operation\": \"insert\", \"table\": \"" + table + "\", \"rowid\": \"";
+        jsonDelete = "{\"operation\": \"delete\", \"table\": \"" + table + "\", \"rowid\": \"";
+        jsonUpdate = "{\"operation\": \"update\", \"table\": \"" + table + "\", \"rowid\": \"";
+        jsonTruncate = "{\"operation\": \"truncate\", \"table\": \"" + table + "\"}";
     }
 
     OracleObject::~OracleObject() {
@@ -45,7 +52,17 @@ namespace OpenLogReplicator {
         columns.clear();
     }
 
+    //names are escaped once here instead of for every row
+    string OracleObject::jsonEscape(const string &str) {
+        uint8_t *buffer = new uint8_t[str.length() * JSON_STRING_ESCAPE_MAX + 1];
+        uint32_t length = JsonString::escape((const uint8_t*)str.c_str(), str.length(), buffer);
+        string escaped((const char*)buffer, length);
+        delete[] buffer;
+        return escaped;
+    }
+
     void OracleObject::addColumn(OracleColumn *column) {
+        column->jsonName = ", \"" + jsonEscape(column->columnName) + "\": \"";
         columns.push_back(column);
     }
 
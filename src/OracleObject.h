@@ -40,8 +40,14 @@ namespace OpenLogReplicator {
         uint32_t totalCols;
         string owner;
         string objectName;
+        string fullName;                            //<owner>.<objectName>
+        string jsonInsert;                          //prebuilt JSON row prefixes, up to the rowid value
+        string jsonDelete;
+        string jsonUpdate;
+        string jsonTruncate;
         vector<OracleColumn*> columns;
 
+        static string jsonEscape(const string &str);
         void addColumn(OracleColumn *column);
 
         OracleObject(uint32_t objn, uint32_t objd, uint32_t cluCols, uint32_t options, string owner, string objectName);
@@ -42,7 +42,9 @@ using namespace oracle::occi;
 namespace OpenLogReplicator {
 
     OracleReader::OracleReader(CommandBuffer *commandBuffer, const string alias, const string database, const string user, const string passwd,
-            const string connectString, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols) :
+            const string connectString, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols,
+            uint32_t maxMemory, uint32_t spillMemory, const string spillDir, uint32_t serializerThreads,
+            uint32_t streamMemory) :
         Thread(alias, commandBuffer),
         currentRedo(nullptr),
         database(database.c_str()),
@@ -55,7 +57,8 @@ namespace OpenLogReplicator {
         passwd(passwd),
         connectString(connectString) {
 
-        oracleEnvironment = new OracleEnvironment(commandBuffer, trace, dumpLogFile, dumpData, directRead, sortCols);
+        oracleEnvironment = new OracleEnvironment(commandBuffer, trace, dumpLogFile, dumpData, directRead, sortCols, maxMemory, spillMemory, spillDir,
+                serializerThreads, streamMemory);
         readCheckpoint();
         env = Environment::createEnvironment (Environment::DEFAULT);
     }
@@ -180,6 +183,7 @@ namespace OpenLogReplicator {
                         if (redo == nullptr && !isHigher) {
                             if (oracleEnvironment->trace >= TRACE_INFO)
                                 cerr << "INFO: Sleeping while waiting for new redo log sequence " << databaseSequence << endl;
+                            oracleEnvironment->transactionBuffer.shrink();
                             usleep(REDO_SLEEP_RETRY);
                         } else
                             break;
@@ -459,6 +463,8 @@ namespace OpenLogReplicator {
     void OracleReader::writeCheckpoint() {
         if (oracleEnvironment->trace >= TRACE_INFO)
             cerr << "Writing checkpoint information" << endl;
+        if (oracleEnvironment->checkpointScn != 0)
+            databaseScn = oracleEnvironment->checkpointScn;
         FILE *fp = fopen((database + ".cfg").c_str(), "wb");
         if (fp == nullptr) {
             cerr << "ERROR: Error writing checkpoint data for " << database << endl;
@@ -76,7 +76,9 @@ namespace OpenLogReplicator {
         int initialize();
 
         OracleReader(CommandBuffer *commandBuffer, const string alias, const string database, const string user, const string passwd,
-                const string connectString, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols);
+                const string connectString, uint32_t trace, uint32_t dumpLogFile, bool dumpData, bool directRead, uint32_t sortCols,
+                uint32_t maxMemory, uint32_t spillMemory, const string spillDir, uint32_t serializerThreads,
+                uint32_t streamMemory);
         virtual ~OracleReader();
     };
 }
@@ -64,7 +64,7 @@ namespace OpenLogReplicator {
                 typescn nextScn, typeseq sequence, const char* path) :
             oracleEnvironment(oracleEnvironment),
             group(group),
-            lastCheckpointScn(0),
+            watermarkScn(0),
             curScn(ZERO_SCN),
             firstScn(firstScn),
             nextScn(nextScn),
@@ -85,7 +85,6 @@ namespace OpenLogReplicator {
             headerBufferFileEnd(0),
             lastReadSuccessfull(false),
             redoOverwritten(false),
-            lastCheckpointInfo(false),
             fileDes(-1),
             path(path),
             sequence(sequence) {
@@ -752,7 +751,12 @@ namespace OpenLogReplicator {
             }
         }
 
-        flushTransactions(checkpoint);
+        if (oracleEnvironment->transactionBuffer.spillNeeded())
+            oracleEnvironment->spillTransactions();
+
+        //all records of previous LWN are already read
+        if (checkpoint)
+            flushTransactions(curScn);
     }
 
     void OracleReaderRedo::appendToTransaction(RedoLogRecord *redoLogRecord) {
@@ -788,14 +792,16 @@ namespace OpenLogReplicator {
                 transaction->add(oracleEnvironment, redoLogRecord->objn, redoLogRecord->objd, redoLogRecord->uba, redoLogRecord->dba, redoLogRecord->slt,
                         redoLogRecord->rci, redoLogRecord, &zero, &oracleEnvironment->transactionBuffer);
                 oracleEnvironment->xidTransactionMap[redoLogRecord->xid] = transaction;
-                oracleEnvironment->transactionHeap.add(transaction);
+                oracleEnvironment->transactionTracker.add(transaction);
+                oracleEnvironment->slotTransactionMap[USNSLT(USN(redoLogRecord->xid), SLT(redoLogRecord->xid))] = transaction;
             } else {
                 if (transaction->opCodes > 0)
                     oracleEnvironment->lastOpTransactionMap.erase(transaction->lastUba, transaction->lastDba,
                             transaction->lastSlt, transaction->lastRci);
                 transaction->add(oracleEnvironment, redoLogRecord->objn, redoLogRecord->objd, redoLogRecord->uba, redoLogRecord->dba, redoLogRecord->slt,
                         redoLogRecord->rci, redoLogRecord, &zero, &oracleEnvironment->transactionBuffer);
-                oracleEnvironment->transactionHeap.update(transaction->pos);
+                if (!transaction->isCommit)
+                    oracleEnvironment->transactionTracker.update(transaction);
             }
             transaction->lastUba = redoLogRecord->uba;
             transaction->lastDba = redoLogRecord->dba;
@@ -809,7 +815,6 @@ namespace OpenLogReplicator {
                 oracleEnvironment->lastOpTransactionMap.set(redoLogRecord->uba, redoLogRecord->dba,
                         redoLogRecord->slt, redoLogRecord->rci, transaction);
             }
-            oracleEnvironment->transactionHeap.update(transaction->pos);
 
             return;
         } else
@@ -821,19 +826,28 @@ namespace OpenLogReplicator {
             transaction = new Transaction(redoLogRecord->xid, &oracleEnvironment->transactionBuffer);
             transaction->touch(curScn);
             oracleEnvironment->xidTransactionMap[redoLogRecord->xid] = transaction;
-            oracleEnvironment->transactionHeap.add(transaction);
-        } else
+            oracleEnvironment->transactionTracker.add(transaction);
+            oracleEnvironment->slotTransactionMap[USNSLT(USN(redoLogRecord->xid), SLT(redoLogRecord->xid))] = transaction;
+        } else if (!transaction->isCommit) {
+            //commit SCN is the key in commit queue, it can't change after commit
             transaction->touch(curScn);
+            oracleEnvironment->transactionTracker.update(transaction);
+        }
 
         if (redoLogRecord->opCode == 0x0502) {
             transaction->isBegin = true;
         }
 
-        if (redoLogRecord->opCode == 0x0504) {
+        if (redoLogRecord->opCode == 0x0504 && !transaction->isCommit) {
             transaction->isCommit = true;
             if ((redoLogRecord->flg & FLG_ROLLBACK_OP0504) != 0)
                 transaction->isRollback = true;
-            oracleEnvironment->transactionHeap.update(transaction->pos);
+            oracleEnvironment->transactionTracker.erase(transaction);
+            oracleEnvironment->commitQueue.push(transaction);
+
+            auto it = oracleEnvironment->slotTransactionMap.find(USNSLT(USN(transaction->xid), SLT(transaction->xid)));
+            if (it != oracleEnvironment->slotTransactionMap.end() && it->second == transaction)
+                oracleEnvironment->slotTransactionMap.erase(it);
         }
     }
 
@@ -898,7 +912,8 @@ namespace OpenLogReplicator {
                     transaction->add(oracleEnvironment, objn, objd, redoLogRecord1->uba, redoLogRecord1->dba, redoLogRecord1->slt, redoLogRecord1->rci,
                             redoLogRecord1, redoLogRecord2, &oracleEnvironment->transactionBuffer);
                     oracleEnvironment->xidTransactionMap[redoLogRecord1->xid] = transaction;
-                    oracleEnvironment->transactionHeap.add(transaction);
+                    oracleEnvironment->transactionTracker.add(transaction);
+                    oracleEnvironment->slotTransactionMap[USNSLT(USN(redoLogRecord1->xid), SLT(redoLogRecord1->xid))] = transaction;
                 } else {
                     if (transaction->opCodes > 0)
                         oracleEnvironment->lastOpTransactionMap.erase(transaction->lastUba, transaction->lastDba,
@@ -906,7 +921,8 @@ namespace OpenLogReplicator {
 
                     transaction->add(oracleEnvironment, objn, objd, redoLogRecord1->uba, redoLogRecord1->dba, redoLogRecord1->slt, redoLogRecord1->rci,
                             redoLogRecord1, redoLogRecord2, &oracleEnvironment->transactionBuffer);
-                    oracleEnvironment->transactionHeap.update(transaction->pos);
+                    if (!transaction->isCommit)
+                        oracleEnvironment->transactionTracker.update(transaction);
                 }
                 transaction->lastUba = redoLogRecord1->uba;
                 transaction->lastDba = redoLogRecord1->dba;
@@ -920,7 +936,6 @@ namespace OpenLogReplicator {
                     oracleEnvironment->lastOpTransactionMap.set(redoLogRecord1->uba, redoLogRecord1->dba,
                             redoLogRecord1->slt, redoLogRecord1->rci, transaction);
                 }
-                oracleEnvironment->transactionHeap.update(transaction->pos);
             }
             break;
 
@@ -951,38 +966,49 @@ namespace OpenLogReplicator {
                     oracleEnvironment->lastOpTransactionMap.erase(transaction->lastUba, transaction->lastDba,
                             transaction->lastSlt, transaction->lastRci);
                     transaction->rollbackLastOp(oracleEnvironment, curScn, &oracleEnvironment->transactionBuffer);
-                    oracleEnvironment->transactionHeap.update(transaction->pos);
                     oracleEnvironment->lastOpTransactionMap.set(transaction->lastUba, transaction->lastDba,
                             transaction->lastSlt, transaction->lastRci, transaction);
 
                 } else {
-                    //check all previous transactions - not yet implemented
+                    //rollback to savepoint: operation is not the last one, locate the transaction by undo slot
                     bool foundPrevious = false;
 
-                    for (uint32_t i = 0; i < oracleEnvironment->transactionHeap.heapSize; ++i) {
-                        transaction = oracleEnvironment->transactionHeap.heap[i];
-
-                        if (transaction != nullptr &&
-                                transaction->opCodes > 0 &&
-                                transaction->rollbackPreviousOp(oracleEnvironment, curScn, &oracleEnvironment->transactionBuffer, redoLogRecord1->uba,
-                                redoLogRecord2->dba, redoLogRecord2->slt, redoLogRecord2->rci)) {
-                            oracleEnvironment->transactionHeap.update(transaction->pos);
-                            foundPrevious = true;
-                            break;
+                    if (redoLogRecord2->usn >= 0) {
+                        auto it = oracleEnvironment->slotTransactionMap.find(USNSLT(redoLogRecord2->usn, redoLogRecord2->slt));
+                        if (it != oracleEnvironment->slotTransactionMap.end()) {
+                            transaction = it->second;
+                            typeuba lastUba = transaction->lastUba;
+                            uint32_t lastDba = transaction->lastDba;
+                            uint8_t lastSlt = transaction->lastSlt;
+                            uint8_t lastRci = transaction->lastRci;
+
+                            if (transaction->opCodes > 0 &&
+                                    transaction->rollbackPreviousOp(oracleEnvironment, curScn, &oracleEnvironment->transactionBuffer, redoLogRecord1->uba,
+                                    redoLogRecord2->dba, redoLogRecord2->slt, redoLogRecord2->rci)) {
+                                foundPrevious = true;
+
+                                //last operation could have changed
+                                if (lastUba != transaction->lastUba || lastDba != transaction->lastDba ||
+                                        lastSlt != transaction->lastSlt || lastRci != transaction->lastRci) {
+                                    oracleEnvironment->lastOpTransactionMap.erase(lastUba, lastDba, lastSlt, lastRci);
+                                    if (transaction->opCodes > 0)
+                                        oracleEnvironment->lastOpTransactionMap.set(transaction->lastUba, transaction->lastDba,
+                                                transaction->lastSlt, transaction->lastRci, transaction);
+                                }
+
+                            //operation of streamed transaction could be already sent
+                            } else if (transaction->isStreamed && oracleEnvironment->rollbackStreamed(transaction, curScn, redoLogRecord1->uba,
+                                    redoLogRecord2->dba, redoLogRecord2->slt, redoLogRecord2->rci))
+                                foundPrevious = true;
                         }
                     }
+
                     if (!foundPrevious) {
                         if (oracleEnvironment->trace >= TRACE_WARN)
                             cerr << "WARNING: can't rollback transaction part, UBA: " << PRINTUBA(redoLogRecord1->uba) <<
                                     " DBA: " << hex << redoLogRecord2->dba <<
                                     " SLT: " << dec << (uint32_t)redoLogRecord2->slt <<
                                     " RCI: " << dec << (uint32_t)redoLogRecord2->rci << endl;
-                    } else {
-                        if (oracleEnvironment->trace >= TRACE_WARN)
-                            cerr << "WARNING: would like to rollback transaction part, UBA: " << PRINTUBA(redoLogRecord1->uba) <<
-                                    " DBA: " << hex << redoLogRecord2->dba <<
-                                    " SLT: " << dec << (uint32_t)redoLogRecord2->slt <<
-                                    " RCI: " << dec << (uint32_t)redoLogRecord2->rci << endl;
                     }
                 }
             }
@@ -992,31 +1018,26 @@ namespace OpenLogReplicator {
     }
 
 
-    void OracleReaderRedo::flushTransactions(bool checkpoint) {
-        Transaction *transaction = oracleEnvironment->transactionHeap.top();
-        typescn checkpointScn;
-        if (checkpoint) {
-            checkpointScn = curScn;
-            lastCheckpointScn = curScn;
-            lastCheckpointInfo = false;
-        } else if (curScn > 200) { //TODO: parametrize
-            checkpointScn = curScn - 200;
-            if (checkpointScn < lastCheckpointScn)
-                return;
+    //commit queue is ordered by commit scn, every commit up to the watermark is already read;
+    //transactions still open commit after the watermark, so they don't hold back earlier commits,
+    //but their first SCN bounds the checkpoint: on restart their records have to be read again
+    void OracleReaderRedo::flushTransactions(typescn checkpointScn) {
+        if (oracleEnvironment->serializerThreads > 0)
+            oracleEnvironment->releaseTransactions(false);
 
-            if (!lastCheckpointInfo) {
-                if (oracleEnvironment->trace >= TRACE_INFO) {
-                    if (oracleEnvironment->version >= 12200)
-                        cerr << "INFO: current SCN: " << PRINTSCN64(curScn) << ", checkpoint at SCN: " << PRINTSCN64(checkpointScn) << endl;
-                    else
-                        cerr << "INFO: current SCN: " << PRINTSCN48(curScn) << ", checkpoint at SCN: " << PRINTSCN48(checkpointScn) << endl;
-                }
-                lastCheckpointInfo = true;
-            }
-        } else
+        if (checkpointScn < watermarkScn)
             return;
+        watermarkScn = checkpointScn;
 
-        while (transaction != nullptr) {
+        if (oracleEnvironment->trace >= TRACE_FULL) {
+            if (oracleEnvironment->version >= 12200)
+                cerr << "Watermark SCN: " << PRINTSCN64(watermarkScn) << endl;
+            else
+                cerr << "Watermark SCN: " << PRINTSCN48(watermarkScn) << endl;
+        }
+
+        while (!oracleEnvironment->commitQueue.empty()) {
+            Transaction *transaction = oracleEnvironment->commitQueue.top();
             if (oracleEnvironment->trace >= TRACE_FULL) {
                 cerr << "FirstScn: " << PRINTSCN64(transaction->firstScn) <<
                         " lastScn: " << PRINTSCN64(transaction->lastScn) <<
@@ -1030,20 +1051,22 @@ namespace OpenLogReplicator {
                         endl;
             }
 
-            if (transaction->lastScn <= checkpointScn && transaction->isCommit) {
-                if (transaction->isBegin)
+            if (transaction->lastScn <= checkpointScn) {
+                bool serialize = false;
+                if (transaction->isBegin) {
                     //FIXME: it should be checked if transaction begin SCN is within captured range of SCNs
-                    transaction->flush(oracleEnvironment);
-                else {
-                    if (curScn + 100 > transaction->lastScn) //TODO: parametrize
-                        return;
-
+                    transaction->sort(&oracleEnvironment->transactionBuffer);
+                    if (oracleEnvironment->serializerThreads > 0 && ((transaction->opCodes > 0 && !transaction->isRollback) || transaction->isStreamed))
+                        serialize = true;
+                    else
+                        transaction->flush(oracleEnvironment, oracleEnvironment->commandBuffer, oracleEnvironment->transactionBuffer.spillBuffer);
+                } else {
                     if (oracleEnvironment->trace >= TRACE_WARN) {
                         cerr << "WARNING: skipping transaction with no begin, XID: " << PRINTXID(transaction->xid) << endl;
 
-                        for (uint32_t i = 1; i <= oracleEnvironment->transactionHeap.heapSize; ++i) {
-                            Transaction *transactionI = oracleEnvironment->transactionHeap.heap[i];
-                            cerr << "WARNING: heap dump[" << i << "] XID: " << PRINTXID(transactionI->xid) <<
+                        for (uint32_t i = 0; i < oracleEnvironment->transactionTracker.size(); ++i) {
+                            Transaction *transactionI = oracleEnvironment->transactionTracker.at(i);
+                            cerr << "WARNING: open transaction dump[" << i << "] XID: " << PRINTXID(transactionI->xid) <<
                                     ", begin: " << transactionI->isBegin <<
                                     ", commit: " << transactionI->isCommit <<
                                     ", rollback: " << transactionI->isRollback << endl;
@@ -1052,19 +1075,30 @@ namespace OpenLogReplicator {
                     }
                 }
 
-                oracleEnvironment->transactionHeap.pop();
+                oracleEnvironment->commitQueue.pop();
                 if (transaction->opCodes > 0)
                     oracleEnvironment->lastOpTransactionMap.erase(transaction->lastUba, transaction->lastDba,
                             transaction->lastSlt, transaction->lastRci);
                 oracleEnvironment->xidTransactionMap.erase(transaction->xid);
-
-                //oracleEnvironment->xidTransactionMap[transaction->xid]->free(&oracleEnvironment->transactionBuffer);
-                delete oracleEnvironment->xidTransactionMap[transaction->xid];
-                transaction = oracleEnvironment->transactionHeap.top();
+                if (serialize)
+                    oracleEnvironment->serializeTransaction(transaction);
+                else {
+                    transaction->free(&oracleEnvironment->transactionBuffer);
+                    delete transaction;
+                }
             } else
                 break;
         }
 
+        typescn minScn = oracleEnvironment->transactionTracker.minScn();
+        if (minScn < watermarkScn)
+            oracleEnvironment->checkpointScn = minScn;
+        else
+            oracleEnvironment->checkpointScn = watermarkScn;
+
+        //release memory after peaks, only when usage stays low
+        oracleEnvironment->transactionBuffer.shrink();
+
         if (oracleEnvironment->trace >= TRACE_FULL) {
             for (auto const& xid : oracleEnvironment->xidTransactionMap) {
                 Transaction *transaction = oracleEnvironment->xidTransactionMap[xid.first];
@@ -1192,7 +1226,7 @@ namespace OpenLogReplicator {
                         break;
                     }
 
-                    flushTransactions(true);
+                    flushTransactions(curScn);
                     //online redo log problem
                     if (oracleReader->shutdown)
                         break;
@@ -43,7 +43,7 @@ namespace OpenLogReplicator {
     private:
         OracleEnvironment *oracleEnvironment;
         int group;
-        typescn lastCheckpointScn;
+        typescn watermarkScn;
         typescn curScn;
         typescn firstScn;
         typescn nextScn;
@@ -65,7 +65,6 @@ namespace OpenLogReplicator {
         uint32_t headerBufferFileEnd;
         bool lastReadSuccessfull;
         bool redoOverwritten;
-        bool lastCheckpointInfo;
         char SID[9];
         int fileDes;
 
@@ -75,7 +74,7 @@ namespace OpenLogReplicator {
         int checkRedoHeader(bool first);
         int processBuffer();
         void analyzeRecord();
-        void flushTransactions(bool checkpoint);
+        void flushTransactions(typescn checkpointScn);
         void appendToTransaction(RedoLogRecord *redoLogRecord);
         void appendToTransaction(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2);
         uint16_t calcChSum(uint8_t *buffer, uint32_t size);
@@ -0,0 +1,275 @@
+/* Decoding of Oracle date and time values
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string.h>
+#include "types.h"
+#include "OracleNumber.h"
+#include "OracleTime.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    static const uint32_t oracleTimeMonthDays[13] = {0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    bool OracleTime::isTime(uint32_t typeNo) {
+        return typeNo == ORACLE_TYPE_DATE || typeNo == ORACLE_TYPE_TIMESTAMP || typeNo == ORACLE_TYPE_TIMESTAMP_TZ ||
+                typeNo == ORACLE_TYPE_TIMESTAMP_LTZ;
+    }
+
+    bool OracleTime::isInterval(uint32_t typeNo) {
+        return typeNo == ORACLE_TYPE_INTERVAL_YM || typeNo == ORACLE_TYPE_INTERVAL_DS;
+    }
+
+    //7 bytes: century + 100, year + 100, month, day, hour + 1, minute + 1, second + 1; 11 and 13 bytes: also nanoseconds
+    bool OracleTime::decodeFields(const uint8_t *data, uint32_t length, OracleTimeFields &fields) {
+        if (length != 7 && length != 11 && length != 13)
+            return false;
+
+        //AD
+        if (data[0] >= 100 && data[1] >= 100)
+            fields.year = (data[0] - 100) * 100 + (data[1] - 100);
+        //BC, year 1 BC is year 0
+        else
+            fields.year = 1 - ((100 - data[0]) * 100 + (100 - data[1]));
+
+        fields.month = data[2];
+        fields.day = data[3];
+        fields.hour = data[4] - 1;
+        fields.minute = data[5] - 1;
+        fields.second = data[6] - 1;
+        fields.nanosecond = 0;
+        if (length >= 11)
+            fields.nanosecond = ((uint32_t)data[7] << 24) | ((uint32_t)data[8] << 16) | ((uint32_t)data[9] << 8) | data[10];
+
+        if (fields.year < -9999 || fields.year > 9999 || fields.month < 1 || fields.month > 12 || fields.day < 1 ||
+                fields.day > oracleTimeMonthDays[fields.month] || fields.hour > 23 || fields.minute > 59 || fields.second > 59 ||
+                fields.nanosecond > 999999999)
+            return false;
+        return true;
+    }
+
+    //days from 1970-01-01 in proleptic Gregorian calendar
+    int64_t OracleTime::daysFromCivil(int64_t year, uint32_t month, uint32_t day) {
+        int64_t y = year - (month <= 2 ? 1 : 0);
+        int64_t era = (y >= 0 ? y : y - 399) / 400;
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    void OracleTime::civilFromDays(int64_t days, OracleTimeFields &fields) {
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        int64_t doe = days - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        fields.day = doy - (153 * mp + 2) / 5 + 1;
+        fields.month = mp < 10 ? mp + 3 : mp - 9;
+        fields.year = yoe + era * 400 + (fields.month <= 2 ? 1 : 0);
+    }
+
+    //shortest of milli, micro and nanoseconds which is exact, nothing for 0
+    uint32_t OracleTime::formatFraction(uint32_t nanosecond, uint8_t *out) {
+        if (nanosecond == 0)
+            return 0;
+
+        uint32_t digits = 9;
+        if (nanosecond % 1000000 == 0) {
+            nanosecond /= 1000000;
+            digits = 3;
+        } else if (nanosecond % 1000 == 0) {
+            nanosecond /= 1000;
+            digits = 6;
+        }
+
+        out[0] = '.';
+        for (uint32_t pos = digits; pos > 0; --pos) {
+            out[pos] = '0' + nanosecond % 10;
+            nanosecond /= 10;
+        }
+        return digits + 1;
+    }
+
+    uint32_t OracleTime::formatUnsigned(uint64_t val, uint8_t *out) {
+        uint32_t length = 1;
+        for (uint64_t rest = val; rest >= 10; rest /= 10)
+            ++length;
+
+        uint32_t pos = length;
+        while (pos >= 2) {
+            pos -= 2;
+            memcpy(out + pos, OracleNumber::digitPairs + (val % 100) * 2, 2);
+            val /= 100;
+        }
+        if (pos == 1)
+            out[0] = '0' + val;
+        return length;
+    }
+
+    //ISO 8601: [-]YYYY-MM-DDTHH:MM:SS[.fff[fff[fff]]][Z|+HH:MM], time zone only for TIMESTAMP WITH TIME ZONE
+    uint32_t OracleTime::formatTimestamp(uint32_t typeNo, const uint8_t *data, uint32_t length, uint8_t *out) {
+        OracleTimeFields fields;
+        if (!decodeFields(data, length, fields))
+            return 0;
+
+        //stored in UTC, shown in local time of the offset; region names are not known, these stay in UTC
+        int32_t offset = 0;
+        bool utc = false;
+        if (typeNo == ORACLE_TYPE_TIMESTAMP_TZ) {
+            if (length == 13 && (data[11] & 0x80) == 0) {
+                int32_t offsetHour = data[11] - 20, offsetMinute = data[12] - 60;
+                if (offsetHour < -15 || offsetHour > 15 || offsetMinute < -59 || offsetMinute > 59)
+                    return 0;
+                offset = offsetHour * 60 + offsetMinute;
+            } else
+                utc = true;
+        } else if (length == 13)
+            return 0;
+
+        if (offset != 0) {
+            int64_t minutes = (daysFromCivil(fields.year, fields.month, fields.day) * 24 + fields.hour) * 60 + fields.minute + offset;
+            int64_t days = (minutes >= 0 ? minutes : minutes - 1439) / 1440;
+            minutes -= days * 1440;
+            civilFromDays(days, fields);
+            fields.hour = minutes / 60;
+            fields.minute = minutes % 60;
+            if (fields.year < -9999 || fields.year > 9999)
+                return 0;
+        }
+
+        uint32_t pos = 0;
+        uint64_t year = fields.year;
+        if (fields.year < 0) {
+            out[pos++] = '-';
+            year = -fields.year;
+        }
+        memcpy(out + pos, OracleNumber::digitPairs + (year / 100) * 2, 2);
+        memcpy(out + pos + 2, OracleNumber::digitPairs + (year % 100) * 2, 2);
+        out[pos + 4] = '-';
+        memcpy(out + pos + 5, OracleNumber::digitPairs + fields.month * 2, 2);
+        out[pos + 7] = '-';
+        memcpy(out + pos + 8, OracleNumber::digitPairs + fields.day * 2, 2);
+        out[pos + 10] = 'T';
+        memcpy(out + pos + 11, OracleNumber::digitPairs + fields.hour * 2, 2);
+        out[pos + 13] = ':';
+        memcpy(out + pos + 14, OracleNumber::digitPairs + fields.minute * 2, 2);
+        out[pos + 16] = ':';
+        memcpy(out + pos + 17, OracleNumber::digitPairs + fields.second * 2, 2);
+        pos += 19;
+        pos += formatFraction(fields.nanosecond, out + pos);
+
+        if (utc)
+            out[pos++] = 'Z';
+        else if (typeNo == ORACLE_TYPE_TIMESTAMP_TZ) {
+            uint32_t offsetAbs = offset;
+            out[pos] = '+';
+            if (offset < 0) {
+                out[pos] = '-';
+                offsetAbs = -offset;
+            }
+            memcpy(out + pos + 1, OracleNumber::digitPairs + (offsetAbs / 60) * 2, 2);
+            out[pos + 3] = ':';
+            memcpy(out + pos + 4, OracleNumber::digitPairs + (offsetAbs % 60) * 2, 2);
+            pos += 6;
+        }
+        return pos;
+    }
+
+    //ISO 8601 duration: [-]PnYnM or [-]PnDTnHnMn[.fff[fff[fff]]]S, all fields have the same sign
+    uint32_t OracleTime::formatInterval(uint32_t typeNo, const uint8_t *data, uint32_t length, uint8_t *out) {
+        uint32_t pos = 0;
+
+        if (typeNo == ORACLE_TYPE_INTERVAL_YM) {
+            //years + 0x80000000, months + 60
+            if (length != 5)
+                return 0;
+            int64_t years = (int64_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]) - 0x80000000;
+            int32_t months = data[4] - 60;
+            if (months < -11 || months > 11 || (years < 0 && months > 0) || (years > 0 && months < 0))
+                return 0;
+
+            if (years < 0 || months < 0) {
+                out[pos++] = '-';
+                years = -years;
+                months = -months;
+            }
+            out[pos++] = 'P';
+            pos += formatUnsigned(years, out + pos);
+            out[pos++] = 'Y';
+            pos += formatUnsigned(months, out + pos);
+            out[pos++] = 'M';
+            return pos;
+        }
+
+        //days + 0x80000000, hours, minutes and seconds + 60, nanoseconds + 0x80000000
+        if (length != 11)
+            return 0;
+        int64_t days = (int64_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]) - 0x80000000;
+        int32_t hours = data[4] - 60, minutes = data[5] - 60, seconds = data[6] - 60;
+        int64_t nanoseconds = (int64_t)(((uint32_t)data[7] << 24) | ((uint32_t)data[8] << 16) | ((uint32_t)data[9] << 8) | data[10]) - 0x80000000;
+        if (hours < -23 || hours > 23 || minutes < -59 || minutes > 59 || seconds < -59 || seconds > 59 ||
+                nanoseconds < -999999999 || nanoseconds > 999999999)
+            return 0;
+
+        bool negative = (days < 0 || hours < 0 || minutes < 0 || seconds < 0 || nanoseconds < 0);
+        if (negative && (days > 0 || hours > 0 || minutes > 0 || seconds > 0 || nanoseconds > 0))
+            return 0;
+        if (negative) {
+            out[pos++] = '-';
+            days = -days;
+            hours = -hours;
+            minutes = -minutes;
+            seconds = -seconds;
+            nanoseconds = -nanoseconds;
+        }
+        out[pos++] = 'P';
+        pos += formatUnsigned(days, out + pos);
+        out[pos++] = 'D';
+        out[pos++] = 'T';
+        pos += formatUnsigned(hours, out + pos);
+        out[pos++] = 'H';
+        pos += formatUnsigned(minutes, out + pos);
+        out[pos++] = 'M';
+        pos += formatUnsigned(seconds, out + pos);
+        pos += formatFraction(nanoseconds, out + pos);
+        out[pos++] = 'S';
+        return pos;
+    }
+
+    //text of at most ORACLE_TIME_LENGTH_MAX bytes, 0 for malformed value
+    uint32_t OracleTime::format(uint32_t typeNo, const uint8_t *data, uint32_t length, uint8_t *out) {
+        if (isInterval(typeNo))
+            return formatInterval(typeNo, data, length, out);
+        return formatTimestamp(typeNo, data, length, out);
+    }
+
+    //microseconds since epoch for binary formats, WITH TIME ZONE is stored in UTC, WITH LOCAL TIME ZONE in database time zone
+    bool OracleTime::decode(const uint8_t *data, uint32_t length, int64_t &val) {
+        OracleTimeFields fields;
+        if (!decodeFields(data, length, fields))
+            return false;
+
+        int64_t days = daysFromCivil(fields.year, fields.month, fields.day);
+        val = (days * 86400 + fields.hour * 3600 + fields.minute * 60 + fields.second) * 1000000 + fields.nanosecond / 1000;
+        return true;
+    }
+}
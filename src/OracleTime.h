@@ -0,0 +1,69 @@
+/* Header for OracleTime class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdint.h>
+#include "types.h"
+
+#ifndef ORACLETIME_H_
+#define ORACLETIME_H_
+
+#define ORACLE_TYPE_DATE 12
+#define ORACLE_TYPE_TIMESTAMP 180
+#define ORACLE_TYPE_TIMESTAMP_TZ 181
+#define ORACLE_TYPE_INTERVAL_YM 182
+#define ORACLE_TYPE_INTERVAL_DS 183
+#define ORACLE_TYPE_TIMESTAMP_LTZ 231
+
+#define ORACLE_TIME_LENGTH_MAX 64
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //fields of DATE or TIMESTAMP, year is astronomical: 1 BC is 0
+    struct OracleTimeFields {
+        int64_t year;
+        uint32_t month;
+        uint32_t day;
+        uint32_t hour;
+        uint32_t minute;
+        uint32_t second;
+        uint32_t nanosecond;
+    };
+
+    //decoding of DATE, TIMESTAMP, TIMESTAMP WITH (LOCAL) TIME ZONE and INTERVAL values
+    class OracleTime {
+    protected:
+        static bool decodeFields(const uint8_t *data, uint32_t length, OracleTimeFields &fields);
+        static int64_t daysFromCivil(int64_t year, uint32_t month, uint32_t day);
+        static void civilFromDays(int64_t days, OracleTimeFields &fields);
+        static uint32_t formatFraction(uint32_t nanosecond, uint8_t *out);
+        static uint32_t formatUnsigned(uint64_t val, uint8_t *out);
+        static uint32_t formatTimestamp(uint32_t typeNo, const uint8_t *data, uint32_t length, uint8_t *out);
+        static uint32_t formatInterval(uint32_t typeNo, const uint8_t *data, uint32_t length, uint8_t *out);
+
+    public:
+        static bool isTime(uint32_t typeNo);
+        static bool isInterval(uint32_t typeNo);
+        static uint32_t format(uint32_t typeNo, const uint8_t *data, uint32_t length, uint8_t *out);
+        static bool decode(const uint8_t *data, uint32_t length, int64_t &val);
+    };
+}
+
+#endif
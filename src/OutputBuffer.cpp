@@ -0,0 +1,75 @@
+/* Buffer for transaction formatted by serializer thread
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <iostream>
+#include <mutex>
+#include "types.h"
+#include "OutputBuffer.h"
+#include "OracleEnvironment.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    OutputBuffer::OutputBuffer(OracleEnvironment *oracleEnvironment, CommandBuffer *commandBuffer) :
+            CommandBuffer(),
+            oracleEnvironment(oracleEnvironment),
+            commandBuffer(commandBuffer),
+            ticket(0) {
+        filterBuffer = commandBuffer;
+    }
+
+    OutputBuffer::~OutputBuffer() {
+    }
+
+    //buffer is full, the transaction keeps its turn until it is published completely
+    CommandBuffer* OutputBuffer::rewind() {
+        if (posEnd < INTRA_THREAD_BUFFER_SIZE - MAX_TRANSACTION_SIZE)
+            return this;
+        //on shutdown the rest of the transaction is dropped too
+        if (!publish()) {
+            posEnd = 0;
+            posEndTmp = 0;
+        }
+        return this;
+    }
+
+    //copy complete messages to the target buffer in commit order, false - shutdown before the turn of the transaction
+    bool OutputBuffer::publish() {
+        {
+            unique_lock<mutex> lck(oracleEnvironment->serializeMtx);
+            while (oracleEnvironment->publishTicket != ticket) {
+                if (this->shutdown)
+                    return false;
+                oracleEnvironment->publishCond.wait(lck);
+            }
+        }
+
+        uint64_t pos = 0;
+        while (pos < posEnd) {
+            CommandBufferHeader *header = (CommandBufferHeader*)(intraThreadBuffer + pos);
+            commandBuffer->appendTran(header);
+            pos += (header->length + 7) & 0xFFFFFFF8;
+        }
+
+        posEnd = 0;
+        posEndTmp = 0;
+        return true;
+    }
+}
@@ -1,4 +1,4 @@
-/* Header for TransactionHeap class
+/* Header for OutputBuffer class
    Copyright (C) 2018-2020 Adam Leszczynski.
 
 This file is part of Open Log Replicator.
@@ -17,30 +17,32 @@ You should have received a copy of the GNU General Public License
 along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <stdint.h>
 #include "types.h"
+#include "CommandBuffer.h"
 
-#ifndef TRANSACTIONHEAP_H_
-#define TRANSACTIONHEAP_H_
+#ifndef OUTPUTBUFFER_H_
+#define OUTPUTBUFFER_H_
+
+using namespace std;
 
 namespace OpenLogReplicator {
 
-    class Transaction;
+    class OracleEnvironment;
+
+    class OutputBuffer : public CommandBuffer {
+    protected:
+        OracleEnvironment *oracleEnvironment;
+        CommandBuffer *commandBuffer;
 
-    class TransactionHeap {
     public:
-        uint32_t heapMaxSize;
-        uint32_t heapSize;
-        Transaction **heap;
-
-        void initialize(uint32_t heapMaxSize);
-        void pop();
-        void pop(uint32_t pos);
-        Transaction *top();
-        int add(Transaction *element);
-        void update(uint32_t pos);
-
-        TransactionHeap();
-        virtual ~TransactionHeap();
+        uint64_t ticket;
+
+        virtual CommandBuffer* rewind();
+        bool publish();
+
+        OutputBuffer(OracleEnvironment *oracleEnvironment, CommandBuffer *commandBuffer);
+        virtual ~OutputBuffer();
     };
 }
 
@@ -0,0 +1,282 @@
+/* Library for processes reading shared memory ring
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ShmReader.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    ShmReader::ShmReader(uint32_t spin) :
+        fd(-1),
+        map(nullptr),
+        mapSize(0),
+        ring(nullptr),
+        data(nullptr),
+        size(0),
+        slot(SHM_RING_READERS_MAX),
+        pos(0),
+        spin(spin),
+        current(nullptr),
+        joined(nullptr),
+        joinedLength(0),
+        joinedSize(0) {
+    }
+
+    ShmReader::~ShmReader() {
+        close();
+        if (joined != nullptr) {
+            delete[] joined;
+            joined = nullptr;
+        }
+    }
+
+    //reading starts with the next published message
+    int ShmReader::open(const char *name) {
+        string shmName = string("/") + name;
+        fd = shm_open(shmName.c_str(), O_RDWR, 0);
+        if (fd == -1)
+            return 0;
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || (uint64_t)fileStat.st_size <= SHM_RING_CONTROL_SIZE) {
+            close();
+            return 0;
+        }
+        mapSize = fileStat.st_size;
+        map = (uint8_t*)mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            close();
+            return 0;
+        }
+
+        ring = (ShmRingControl*)map;
+        data = map + SHM_RING_CONTROL_SIZE;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (ring->magic != SHM_RING_MAGIC || ring->version != SHM_RING_VERSION || ring->size + SHM_RING_CONTROL_SIZE > mapSize) {
+            close();
+            return 0;
+        }
+        size = ring->size;
+
+        uint32_t pid = getpid();
+        for (uint32_t i = 0; i < SHM_RING_READERS_MAX; ++i) {
+            uint32_t free = 0;
+            if (ring->slots[i].pid.compare_exchange_strong(free, pid)) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot == SHM_RING_READERS_MAX) {
+            close();
+            return 0;
+        }
+
+        //position is stable when no message was published while it was stored
+        do {
+            pos = ring->posWrite.load();
+            ring->slots[slot].pos.store(pos);
+        } while (ring->posWrite.load() != pos);
+
+        return 1;
+    }
+
+    void ShmReader::close() {
+        if (ring != nullptr && slot < SHM_RING_READERS_MAX) {
+            ring->slots[slot].pid.store(0);
+            if (ring->writerWaiting.load() > 0)
+                shmRingWake(&ring->readSeq);
+        }
+        slot = SHM_RING_READERS_MAX;
+        ring = nullptr;
+        current = nullptr;
+        joinedLength = 0;
+
+        if (map != nullptr) {
+            munmap(map, mapSize);
+            map = nullptr;
+        }
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    //the same message is returned until release
+    ShmRingMessage *ShmReader::next(uint64_t waitUs) {
+        if (ring == nullptr)
+            return nullptr;
+
+        uint32_t spins = 0;
+        while (true) {
+            uint64_t end = ring->posWrite.load();
+            while (pos < end) {
+                ShmRingMessage *message = (ShmRingMessage*)(data + pos % size);
+                if (message->length == 0) {
+                    pos = (pos / size + 1) * size;
+                    continue;
+                }
+
+                uint32_t flags = message->flags;
+                if ((flags & (SHM_RING_FRAGMENT_MORE | SHM_RING_FRAGMENT_NEXT)) != 0) {
+                    //beginning of the message was published before open
+                    if ((flags & SHM_RING_FRAGMENT_NEXT) != 0 && joinedLength == 0) {
+                        skip(message);
+                        continue;
+                    }
+                    join(message);
+                    skip(message);
+                    if ((flags & SHM_RING_FRAGMENT_MORE) != 0)
+                        continue;
+
+                    current = (ShmRingMessage*)joined;
+                    current->length = joinedLength;
+                    joinedLength = 0;
+                    return current;
+                }
+
+                current = message;
+                return message;
+            }
+
+            if (ring->state.load() != SHM_RING_OPEN)
+                return nullptr;
+            if (spins < spin) {
+                ++spins;
+                continue;
+            }
+            if (waitUs == 0)
+                return nullptr;
+
+            ++ring->readersWaiting;
+            uint32_t seq = ring->writeSeq.load();
+            if (ring->posWrite.load() == end && ring->state.load() == SHM_RING_OPEN)
+                shmRingWait(&ring->writeSeq, seq, waitUs == SHM_READER_WAIT_INFINITE ? 1000000 : waitUs);
+            --ring->readersWaiting;
+
+            if (waitUs != SHM_READER_WAIT_INFINITE && ring->posWrite.load() == end)
+                return nullptr;
+        }
+    }
+
+    //space of the message may be overwritten after release
+    void ShmReader::release() {
+        if (current == nullptr)
+            return;
+
+        //fragments of joined message are already released
+        if (current != (ShmRingMessage*)joined)
+            skip(current);
+        current = nullptr;
+    }
+
+    void ShmReader::skip(ShmRingMessage *message) {
+        pos += (message->length + 7) & 0xFFFFFFF8;
+        ring->slots[slot].pos.store(pos);
+        if (ring->writerWaiting.load() > 0)
+            shmRingWake(&ring->readSeq);
+    }
+
+    //fragment is copied, so the writer can reuse its space for the next one
+    void ShmReader::join(ShmRingMessage *message) {
+        if ((message->flags & SHM_RING_FRAGMENT_NEXT) == 0)
+            joinedLength = 0;
+        if (joinedLength == 0) {
+            joinedLength = SHM_RING_MESSAGE_HEADER;
+            if (joinedSize < SHM_RING_MESSAGE_HEADER) {
+                if (joined != nullptr)
+                    delete[] joined;
+                joinedSize = size;
+                joined = new uint8_t[joinedSize];
+            }
+            ShmRingMessage *header = (ShmRingMessage*)joined;
+            header->flags = message->flags & SHM_RING_COMPRESSED;
+            header->scn = message->scn;
+        }
+
+        uint64_t length = message->length - SHM_RING_MESSAGE_HEADER;
+        if (joinedLength + length > joinedSize) {
+            uint64_t newSize = joinedSize * 2;
+            while (joinedLength + length > newSize)
+                newSize *= 2;
+            uint8_t *newJoined = new uint8_t[newSize];
+            memcpy(newJoined, joined, joinedLength);
+            delete[] joined;
+            joined = newJoined;
+            joinedSize = newSize;
+        }
+        memcpy(joined + joinedLength, (uint8_t*)message + SHM_RING_MESSAGE_HEADER, length);
+        joinedLength += length;
+    }
+
+    //compression of the message returned by next: SHM_RING_COMPRESSED_* or 0
+    uint32_t ShmReader::compression() {
+        if (current == nullptr)
+            return 0;
+        return current->flags & SHM_RING_COMPRESSED;
+    }
+
+    bool ShmReader::isClosed() {
+        return ring == nullptr || (ring->state.load() != SHM_RING_OPEN && pos >= ring->posWrite.load());
+    }
+}
+
+using namespace OpenLogReplicator;
+
+void *olr_shm_open(const char *name, uint32_t spin) {
+    ShmReader *reader = new ShmReader(spin);
+    if (!reader->open(name)) {
+        delete reader;
+        return nullptr;
+    }
+    return reader;
+}
+
+const uint8_t *olr_shm_next(void *reader, uint32_t *length, uint64_t *scn, uint64_t waitUs) {
+    ShmRingMessage *message = ((ShmReader*)reader)->next(waitUs);
+    if (message == nullptr)
+        return nullptr;
+    *length = message->length - SHM_RING_MESSAGE_HEADER;
+    if (scn != nullptr)
+        *scn = message->scn;
+    return (const uint8_t*)message + SHM_RING_MESSAGE_HEADER;
+}
+
+void olr_shm_release(void *reader) {
+    ((ShmReader*)reader)->release();
+}
+
+uint32_t olr_shm_compression(void *reader) {
+    return ((ShmReader*)reader)->compression();
+}
+
+int olr_shm_closed(void *reader) {
+    return ((ShmReader*)reader)->isClosed() ? 1 : 0;
+}
+
+void olr_shm_close(void *reader) {
+    delete (ShmReader*)reader;
+}
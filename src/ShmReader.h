@@ -0,0 +1,76 @@
+/* Header for ShmReader class, library for processes reading shared memory ring
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdint.h>
+#include "ShmRing.h"
+
+#ifndef SHMREADER_H_
+#define SHMREADER_H_
+
+#define SHM_READER_WAIT_INFINITE 0xFFFFFFFFFFFFFFFF
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //reader of messages published by ShmWriter, messages are used in place until release,
+    //message published in fragments is copied
+    class ShmReader {
+    protected:
+        int fd;
+        uint8_t *map;
+        uint64_t mapSize;
+        ShmRingControl *ring;
+        uint8_t *data;
+        uint64_t size;
+        uint32_t slot;
+        uint64_t pos;
+        uint32_t spin;                              //checks of the ring before sleeping on futex
+        ShmRingMessage *current;
+        uint8_t *joined;                            //fragments of big message, with message header
+        uint64_t joinedLength;                      //0 - no message is being joined
+        uint64_t joinedSize;
+
+        void skip(ShmRingMessage *message);
+        void join(ShmRingMessage *message);
+
+    public:
+        int open(const char *name);
+        void close();
+        ShmRingMessage *next(uint64_t waitUs);
+        void release();
+        uint32_t compression();
+        bool isClosed();
+
+        ShmReader(uint32_t spin);
+        virtual ~ShmReader();
+    };
+}
+
+//C interface, name without leading slash, nullptr when no message came in waitUs or the ring is closed
+extern "C" {
+    void *olr_shm_open(const char *name, uint32_t spin);
+    const uint8_t *olr_shm_next(void *reader, uint32_t *length, uint64_t *scn, uint64_t waitUs);
+    void olr_shm_release(void *reader);
+    uint32_t olr_shm_compression(void *reader);
+    int olr_shm_closed(void *reader);
+    void olr_shm_close(void *reader);
+}
+
+#endif
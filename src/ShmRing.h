@@ -0,0 +1,94 @@
+/* Layout of shared memory ring shared by ShmWriter and ShmReader
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#define SHM_RING_MAGIC 0x534C524F
+#define SHM_RING_VERSION 3
+#define SHM_RING_READERS_MAX 16
+#define SHM_RING_CONTROL_SIZE 4096
+#define SHM_RING_MESSAGE_HEADER (sizeof(struct ShmRingMessage))
+
+#define SHM_RING_OPEN 0
+#define SHM_RING_CLOSED 1
+
+#define SHM_RING_FRAGMENT_MORE 1                    //next message continues this one
+#define SHM_RING_FRAGMENT_NEXT 2                    //message continues the previous one
+#define SHM_RING_COMPRESSED_ZSTD 4                  //payload compressed with zstd
+#define SHM_RING_COMPRESSED_LZ4 8                   //payload is lz4 frame
+#define SHM_RING_COMPRESSED (SHM_RING_COMPRESSED_ZSTD | SHM_RING_COMPRESSED_LZ4)
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    //message in the ring, 8 byte aligned like in CommandBuffer, length 0 - rest of the ring is not used,
+    //message bigger than half of the ring is published in fragments
+    struct ShmRingMessage {
+        uint32_t length;                            //with header
+        uint32_t flags;                             //SHM_RING_FRAGMENT_*, SHM_RING_COMPRESSED_*
+        uint64_t scn;
+    };
+
+    //reader position, slot is owned by process with pid
+    struct alignas(64) ShmRingSlot {
+        atomic<uint32_t> pid;
+        atomic<uint64_t> pos;
+    };
+
+    //first page of the shared memory, messages follow it
+    struct ShmRingControl {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t size;                              //of message area
+        atomic<uint32_t> state;
+
+        alignas(64) atomic<uint64_t> posWrite;      //end of published messages
+        atomic<uint32_t> writeSeq;                  //futex word of readers
+        atomic<uint32_t> readersWaiting;
+
+        alignas(64) atomic<uint32_t> readSeq;       //futex word of writer
+        atomic<uint32_t> writerWaiting;
+
+        ShmRingSlot slots[SHM_RING_READERS_MAX];
+    };
+
+    static_assert(sizeof(ShmRingControl) <= SHM_RING_CONTROL_SIZE, "ring control block too big");
+
+    //futex shared between processes, timeout in microseconds
+    static inline void shmRingWait(atomic<uint32_t> *word, uint32_t value, uint64_t waitUs) {
+        struct timespec timeout = {(time_t)(waitUs / 1000000), (long)((waitUs % 1000000) * 1000)};
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, value, &timeout, nullptr, 0);
+    }
+
+    static inline void shmRingWake(atomic<uint32_t> *word) {
+        ++*word;
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, 0x7FFFFFFF, nullptr, nullptr, 0);
+    }
+}
+
+#endif
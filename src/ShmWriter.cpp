@@ -0,0 +1,219 @@
+/* Thread writing to shared memory ring
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "types.h"
+#include "ShmWriter.h"
+#include "CommandBuffer.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    ShmWriter::ShmWriter(const string alias, CommandBuffer *commandBuffer, Writer *formatter, const string name, uint64_t size) :
+        SinkWriter(alias, commandBuffer, formatter),
+        name(name.c_str()),
+        size((size + 7) & 0xFFFFFFFFFFFFFFF8),
+        fd(-1),
+        map(nullptr),
+        ring(nullptr),
+        data(nullptr),
+        pos(0),
+        fragmentMax(0),
+        compressedFlags(0) {
+    }
+
+    ShmWriter::~ShmWriter() {
+        if (map != nullptr) {
+            munmap(map, SHM_RING_CONTROL_SIZE + size);
+            map = nullptr;
+        }
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+            shm_unlink(("/" + name).c_str());
+        }
+    }
+
+    //ring of previous run is removed, readers still attached to it see it as closed or time out
+    int ShmWriter::initialize() {
+        string shmName = "/" + name;
+        shm_unlink(shmName.c_str());
+        fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+        if (fd == -1) {
+            cerr << "ERROR: can't create shared memory: " << shmName << ", errno: " << dec << errno << endl;
+            return 0;
+        }
+        if (ftruncate(fd, SHM_RING_CONTROL_SIZE + size) != 0) {
+            cerr << "ERROR: can't allocate shared memory: " << shmName << ", size: " << dec << (SHM_RING_CONTROL_SIZE + size) << endl;
+            return 0;
+        }
+
+        map = (uint8_t*)mmap(nullptr, SHM_RING_CONTROL_SIZE + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            cerr << "ERROR: can't map shared memory: " << shmName << ", errno: " << dec << errno << endl;
+            return 0;
+        }
+
+        //new memory is zeroed, magic is set last so readers see the complete control block
+        ring = (ShmRingControl*)map;
+        data = map + SHM_RING_CONTROL_SIZE;
+        ring->version = SHM_RING_VERSION;
+        ring->size = size;
+        ring->state = SHM_RING_OPEN;
+        atomic_thread_fence(memory_order_seq_cst);
+        ring->magic = SHM_RING_MAGIC;
+        return 1;
+    }
+
+    void *ShmWriter::run() {
+        cout << "- Shared memory Writer for: /dev/shm/" << name << endl;
+        pos = ring->posWrite.load();
+        fragmentMax = ((size / 2) & 0xFFFFFFFFFFFFFFF8) - SHM_RING_MESSAGE_HEADER;
+        compressedFlags = 0;
+        if (compressor != nullptr && compressor->getType() == COMPRESSION_ZSTD)
+            compressedFlags = SHM_RING_COMPRESSED_ZSTD;
+        else if (compressor != nullptr && compressor->getType() == COMPRESSION_LZ4)
+            compressedFlags = SHM_RING_COMPRESSED_LZ4;
+
+        while (!this->shutdown) {
+            //compressed messages are published in order, too many waiting stop the thread
+            if (!jobs.empty())
+                writeJobs(SINK_WRITER_JOBS_MAX - 1);
+
+            CommandBufferHeader *header;
+            if (!jobs.empty()) {
+                header = commandBuffer->getTran(consumer, SINK_WRITER_JOBS_POLL_US);
+                if (header == nullptr)
+                    continue;
+            } else {
+                header = commandBuffer->getTran(consumer);
+                if (header == nullptr)
+                    break;
+            }
+
+            if (compressor != nullptr) {
+                compressTran(header);
+                continue;
+            }
+
+            bool published = publishMessage(header->scn, 0, (uint8_t*)header + COMMAND_BUFFER_HEADER, header->length - COMMAND_BUFFER_HEADER);
+            commandBuffer->releaseTran(consumer);
+            if (!published)
+                break;
+        }
+
+        writeJobs(0);
+        ring->state = SHM_RING_CLOSED;
+        shmRingWake(&ring->writeSeq);
+        return 0;
+    }
+
+    //compressed payload is marked in flags of every fragment, message not compressed is published plain
+    void ShmWriter::writeCompressed(SinkWriterJob *job) {
+        if (job->output != nullptr)
+            publishMessage(job->scn, compressedFlags, job->output, job->outputLength);
+        else
+            publishMessage(job->scn, 0, job->data, job->length);
+        freeJob(job);
+    }
+
+    //fragment always fits in the ring, readers join fragments in own memory
+    bool ShmWriter::publishMessage(uint64_t scn, uint32_t flags, uint8_t *payload, uint64_t length) {
+        uint32_t fragmentFlags = 0;
+        while (length > fragmentMax) {
+            if (!publish(pos, scn, flags | fragmentFlags | SHM_RING_FRAGMENT_MORE, payload, fragmentMax))
+                return false;
+            fragmentFlags = SHM_RING_FRAGMENT_NEXT;
+            payload += fragmentMax;
+            length -= fragmentMax;
+        }
+        return publish(pos, scn, flags | fragmentFlags, payload, length);
+    }
+
+    //message doesn't wrap, rest of the ring is skipped
+    bool ShmWriter::publish(uint64_t &pos, uint64_t scn, uint32_t flags, uint8_t *payload, uint64_t length) {
+        uint64_t messageLength = (SHM_RING_MESSAGE_HEADER + length + 7) & 0xFFFFFFFFFFFFFFF8;
+        uint64_t skip = 0;
+        if (pos % size + messageLength > size)
+            skip = size - pos % size;
+        if (!reserve(pos, skip + messageLength))
+            return false;
+        if (skip > 0) {
+            ((ShmRingMessage*)(data + pos % size))->length = 0;
+            pos += skip;
+        }
+
+        ShmRingMessage *message = (ShmRingMessage*)(data + pos % size);
+        message->length = SHM_RING_MESSAGE_HEADER + length;
+        message->flags = flags;
+        message->scn = scn;
+        memcpy((uint8_t*)message + SHM_RING_MESSAGE_HEADER, payload, length);
+        pos += messageLength;
+
+        ring->posWrite.store(pos);
+        if (ring->readersWaiting.load() > 0)
+            shmRingWake(&ring->writeSeq);
+        return true;
+    }
+
+    //slots of readers which exited without detaching are freed
+    uint64_t ShmWriter::slowestReader() {
+        uint64_t slowest = ring->posWrite.load();
+        for (uint32_t i = 0; i < SHM_RING_READERS_MAX; ++i) {
+            uint32_t pid = ring->slots[i].pid.load();
+            if (pid == 0)
+                continue;
+            if (kill(pid, 0) != 0 && errno == ESRCH) {
+                ring->slots[i].pid.compare_exchange_strong(pid, 0);
+                continue;
+            }
+            uint64_t readerPos = ring->slots[i].pos.load();
+            if (readerPos < slowest)
+                slowest = readerPos;
+        }
+        return slowest;
+    }
+
+    //waits until all readers are past the space needed for the message
+    bool ShmWriter::reserve(uint64_t pos, uint64_t length) {
+        while (!this->shutdown) {
+            if (pos + length - slowestReader() <= size)
+                return true;
+
+            ring->writerWaiting = 1;
+            uint32_t seq = ring->readSeq.load();
+            if (pos + length - slowestReader() <= size) {
+                ring->writerWaiting = 0;
+                return true;
+            }
+            shmRingWait(&ring->readSeq, seq, SHM_WRITER_WAIT_US);
+            ring->writerWaiting = 0;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,65 @@
+/* Header for ShmWriter class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <stdint.h>
+#include "types.h"
+#include "SinkWriter.h"
+#include "ShmRing.h"
+
+#ifndef SHMWRITER_H_
+#define SHMWRITER_H_
+
+#define SHM_WRITER_WAIT_US 100000
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    class CommandBuffer;
+
+    //messages published in named shared memory /dev/shm/<name>, read in place by ShmReader
+    class ShmWriter : public SinkWriter {
+    protected:
+        string name;
+        uint64_t size;
+        int fd;
+        uint8_t *map;
+        ShmRingControl *ring;
+        uint8_t *data;
+        uint64_t pos;                               //of the next message
+        uint64_t fragmentMax;
+        uint32_t compressedFlags;                   //SHM_RING_COMPRESSED_* of compressor
+
+        uint64_t slowestReader();
+        bool reserve(uint64_t pos, uint64_t length);
+        bool publish(uint64_t &pos, uint64_t scn, uint32_t flags, uint8_t *payload, uint64_t length);
+        bool publishMessage(uint64_t scn, uint32_t flags, uint8_t *payload, uint64_t length);
+        virtual void writeCompressed(SinkWriterJob *job);
+
+    public:
+        virtual void *run();
+        virtual int initialize();
+
+        ShmWriter(const string alias, CommandBuffer *commandBuffer, Writer *formatter, const string name, uint64_t size);
+        virtual ~ShmWriter();
+    };
+}
+
+#endif
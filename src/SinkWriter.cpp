@@ -0,0 +1,147 @@
+/* Base of targets consuming formatted messages
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string.h>
+#include <stdlib.h>
+#include "SinkWriter.h"
+#include "CommandBuffer.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    SinkWriter::SinkWriter(const string alias, CommandBuffer *commandBuffer, Writer *formatter) :
+        Writer(alias, commandBuffer, MESSAGE_FORMAT_TRANSACTION, false),
+        formatter(formatter) {
+    }
+
+    //messages not written are never acknowledged
+    SinkWriter::~SinkWriter() {
+        while (!jobs.empty()) {
+            SinkWriterJob *job = jobs.front();
+            jobs.pop_front();
+            compressor->wait(job);
+            job->ack = nullptr;
+            freeJob(job);
+        }
+        if (formatter != nullptr) {
+            delete formatter;
+            formatter = nullptr;
+        }
+    }
+
+    //message read from spill file is overwritten by next read and is compressed from a copy
+    void SinkWriter::compressTran(CommandBufferHeader *header) {
+        SinkWriterJob *job = new SinkWriterJob();
+        job->length = header->length - COMMAND_BUFFER_HEADER;
+        job->scn = header->scn;
+        if (commandBuffer->isInBuffer(header)) {
+            job->data = (uint8_t*)header + COMMAND_BUFFER_HEADER;
+            job->ownsData = false;
+            job->ack = commandBuffer->releaseTranDeferred(consumer);
+        } else {
+            job->data = new uint8_t[job->length];
+            memcpy(job->data, (uint8_t*)header + COMMAND_BUFFER_HEADER, job->length);
+            job->ownsData = true;
+            job->ack = nullptr;
+            commandBuffer->releaseTran(consumer);
+        }
+
+        compressor->submit(job);
+        jobs.push_back(job);
+    }
+
+    //writes compressed messages from the front of the queue, waits while more than keep are left
+    void SinkWriter::writeJobs(uint32_t keep) {
+        while (!jobs.empty()) {
+            SinkWriterJob *job = jobs.front();
+            if (!job->done) {
+                if (jobs.size() <= keep)
+                    break;
+                compressor->wait(job);
+            }
+            jobs.pop_front();
+            writeCompressed(job);
+        }
+    }
+
+    //sink which doesn't write compressed messages only releases them
+    void SinkWriter::writeCompressed(SinkWriterJob *job) {
+        freeJob(job);
+    }
+
+    void SinkWriter::freeJob(SinkWriterJob *job) {
+        if (job->ack != nullptr)
+            commandBuffer->ackTran(job->ack);
+        if (job->output != nullptr)
+            free(job->output);
+        if (job->ownsData)
+            delete[] job->data;
+        delete job;
+    }
+
+    //formatting is done by the formatter set as writer of the source
+    void SinkWriter::beginTran(typescn scn, typexid xid) {
+        formatter->beginTran(scn, xid);
+    }
+
+    void SinkWriter::beginProvisional(typescn scn, typexid xid) {
+        formatter->beginProvisional(scn, xid);
+    }
+
+    void SinkWriter::beginMarker(typescn scn, typexid xid) {
+        formatter->beginMarker(scn, xid);
+    }
+
+    void SinkWriter::endTran(typescn scn, typexid xid, bool rollback, bool partial) {
+        formatter->endTran(scn, xid, rollback, partial);
+    }
+
+    void SinkWriter::rollbackSavepoint(typescn scn, typexid xid, typeuba uba) {
+        formatter->rollbackSavepoint(scn, xid, uba);
+    }
+
+    void SinkWriter::next() {
+        formatter->next();
+    }
+
+    void SinkWriter::commitTran() {
+        formatter->commitTran();
+    }
+
+    void SinkWriter::parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) {
+        formatter->parseInsertMultiple(redoLogRecord1, redoLogRecord2, oracleEnvironment);
+    }
+
+    void SinkWriter::parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) {
+        formatter->parseDeleteMultiple(redoLogRecord1, redoLogRecord2, oracleEnvironment);
+    }
+
+    void SinkWriter::parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment) {
+        formatter->parseDML(redoLogRecord1, redoLogRecord2, type, oracleEnvironment);
+    }
+
+    void SinkWriter::parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment) {
+        formatter->parseDDL(redoLogRecord1, oracleEnvironment);
+    }
+
+    Writer *SinkWriter::clone(CommandBuffer *commandBuffer) {
+        return formatter->clone(commandBuffer);
+    }
+}
@@ -0,0 +1,80 @@
+/* Header for SinkWriter class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <string>
+#include <deque>
+#include "types.h"
+#include "Writer.h"
+#include "Compressor.h"
+
+#ifndef SINKWRITER_H_
+#define SINKWRITER_H_
+
+#define SINK_WRITER_JOBS_MAX 16
+#define SINK_WRITER_JOBS_POLL_US 1000
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    class RedoLogRecord;
+    class CommandBuffer;
+    class OracleEnvironment;
+    struct CommandBufferAck;
+    struct CommandBufferHeader;
+
+    //message waiting for compression, message in the buffer is compressed in place
+    struct SinkWriterJob : public CompressorJob {
+        typescn scn;
+        bool ownsData;                              //false - data is in command buffer until ack
+        CommandBufferAck *ack;
+    };
+
+    //target which only consumes formatted messages, formatting is forwarded to formatter
+    class SinkWriter : public Writer {
+    protected:
+        Writer *formatter;                          //formats messages when sink is the first target of the source
+        deque<SinkWriterJob*> jobs;                 //written in order when compressed
+
+        void compressTran(CommandBufferHeader *header);
+        void writeJobs(uint32_t keep);
+        void freeJob(SinkWriterJob *job);
+        virtual void writeCompressed(SinkWriterJob *job);
+
+    public:
+        virtual int initialize() = 0;
+        virtual void beginTran(typescn scn, typexid xid);
+        virtual void beginProvisional(typescn scn, typexid xid);
+        virtual void beginMarker(typescn scn, typexid xid);
+        virtual void endTran(typescn scn, typexid xid, bool rollback, bool partial);
+        virtual void rollbackSavepoint(typescn scn, typexid xid, typeuba uba);
+        virtual void next();
+        virtual void commitTran();
+        virtual void parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment);
+        virtual void parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment);
+        virtual void parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment);
+        virtual void parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment);
+        virtual Writer *clone(CommandBuffer *commandBuffer);
+
+        SinkWriter(const string alias, CommandBuffer *commandBuffer, Writer *formatter);
+        virtual ~SinkWriter();
+    };
+}
+
+#endif
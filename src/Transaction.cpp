@@ -20,7 +20,9 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <queue>
 #include <string.h>
+#include <unistd.h>
 #include "types.h"
 #include "CommandBuffer.h"
 #include "OracleEnvironment.h"
@@ -46,19 +48,10 @@ using namespace std;
 
 namespace OpenLogReplicator {
 
-    bool Transaction::operator< (Transaction &p) {
-        if (isCommit && !p.isCommit)
-            return true;
-        if (!isCommit && p.isCommit)
-            return false;
-
-        bool ret = lastScn < p.lastScn;
-        if (ret != false)
-            return ret;
-        return lastScn == p.lastScn && xid < p.xid;
-    }
-
+    //committed transaction is ordered in commit queue by lastScn, records read after commit don't move it
     void Transaction::touch(typescn scn) {
+        if (isCommit)
+            return;
         if (firstScn == ZERO_SCN || firstScn > scn)
             firstScn = scn;
         if (lastScn == ZERO_SCN || lastScn < scn)
@@ -68,7 +61,6 @@ namespace OpenLogReplicator {
     void Transaction::add(OracleEnvironment *oracleEnvironment, uint32_t objn, uint32_t objd, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci,
             RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, TransactionBuffer *transactionBuffer) {
 
-        uint8_t buffer[REDO_RECORD_MAX_SIZE];
         if (oracleEnvironment->trace >= TRACE_FULL)
             cerr << "Transaction add: " << setfill('0') << setw(4) << hex << redoLogRecord1->opCode << ":" <<
                     setfill('0') << setw(4) << hex << redoLogRecord2->opCode << endl;
@@ -78,57 +70,11 @@ namespace OpenLogReplicator {
             uint32_t opCode;
             RedoLogRecord *lastRedoLogRecord1, *lastRedoLogRecord2;
 
-            if (transactionBuffer->getLastRecord(tcLast, opCode, lastRedoLogRecord1, lastRedoLogRecord2) && opCode == 0x05010000 && (lastRedoLogRecord1->flg & FLG_MULTIBLOCKUNDOTAIL) != 0) {
-                uint32_t pos = 0, newFieldCnt;
-                uint16_t fieldPos, fieldPos2;
-                memcpy(buffer, redoLogRecord1->data, redoLogRecord1->fieldLengthsDelta);
-                pos = redoLogRecord1->fieldLengthsDelta;
-
-                if ((redoLogRecord1->flg & FLG_LASTBUFFERSPLIT) != 0) {
-                    uint16_t length1 = oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + redoLogRecord1->fieldCnt * 2);
-                    uint16_t length2 = oracleEnvironment->read16(lastRedoLogRecord1->data + lastRedoLogRecord1->fieldLengthsDelta + 6);
-                    oracleEnvironment->write16(lastRedoLogRecord1->data + lastRedoLogRecord1->fieldLengthsDelta + 6, length1 + length2);
-                    --redoLogRecord1->fieldCnt;
-                }
-
-                newFieldCnt = redoLogRecord1->fieldCnt + lastRedoLogRecord1->fieldCnt - 2;
-                oracleEnvironment->write16(buffer + pos, newFieldCnt);
-                memcpy(buffer + pos + 2, redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + 2, redoLogRecord1->fieldCnt * 2);
-                memcpy(buffer + pos + 2 + redoLogRecord1->fieldCnt * 2, lastRedoLogRecord1->data + lastRedoLogRecord1->fieldLengthsDelta + 6, lastRedoLogRecord1->fieldCnt * 2 - 4);
-                pos += (((newFieldCnt + 1) * 2) + 2) & (0xFFFC);
-                fieldPos = pos;
-
-                memcpy(buffer + pos, redoLogRecord1->data + redoLogRecord1->fieldPos, redoLogRecord1->length - redoLogRecord1->fieldPos);
-                pos += (redoLogRecord1->length - redoLogRecord1->fieldPos + 3) & (0xFFFC);
-                fieldPos2 = lastRedoLogRecord1->fieldPos +
-                        ((oracleEnvironment->read16(lastRedoLogRecord1->data + lastRedoLogRecord1->fieldLengthsDelta + 2) + 3) & 0xFFFC) +
-                        ((oracleEnvironment->read16(lastRedoLogRecord1->data + lastRedoLogRecord1->fieldLengthsDelta + 4) + 3) & 0xFFFC);
-
-                memcpy(buffer + pos, lastRedoLogRecord1->data + fieldPos2, lastRedoLogRecord1->length - fieldPos2);
-                pos += (lastRedoLogRecord1->length - fieldPos2 + 3) & (0xFFFC);
-
-                redoLogRecord1->length = pos;
-                redoLogRecord1->fieldCnt = newFieldCnt;
-                redoLogRecord1->fieldPos = fieldPos;
-                redoLogRecord1->data = buffer;
-
-                uint16_t myFieldLength = oracleEnvironment->read16(redoLogRecord1->data + redoLogRecord1->fieldLengthsDelta + 1 * 2);
-                fieldPos += (myFieldLength + 3) & 0xFFFC;
-                uint16_t flg = oracleEnvironment->read16(redoLogRecord1->data + fieldPos + 20);
-                flg &= ~(FLG_MULTIBLOCKUNDOHEAD | FLG_MULTIBLOCKUNDOMID | FLG_MULTIBLOCKUNDOTAIL | FLG_LASTBUFFERSPLIT);
-
-                if ((redoLogRecord1->flg & FLG_MULTIBLOCKUNDOHEAD) != 0 && (lastRedoLogRecord1->flg & FLG_MULTIBLOCKUNDOTAIL) != 0) {
-                    oracleEnvironment->write16(redoLogRecord1->data + fieldPos + 20, flg);
-
-                    OpCode0501 *opCode0501 = new OpCode0501(oracleEnvironment, redoLogRecord1);
-                    opCode0501->process();
-                    delete opCode0501;
-                } else {
-                    flg |= FLG_MULTIBLOCKUNDOTAIL;
-                    oracleEnvironment->write16(redoLogRecord1->data + fieldPos + 20, flg);
-                }
-
-                rollbackLastOp(oracleEnvironment, redoLogRecord1->scn, transactionBuffer);
+            if (transactionBuffer->getLastRecord(tcLast, opCode, lastRedoLogRecord1, lastRedoLogRecord2) && opCode == 0x05010000 &&
+                    (lastRedoLogRecord1->flg & FLG_MULTIBLOCKUNDOTAIL) != 0 && lastRedoLogRecord2->length == 0 &&
+                    lastRedoLogRecord1->fieldLengthsDelta == redoLogRecord1->fieldLengthsDelta) {
+                merge(oracleEnvironment, objn, objd, uba, dba, slt, rci, redoLogRecord1, lastRedoLogRecord1, transactionBuffer);
+                return;
             } else
                 cerr << "ERROR: next multi buffer without previous" << endl;
         }
@@ -136,16 +82,101 @@ namespace OpenLogReplicator {
         if (oracleEnvironment->trace >= TRACE_FULL)
             cerr << "add uba: " << PRINTUBA(uba) << ", dba: 0x" << hex << dba << ", slt: " << dec << (uint32_t)slt << ", rci: " << dec << (uint32_t)rci << endl;
 
-        tcLast = transactionBuffer->addTransactionChunk(tcLast, objn, objd, uba, dba, slt, rci, redoLogRecord1, redoLogRecord2);
+        if (opCodes > 0 && redoLogRecord1->scn < lastScn)
+            unsorted = true;
+        TransactionChunk *prevTcLast = tcLast;
+        tcLast = transactionBuffer->addTransactionChunk(tcLast, opIndex, objn, objd, uba, dba, slt, rci, redoLogRecord1, redoLogRecord2);
         ++opCodes;
         touch(redoLogRecord1->scn);
+
+        //big transaction is sent before commit, checked when chunk is full
+        if (prevTcLast != tcLast && oracleEnvironment->streamSize > 0 && isBegin && !isCommit) {
+            uint64_t size = 0;
+            for (TransactionChunk *tcTemp = tc; tcTemp != tcLast; tcTemp = tcTemp->next)
+                size += tcTemp->size;
+            if (size >= oracleEnvironment->streamSize)
+                oracleEnvironment->streamTransaction(this);
+        }
+    }
+
+    //merge multi-block undo piece in place with the previous piece stored as the last record
+    void Transaction::merge(OracleEnvironment *oracleEnvironment, uint32_t objn, uint32_t objd, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci,
+            RedoLogRecord *redoLogRecord1, RedoLogRecord *lastRedoLogRecord1, TransactionBuffer *transactionBuffer) {
+        uint32_t fieldLengthsDelta = redoLogRecord1->fieldLengthsDelta;
+        uint8_t *lastData = lastRedoLogRecord1->data;
+
+        if ((redoLogRecord1->flg & FLG_LASTBUFFERSPLIT) != 0) {
+            uint16_t length1 = oracleEnvironment->read16(redoLogRecord1->data + fieldLengthsDelta + redoLogRecord1->fieldCnt * 2);
+            uint16_t length2 = oracleEnvironment->read16(lastData + fieldLengthsDelta + 6);
+            oracleEnvironment->write16(lastData + fieldLengthsDelta + 6, length1 + length2);
+            --redoLogRecord1->fieldCnt;
+        }
+
+        if (redoLogRecord1->fieldCnt < 2 || lastRedoLogRecord1->fieldCnt < 2) {
+            cerr << "ERROR: multi-block undo with too few fields: " << dec << redoLogRecord1->fieldCnt << ", " << lastRedoLogRecord1->fieldCnt << endl;
+            return;
+        }
+
+        //new layout: header, field lengths, fields of current piece, fields of previous piece without ktudb & ktub
+        uint32_t lastFieldCnt = lastRedoLogRecord1->fieldCnt;
+        uint32_t lastLength = lastRedoLogRecord1->length;
+        uint32_t lastFieldPos = lastRedoLogRecord1->fieldPos +
+                ((oracleEnvironment->read16(lastData + fieldLengthsDelta + 2) + 3) & 0xFFFC) +
+                ((oracleEnvironment->read16(lastData + fieldLengthsDelta + 4) + 3) & 0xFFFC);
+        uint32_t newFieldCnt = redoLogRecord1->fieldCnt + lastFieldCnt - 2;
+        uint32_t fieldPos = fieldLengthsDelta + ((((newFieldCnt + 1) * 2) + 2) & 0xFFFC);
+        uint32_t fieldPos2 = fieldPos + ((redoLogRecord1->length - redoLogRecord1->fieldPos + 3) & 0xFFFC);
+        uint32_t length = fieldPos2 + ((lastLength - lastFieldPos + 3) & 0xFFFC);
+
+        uint8_t *element = transactionBuffer->resizeLastRecord(tcLast, length);
+        RedoLogRecord *mergedRedoLogRecord1 = (RedoLogRecord*)(element + 12);
+        uint8_t *data = element + 12 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord);
+
+        //order of moves keeps data of previous piece which is still needed
+        memmove(data + fieldPos2, data + lastFieldPos, lastLength - lastFieldPos);
+        memmove(data + fieldLengthsDelta + 2 + redoLogRecord1->fieldCnt * 2, data + fieldLengthsDelta + 6, lastFieldCnt * 2 - 4);
+        memcpy(data + fieldPos, redoLogRecord1->data + redoLogRecord1->fieldPos, redoLogRecord1->length - redoLogRecord1->fieldPos);
+        memcpy(data + fieldLengthsDelta + 2, redoLogRecord1->data + fieldLengthsDelta + 2, redoLogRecord1->fieldCnt * 2);
+        oracleEnvironment->write16(data + fieldLengthsDelta, newFieldCnt);
+        memcpy(data, redoLogRecord1->data, fieldLengthsDelta);
+
+        memcpy(mergedRedoLogRecord1, redoLogRecord1, sizeof(struct RedoLogRecord));
+        mergedRedoLogRecord1->length = length;
+        mergedRedoLogRecord1->fieldCnt = newFieldCnt;
+        mergedRedoLogRecord1->fieldPos = fieldPos;
+        mergedRedoLogRecord1->data = data;
+
+        uint16_t myFieldLength = oracleEnvironment->read16(data + fieldLengthsDelta + 1 * 2);
+        uint32_t flgPos = fieldPos + ((myFieldLength + 3) & 0xFFFC) + 20;
+        uint16_t flg = oracleEnvironment->read16(data + flgPos);
+        flg &= ~(FLG_MULTIBLOCKUNDOHEAD | FLG_MULTIBLOCKUNDOMID | FLG_MULTIBLOCKUNDOTAIL | FLG_LASTBUFFERSPLIT);
+
+        if ((redoLogRecord1->flg & FLG_MULTIBLOCKUNDOHEAD) != 0) {
+            oracleEnvironment->write16(data + flgPos, flg);
+
+            OpCode0501 *opCode0501 = new OpCode0501(oracleEnvironment, mergedRedoLogRecord1);
+            opCode0501->process();
+            delete opCode0501;
+        } else {
+            flg |= FLG_MULTIBLOCKUNDOTAIL;
+            oracleEnvironment->write16(data + flgPos, flg);
+            mergedRedoLogRecord1->flg = flg;
+        }
+
+        if (oracleEnvironment->trace >= TRACE_FULL)
+            cerr << "merge uba: " << PRINTUBA(uba) << ", dba: 0x" << hex << dba << ", slt: " << dec << (uint32_t)slt << ", rci: " << dec << (uint32_t)rci << endl;
+
+        if (lastUba != 0)
+            opIndex.erase({lastUba, lastDba, lastSlt, lastRci});
+        transactionBuffer->updateLastRecord(tcLast, opIndex, element, objn, objd, uba, dba, slt, rci, redoLogRecord1->scn);
+        touch(redoLogRecord1->scn);
     }
 
     bool Transaction::rollbackPreviousOp(OracleEnvironment *oracleEnvironment, typescn scn, TransactionBuffer *transactionBuffer, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci) {
         if (oracleEnvironment->trace >= TRACE_FULL)
             cerr << "rollback previous uba: " << PRINTUBA(uba) << ", dba: 0x" << hex << dba << ", slt: " << dec << (uint32_t)slt << ", rci: " << dec << (uint32_t)rci << endl;
 
-        if (transactionBuffer->deleteTransactionPart(tcLast, uba, dba, slt, rci)) {
+        if (transactionBuffer->deleteTransactionPart(tc, tcLast, opIndex, uba, dba, slt, rci, lastUba, lastDba, lastSlt, lastRci)) {
             --opCodes;
             if (lastScn == ZERO_SCN || lastScn < scn)
                 lastScn = scn;
@@ -154,22 +185,45 @@ namespace OpenLogReplicator {
             return false;
     }
 
+    //sent operation can't be removed, consumers get provisional event to undo it and the commit is marked partial
+    bool Transaction::rollbackSentOp(OracleEnvironment *oracleEnvironment, typescn scn, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci) {
+        auto it = sentOps.find({uba, dba, slt, rci});
+        if (it == sentOps.end())
+            return false;
+
+        if (oracleEnvironment->trace >= TRACE_FULL)
+            cerr << "rollback sent uba: " << PRINTUBA(uba) << ", dba: 0x" << hex << dba << ", slt: " << dec << (uint32_t)slt << ", rci: " << dec << (uint32_t)rci << endl;
+
+        sentOps.erase(it);
+        isPartial = true;
+        if (lastScn == ZERO_SCN || lastScn < scn)
+            lastScn = scn;
+
+        CommandBuffer *commandBuffer = oracleEnvironment->commandBuffer;
+        commandBuffer->rewind();
+        commandBuffer->setScn(scn);
+        commandBuffer->writer->rollbackSavepoint(scn, xid, uba);
+        return true;
+    }
+
     void Transaction::rollbackLastOp(OracleEnvironment *oracleEnvironment, typescn scn, TransactionBuffer *transactionBuffer) {
         if (oracleEnvironment->trace >= TRACE_FULL)
             cerr << "rollback last uba: " << PRINTUBA(lastUba) << ", dba: 0x" << hex << lastDba << ", slt: " << dec << (uint32_t)lastSlt << ", rci: " << dec << (uint32_t)lastRci << endl;
-        tcLast = transactionBuffer->rollbackTransactionChunk(tcLast, lastUba, lastDba, lastSlt, lastRci);
+        tcLast = transactionBuffer->rollbackTransactionChunk(tcLast, opIndex, lastUba, lastDba, lastSlt, lastRci);
 
         --opCodes;
         if (lastScn == ZERO_SCN || lastScn < scn)
             lastScn = scn;
     }
 
-    void Transaction::flush(OracleEnvironment *oracleEnvironment) {
-        TransactionChunk *tcTemp = tc;
-        bool hasPrev = false, opFlush = false;
+    //out of order chunks get sorted index once by reader thread, spilled chunks stay on disk
+    void Transaction::sort(TransactionBuffer *transactionBuffer) {
+        if (unsorted && order.empty())
+            transactionBuffer->sortTransactionChunks(tc, order);
+    }
 
+    void Transaction::flush(OracleEnvironment *oracleEnvironment, CommandBuffer *commandBuffer, uint8_t *&spillBuffer) {
         //transaction that has some DML's
-
         if (opCodes > 0 && !isRollback) {
             if (oracleEnvironment->trace >= TRACE_DETAIL) {
                 cerr << endl << "Transaction xid:  " << PRINTXID(xid) <<
@@ -178,192 +232,397 @@ namespace OpenLogReplicator {
                         " opCodes: " << dec << opCodes << endl;
             }
 
-            if (oracleEnvironment->commandBuffer->posEnd >= INTRA_THREAD_BUFFER_SIZE - MAX_TRANSACTION_SIZE)
-                oracleEnvironment->commandBuffer->rewind();
-
-            oracleEnvironment->commandBuffer->writer->beginTran(lastScn, xid);
-
-            while (tcTemp != nullptr) {
-                uint32_t pos = 0, type = 0;
-                RedoLogRecord *first1 = nullptr, *first2 = nullptr, *last1 = nullptr, *last2 = nullptr;
-                typescn prevScn = 0;
-
-
-                for (uint32_t i = 0; i < tcTemp->elements; ++i) {
-                    uint32_t op = *((uint32_t*)(tcTemp->buffer + pos + 8));
-
-                    RedoLogRecord *redoLogRecord1 = ((RedoLogRecord *)(tcTemp->buffer + pos + 12)),
-                                  *redoLogRecord2 = ((RedoLogRecord *)(tcTemp->buffer + pos + 12 + sizeof(struct RedoLogRecord)));
-                    typescn scn = *((typescn *)(tcTemp->buffer + pos + 32 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord) +
-                            redoLogRecord1->length + redoLogRecord2->length));
-                    redoLogRecord1->data = tcTemp->buffer + pos + 12 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord);
-                    redoLogRecord2->data = tcTemp->buffer + pos + 12 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord) + redoLogRecord1->length;
-
-                    if (oracleEnvironment->trace >= TRACE_WARN) {
-                        if (oracleEnvironment->trace >= TRACE_DETAIL) {
-                            uint32_t objn = *((uint32_t*)(tcTemp->buffer + pos));
-                            uint32_t objd = *((uint32_t*)(tcTemp->buffer + pos + 4));
-                            cerr << "Row: " << setfill(' ') << setw(4) << dec << redoLogRecord1->length <<
-                                        ":" << setfill(' ') << setw(4) << dec << redoLogRecord2->length <<\
-                                    " fb: " << setfill('0') << setw(2) << hex << (uint32_t)redoLogRecord1->fb <<
-                                        ":" << setfill('0') << setw(2) << hex << (uint32_t)redoLogRecord2->fb << " " <<
-                                    " op: " << setfill('0') << setw(8) << hex << op <<
-                                    " objn: " << dec << objn <<
-                                    " objd: " << dec << objd <<
-                                    " flg1: 0x" << setfill('0') << setw(4) << hex << redoLogRecord1->flg <<
-                                    " flg2: 0x" << setfill('0') << setw(4) << hex << redoLogRecord2->flg <<
-                                    " uba1: " << PRINTUBA(redoLogRecord1->uba) <<
-                                    " uba2: " << PRINTUBA(redoLogRecord2->uba) <<
-                                    " bdba1: 0x" << setfill('0') << setw(8) << hex << redoLogRecord1->bdba << "." << hex << (uint32_t)redoLogRecord1->slot <<
-                                    " nrid1: 0x" << setfill('0') << setw(8) << hex << redoLogRecord1->nridBdba << "." << hex << redoLogRecord1->nridSlot <<
-                                    " bdba2: 0x" << setfill('0') << setw(8) << hex << redoLogRecord2->bdba << "." << hex << (uint32_t)redoLogRecord2->slot <<
-                                    " nrid2: 0x" << setfill('0') << setw(8) << hex << redoLogRecord2->nridBdba << "." << hex << redoLogRecord2->nridSlot <<
-                                    " supp: (0x" << setfill('0') << setw(2) << hex << (uint32_t)redoLogRecord1->suppLogFb <<
-                                        ", " << setfill(' ') << setw(3) << dec << redoLogRecord1->suppLogCC <<
-                                        ", " << setfill(' ') << setw(3) << dec << redoLogRecord1->suppLogBefore <<
-                                        ", " << setfill(' ') << setw(3) << dec << redoLogRecord1->suppLogAfter <<
-                                        ", 0x" << setfill('0') << setw(8) << hex << redoLogRecord1->suppLogBdba << "." << hex << redoLogRecord1->suppLogSlot << ") " <<
-                                    " scn: " << PRINTSCN64(scn) << endl;
-                        }
-                        if (prevScn != 0 && prevScn > scn)
-                            cerr << "ERROR: SCN swap" << endl;
+            TransactionChunk *tcPending;
+            uint32_t posPending;
+            flushChunks(oracleEnvironment, commandBuffer, spillBuffer, nullptr, tcPending, posPending);
+        }
+
+        //terminal event for transaction streamed before commit
+        if (isStreamed) {
+            commandBuffer->rewind();
+            commandBuffer->writer->endTran(lastScn, xid, isRollback, isPartial);
+        }
+    }
+
+    //records of a row which is not complete yet have to outlive the spill buffer, it is reused for the next chunk
+    void Transaction::keepChain(RedoLogRecord *&first1, RedoLogRecord *&first2, RedoLogRecord *&last1, RedoLogRecord *&last2,
+            uint8_t *spillBuffer, vector<uint8_t*> &kept) {
+        RedoLogRecord *prev1 = nullptr, *prev2 = nullptr;
+        RedoLogRecord *redoLogRecord1 = first1, *redoLogRecord2 = first2;
+
+        while (redoLogRecord1 != nullptr) {
+            RedoLogRecord *next1 = redoLogRecord1->next, *next2 = redoLogRecord2->next;
+            uint8_t *element = ((uint8_t*)redoLogRecord1) - 12;
+
+            if (element >= spillBuffer && element < spillBuffer + TRANSACTION_BUFFER_CHUNK_SIZE) {
+                uint32_t elementSize = redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
+                uint8_t *keptElement = new uint8_t[elementSize];
+                memcpy(keptElement, element, elementSize);
+                kept.push_back(keptElement);
+
+                redoLogRecord1 = (RedoLogRecord*)(keptElement + 12);
+                redoLogRecord2 = (RedoLogRecord*)(keptElement + 12 + sizeof(struct RedoLogRecord));
+                redoLogRecord1->data = keptElement + 12 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord);
+                redoLogRecord2->data = redoLogRecord1->data + redoLogRecord1->length;
+            }
+
+            redoLogRecord1->prev = prev1;
+            redoLogRecord2->prev = prev2;
+            if (prev1 == nullptr) {
+                first1 = redoLogRecord1;
+                first2 = redoLogRecord2;
+            } else {
+                prev1->next = redoLogRecord1;
+                prev2->next = redoLogRecord2;
+            }
+            prev1 = redoLogRecord1;
+            prev2 = redoLogRecord2;
+            redoLogRecord1 = next1;
+            redoLogRecord2 = next2;
+        }
+
+        last1 = prev1;
+        last2 = prev2;
+    }
+
+    //format operations of chunks up to tcEnd, returns number of operations
+    //row which is not complete at tcEnd is not sent, tcPending & posPending point to its first piece
+    uint32_t Transaction::flushChunks(OracleEnvironment *oracleEnvironment, CommandBuffer *commandBuffer, uint8_t *&spillBuffer,
+            TransactionChunk *tcEnd, TransactionChunk *&tcPending, uint32_t &posPending) {
+        TransactionChunk *tcTemp = tc;
+        bool hasPrev = false, opFlush = false;
+        bool sorted = (unsorted && tcEnd == nullptr);
+        bool provisional = (isStreamed || tcEnd != nullptr);
+        uint32_t ops = 0, opsPending = 0, type = 0;
+        //pieces of one row may be stored in more than one chunk
+        RedoLogRecord *first1 = nullptr, *first2 = nullptr, *last1 = nullptr, *last2 = nullptr;
+        vector<uint8_t*> kept;
+        typescn prevScn = 0;
+        //chunks are already sorted or have sorted index, k-way merge of them keeps memory usage low
+        priority_queue<TransactionChunkRun, vector<TransactionChunkRun>, TransactionChunkRunCompare> runs;
+        TransactionBuffer *transactionBuffer = &oracleEnvironment->transactionBuffer;
+
+        if (sorted) {
+            uint32_t seq = 0, orderPos = 0;
+            for (TransactionChunk *tcRun = tc; tcRun != nullptr; tcRun = tcRun->next) {
+                if (tcRun->elements == 0)
+                    continue;
+
+                TransactionChunkRun run;
+                run.seq = seq++;
+                run.tc = tcRun;
+                run.element = 0;
+                run.orderPos = orderPos;
+                if (tcRun->unsorted) {
+                    run.pos = order[orderPos].chunkPos.pos;
+                    orderPos += tcRun->elements;
+                } else
+                    run.pos = 0;
+                run.scn = transactionBuffer->readElementScn(tcRun, run.pos, run.elementSize);
+                runs.push(run);
+            }
+        }
+
+        tcPending = tcEnd;
+        posPending = 0;
+        commandBuffer->rewind();
+        commandBuffer->writer->begin(lastScn, xid, provisional);
+
+        while (tcTemp != tcEnd) {
+            uint8_t *buffer = sorted ? nullptr : transactionBuffer->readTransactionChunk(tcTemp, spillBuffer);
+            uint32_t pos = 0;
+            uint32_t elements = sorted ? 0 : tcTemp->elements;
+
+            for (uint32_t i = 0; sorted ? !runs.empty() : i < elements; ++i) {
+                if (sorted) {
+                    TransactionChunkRun run = runs.top();
+                    runs.pop();
+
+                    //operation of spilled chunk is read alone
+                    if (run.tc->buffer != nullptr) {
+                        buffer = run.tc->buffer;
+                        pos = run.pos;
+                    } else {
+                        buffer = new uint8_t[run.elementSize];
+                        transactionBuffer->readTransactionChunkPart(run.tc, run.pos, buffer, run.elementSize);
+                        kept.push_back(buffer);
+                        pos = 0;
                     }
-                    pos += redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
-
-                    opFlush = false;
-                    switch (op) {
-                    //insert row piece
-                    case 0x05010B02:
-                    //delete row piece
-                    case 0x05010B03:
-                    //update row piece
-                    case 0x05010B05:
-                    //overwrite row piece
-                    case 0x05010B06:
-
-                        redoLogRecord2->suppLogAfter = redoLogRecord1->suppLogAfter;
-                        if (type == 0) {
-                            if ((redoLogRecord1->suppLogFb & FB_F) != 0 && op == 0x05010B02 &&
-                                    ((redoLogRecord1->suppLogBdba == redoLogRecord2->bdba && redoLogRecord1->suppLogSlot == redoLogRecord2->slot) || redoLogRecord1->suppLogBdba == 0))
-                                type = TRANSACTION_INSERT;
-                            else if ((redoLogRecord1->suppLogFb & FB_F) != 0 && op == 0x05010B03)
-                                type = TRANSACTION_DELETE;
-                            else
-                                type = TRANSACTION_UPDATE;
-                        }
 
-                        if (first1 == nullptr) {
-                            first1 = redoLogRecord1;
-                            first2 = redoLogRecord2;
-                            last1 = redoLogRecord1;
-                            last2 = redoLogRecord2;
-                        } else {
-                            if (last1->suppLogBdba == redoLogRecord1->suppLogBdba && last1->suppLogSlot == redoLogRecord1->suppLogSlot) {
-                                if (type == TRANSACTION_INSERT) {
-                                    redoLogRecord1->next = first1;
-                                    redoLogRecord2->next = first2;
-                                    first1->prev = redoLogRecord1;
-                                    first2->prev = redoLogRecord2;
-                                    first1 = redoLogRecord1;
-                                    first2 = redoLogRecord2;
-                                } else {
-                                    if (op == 0x05010B06 && last2->opCode == 0x0B02) {
-                                        if (last1->prev == nullptr) {
-                                            first1 = redoLogRecord1;
-                                            first2 = redoLogRecord2;
-                                            first1->next = last1;
-                                            first2->next = last2;
-                                            last1->prev = first1;
-                                            last2->prev = first2;
-                                        } else {
-                                            redoLogRecord1->prev = last1->prev;
-                                            redoLogRecord2->prev = last2->prev;
-                                            redoLogRecord1->next = last1;
-                                            redoLogRecord2->next = last2;
-                                            last1->prev->next = redoLogRecord1;
-                                            last2->prev->next = redoLogRecord2;
-                                            last1->prev = redoLogRecord1;
-                                            last2->prev = redoLogRecord2;
-                                        }
+                    if (++run.element < run.tc->elements) {
+                        if (run.tc->unsorted)
+                            run.pos = order[run.orderPos + run.element].chunkPos.pos;
+                        else
+                            run.pos += run.elementSize;
+                        run.scn = transactionBuffer->readElementScn(run.tc, run.pos, run.elementSize);
+                        runs.push(run);
+                    }
+                }
+                uint32_t elementPos = pos;
+                uint32_t op = *((uint32_t*)(buffer + pos + 8));
+                if (op != 0)
+                    ++ops;
+
+                RedoLogRecord *redoLogRecord1 = ((RedoLogRecord *)(buffer + pos + 12)),
+                              *redoLogRecord2 = ((RedoLogRecord *)(buffer + pos + 12 + sizeof(struct RedoLogRecord)));
+                typescn scn = *((typescn *)(buffer + pos + 32 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord) +
+                        redoLogRecord1->length + redoLogRecord2->length));
+                redoLogRecord1->data = buffer + pos + 12 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord);
+                redoLogRecord2->data = buffer + pos + 12 + sizeof(struct RedoLogRecord) + sizeof(struct RedoLogRecord) + redoLogRecord1->length;
+
+                if (oracleEnvironment->trace >= TRACE_WARN) {
+                    if (oracleEnvironment->trace >= TRACE_DETAIL) {
+                        uint32_t objn = *((uint32_t*)(buffer + pos));
+                        uint32_t objd = *((uint32_t*)(buffer + pos + 4));
+                        cerr << "Row: " << setfill(' ') << setw(4) << dec << redoLogRecord1->length <<
+                                    ":" << setfill(' ') << setw(4) << dec << redoLogRecord2->length <<\
+                                " fb: " << setfill('0') << setw(2) << hex << (uint32_t)redoLogRecord1->fb <<
+                                    ":" << setfill('0') << setw(2) << hex << (uint32_t)redoLogRecord2->fb << " " <<
+                                " op: " << setfill('0') << setw(8) << hex << op <<
+                                " objn: " << dec << objn <<
+                                " objd: " << dec << objd <<
+                                " flg1: 0x" << setfill('0') << setw(4) << hex << redoLogRecord1->flg <<
+                                " flg2: 0x" << setfill('0') << setw(4) << hex << redoLogRecord2->flg <<
+                                " uba1: " << PRINTUBA(redoLogRecord1->uba) <<
+                                " uba2: " << PRINTUBA(redoLogRecord2->uba) <<
+                                " bdba1: 0x" << setfill('0') << setw(8) << hex << redoLogRecord1->bdba << "." << hex << (uint32_t)redoLogRecord1->slot <<
+                                " nrid1: 0x" << setfill('0') << setw(8) << hex << redoLogRecord1->nridBdba << "." << hex << redoLogRecord1->nridSlot <<
+                                " bdba2: 0x" << setfill('0') << setw(8) << hex << redoLogRecord2->bdba << "." << hex << (uint32_t)redoLogRecord2->slot <<
+                                " nrid2: 0x" << setfill('0') << setw(8) << hex << redoLogRecord2->nridBdba << "." << hex << redoLogRecord2->nridSlot <<
+                                " supp: (0x" << setfill('0') << setw(2) << hex << (uint32_t)redoLogRecord1->suppLogFb <<
+                                    ", " << setfill(' ') << setw(3) << dec << redoLogRecord1->suppLogCC <<
+                                    ", " << setfill(' ') << setw(3) << dec << redoLogRecord1->suppLogBefore <<
+                                    ", " << setfill(' ') << setw(3) << dec << redoLogRecord1->suppLogAfter <<
+                                    ", 0x" << setfill('0') << setw(8) << hex << redoLogRecord1->suppLogBdba << "." << hex << redoLogRecord1->suppLogSlot << ") " <<
+                                " scn: " << PRINTSCN64(scn) << endl;
+                    }
+                    if (prevScn != 0 && prevScn > scn)
+                        cerr << "ERROR: SCN swap" << endl;
+                }
+                pos += redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
+
+                opFlush = false;
+                switch (op) {
+                //insert row piece
+                case 0x05010B02:
+                //delete row piece
+                case 0x05010B03:
+                //update row piece
+                case 0x05010B05:
+                //overwrite row piece
+                case 0x05010B06:
+
+                    redoLogRecord2->suppLogAfter = redoLogRecord1->suppLogAfter;
+                    //links left from previous flush of a streamed transaction
+                    redoLogRecord1->prev = nullptr;
+                    redoLogRecord1->next = nullptr;
+                    redoLogRecord2->prev = nullptr;
+                    redoLogRecord2->next = nullptr;
+                    if (type == 0) {
+                        if ((redoLogRecord1->suppLogFb & FB_F) != 0 && op == 0x05010B02 &&
+                                ((redoLogRecord1->suppLogBdba == redoLogRecord2->bdba && redoLogRecord1->suppLogSlot == redoLogRecord2->slot) || redoLogRecord1->suppLogBdba == 0))
+                            type = TRANSACTION_INSERT;
+                        else if ((redoLogRecord1->suppLogFb & FB_F) != 0 && op == 0x05010B03)
+                            type = TRANSACTION_DELETE;
+                        else
+                            type = TRANSACTION_UPDATE;
+                    }
+
+                    if (first1 == nullptr) {
+                        tcPending = tcTemp;
+                        posPending = elementPos;
+                        opsPending = ops - 1;
+                        first1 = redoLogRecord1;
+                        first2 = redoLogRecord2;
+                        last1 = redoLogRecord1;
+                        last2 = redoLogRecord2;
+                    } else {
+                        if (last1->suppLogBdba == redoLogRecord1->suppLogBdba && last1->suppLogSlot == redoLogRecord1->suppLogSlot) {
+                            if (type == TRANSACTION_INSERT) {
+                                redoLogRecord1->next = first1;
+                                redoLogRecord2->next = first2;
+                                first1->prev = redoLogRecord1;
+                                first2->prev = redoLogRecord2;
+                                first1 = redoLogRecord1;
+                                first2 = redoLogRecord2;
+                            } else {
+                                if (op == 0x05010B06 && last2->opCode == 0x0B02) {
+                                    if (last1->prev == nullptr) {
+                                        first1 = redoLogRecord1;
+                                        first2 = redoLogRecord2;
+                                        first1->next = last1;
+                                        first2->next = last2;
+                                        last1->prev = first1;
+                                        last2->prev = first2;
                                     } else {
-                                        last1->next = redoLogRecord1;
-                                        last2->next = redoLogRecord2;
-                                        redoLogRecord1->prev = last1;
-                                        redoLogRecord2->prev = last2;
-                                        last1 = redoLogRecord1;
-                                        last2 = redoLogRecord2;
+                                        redoLogRecord1->prev = last1->prev;
+                                        redoLogRecord2->prev = last2->prev;
+                                        redoLogRecord1->next = last1;
+                                        redoLogRecord2->next = last2;
+                                        last1->prev->next = redoLogRecord1;
+                                        last2->prev->next = redoLogRecord2;
+                                        last1->prev = redoLogRecord1;
+                                        last2->prev = redoLogRecord2;
                                     }
+                                } else {
+                                    last1->next = redoLogRecord1;
+                                    last2->next = redoLogRecord2;
+                                    redoLogRecord1->prev = last1;
+                                    redoLogRecord2->prev = last2;
+                                    last1 = redoLogRecord1;
+                                    last2 = redoLogRecord2;
                                 }
-                            } else {
-                                if (oracleEnvironment->trace >= TRACE_WARN)
-                                    cerr << "ERROR: next BDBA/SLOT does not match" << endl;
                             }
+                        } else {
+                            if (oracleEnvironment->trace >= TRACE_WARN)
+                                cerr << "ERROR: next BDBA/SLOT does not match" << endl;
                         }
+                    }
 
-                    //change row forwading address
-                    case 0x05010B08:
-                        if ((redoLogRecord1->suppLogFb & FB_L) != 0) {
-                            if (hasPrev)
-                                oracleEnvironment->commandBuffer->writer->next();
-                            oracleEnvironment->commandBuffer->writer->parseDML(first1, first2, type, oracleEnvironment);
-                            opFlush = true;
-                        }
-                        break;
-
-                    //insert multiple rows
-                    case 0x05010B0B:
-                        if (hasPrev)
-                            oracleEnvironment->commandBuffer->writer->next();
-                        oracleEnvironment->commandBuffer->writer->parseInsertMultiple(redoLogRecord1, redoLogRecord2, oracleEnvironment);
-                        opFlush = true;
-                        break;
-
-                    //delete multiple rows
-                    case 0x05010B0C:
-                        if (hasPrev)
-                            oracleEnvironment->commandBuffer->writer->next();
-                        oracleEnvironment->commandBuffer->writer->parseDeleteMultiple(redoLogRecord1, redoLogRecord2, oracleEnvironment);
-                        opFlush = true;
-                        break;
-
-                    //truncate table
-                    case 0x18010000:
-                        if (hasPrev)
-                            oracleEnvironment->commandBuffer->writer->next();
-                        oracleEnvironment->commandBuffer->writer->parseDDL(redoLogRecord1, oracleEnvironment);
+                //change row forwading address
+                case 0x05010B08:
+                    if ((redoLogRecord1->suppLogFb & FB_L) != 0) {
+                        commandBuffer->writer->beginOp(first1->object, hasPrev);
+                        commandBuffer->writer->parseDML(first1, first2, type, oracleEnvironment);
                         opFlush = true;
-                        break;
-
-                    default:
-                        cerr << "ERROR: Unknown OpCode " << hex << op << endl;
                     }
+                    break;
+
+                //insert multiple rows
+                case 0x05010B0B:
+                    commandBuffer->writer->beginOp(redoLogRecord1->object, hasPrev);
+                    commandBuffer->writer->parseInsertMultiple(redoLogRecord1, redoLogRecord2, oracleEnvironment);
+                    opFlush = true;
+                    break;
+
+                //delete multiple rows
+                case 0x05010B0C:
+                    commandBuffer->writer->beginOp(redoLogRecord1->object, hasPrev);
+                    commandBuffer->writer->parseDeleteMultiple(redoLogRecord1, redoLogRecord2, oracleEnvironment);
+                    opFlush = true;
+                    break;
+
+                //truncate table
+                case 0x18010000:
+                    commandBuffer->writer->beginOp(redoLogRecord1->object, hasPrev);
+                    commandBuffer->writer->parseDDL(redoLogRecord1, oracleEnvironment);
+                    opFlush = true;
+                    break;
+
+                //operation rolled back to savepoint
+                case 0x00000000:
+                    break;
+
+                default:
+                    cerr << "ERROR: Unknown OpCode " << hex << op << endl;
+                }
 
-                    //split very big transactions
-                    if (oracleEnvironment->commandBuffer->currentTranSize() >= MAX_TRANSACTION_SIZE) {
-                        cerr << "WARNING: Big transaction divided (" << oracleEnvironment->commandBuffer->currentTranSize() << ")" << endl;
-                        oracleEnvironment->commandBuffer->writer->commitTran();
-                        if (oracleEnvironment->commandBuffer->posEnd >= INTRA_THREAD_BUFFER_SIZE - MAX_TRANSACTION_SIZE)
-                            oracleEnvironment->commandBuffer->rewind();
-                        oracleEnvironment->commandBuffer->writer->beginTran(lastScn, xid);
-                    }
+                if (opFlush) {
+                    first1 = nullptr;
+                    last1 = nullptr;
+                    first2 = nullptr;
+                    last2 = nullptr;
+                    hasPrev = true;
+                    type = 0;
+                    for (uint8_t *element : kept)
+                        delete[] element;
+                    kept.clear();
+                }
 
-                    if (opFlush) {
-                        first1 = nullptr;
-                        last1 = nullptr;
-                        first2 = nullptr;
-                        last2 = nullptr;
-                        hasPrev = true;
-                        type = 0;
-                    }
-                    prevScn = scn;
+                //split very big transactions
+                if (commandBuffer->currentTranSize() >= MAX_TRANSACTION_SIZE) {
+                    cerr << "WARNING: Big transaction divided (" << commandBuffer->currentTranSize() << ")" << endl;
+                    commandBuffer->writer->split();
+                    hasPrev = false;
                 }
-                tcTemp = tcTemp->next;
+                prevScn = scn;
             }
 
-            oracleEnvironment->commandBuffer->writer->commitTran();
+            if (first1 != nullptr && buffer == spillBuffer)
+                keepChain(first1, first2, last1, last2, spillBuffer, kept);
+            tcTemp = sorted ? tcEnd : tcTemp->next;
+        }
+
+        //row continues after tcEnd, it is sent with the rest of the transaction
+        if (first1 != nullptr && tcEnd != nullptr)
+            ops = opsPending;
+        else {
+            tcPending = tcEnd;
+            posPending = 0;
+        }
+        for (uint8_t *element : kept)
+            delete[] element;
+
+        commandBuffer->writer->end();
+        return ops;
+    }
+
+    //emit all chunks but the last one before commit and return them to the pool
+    void Transaction::stream(OracleEnvironment *oracleEnvironment, TransactionBuffer *transactionBuffer) {
+        if (tc == tcLast)
+            return;
+
+        if (oracleEnvironment->trace >= TRACE_INFO)
+            cerr << "INFO: streaming transaction xid: " << PRINTXID(xid) << ", operations: " << dec << opCodes << endl;
+
+        TransactionChunk *tcPending;
+        uint32_t posPending;
+        isStreamed = true;
+        opCodes -= flushChunks(oracleEnvironment, oracleEnvironment->commandBuffer, transactionBuffer->spillBuffer, tcLast,
+                tcPending, posPending);
+
+        //operations already sent are remembered only by key, rollback to savepoint of them is sent as event
+        for (auto it = opIndex.begin(); it != opIndex.end(); ) {
+            bool sent = (it->second.tc != tcPending || it->second.pos < posPending);
+            for (TransactionChunk *tcTemp = tcPending->next; sent && tcTemp != nullptr; tcTemp = tcTemp->next)
+                if (it->second.tc == tcTemp)
+                    sent = false;
+
+            if (sent) {
+                sentOps.insert(it->first);
+                it = opIndex.erase(it);
+            } else
+                ++it;
+        }
+
+        //chunk with first piece of incomplete row is kept, operations sent from it are skipped later
+        transactionBuffer->discardTransactionChunkPart(tcPending, posPending);
+        if (tcPending != tc) {
+            tcPending->prev->next = nullptr;
+            transactionBuffer->deleteTransactionChunks(tc, tcPending->prev);
+            tcPending->prev = nullptr;
+            tc = tcPending;
+        }
+    }
+
+    uint64_t Transaction::memorySize() {
+        uint64_t size = 0;
+        for (TransactionChunk *tcTemp = tc; tcTemp != tcLast; tcTemp = tcTemp->next)
+            if (tcTemp->buffer != nullptr)
+                size += tcTemp->capacity;
+        return size;
+    }
+
+    void Transaction::spill(TransactionBuffer *transactionBuffer) {
+        //last chunk is always kept in memory
+        for (TransactionChunk *tcTemp = tc; tcTemp != tcLast; tcTemp = tcTemp->next)
+            transactionBuffer->spillTransactionChunk(tcTemp, spillFd, spillSize);
+    }
+
+    void Transaction::free(TransactionBuffer *transactionBuffer) {
+        if (tc != nullptr) {
+            transactionBuffer->deleteTransactionChunks(tc, tcLast);
+            tc = nullptr;
+            tcLast = nullptr;
         }
+        opIndex.clear();
+        sentOps.clear();
+        order.clear();
 
-        oracleEnvironment->transactionBuffer.deleteTransactionChunks(tc, tcLast);
+        if (spillFd != -1) {
+            close(spillFd);
+            spillFd = -1;
+        }
     }
 
     Transaction::Transaction(typexid xid, TransactionBuffer *transactionBuffer) :
@@ -379,18 +638,23 @@ namespace OpenLogReplicator {
             isBegin(false),
             isCommit(false),
             isRollback(false),
-            next(nullptr) {
-        tc = transactionBuffer->newTransactionChunk();
+            unsorted(false),
+            spillFd(-1),
+            spillSize(0),
+            ticket(0),
+            isStreamed(false),
+            isPartial(false) {
+        tc = transactionBuffer->newTransactionChunk(0);
         tcLast = tc;
     }
 
     Transaction::~Transaction() {
+        if (spillFd != -1) {
+            close(spillFd);
+            spillFd = -1;
+        }
     }
 
-    //void Transaction::free(TransactionBuffer *transactionBuffer) {
-    //    transactionBuffer->deleteTransactionChunks(tc, tcLast);
-    //}
-
 
     ostream& operator<<(ostream& os, const Transaction& tran) {
         os << "xid: " << PRINTXID(tran.xid) <<
@@ -17,15 +17,17 @@ You should have received a copy of the GNU General Public License
 along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <unordered_set>
 #include "types.h"
+#include "TransactionChunk.h"
 
 #ifndef TRANSACTION_H_
 #define TRANSACTION_H_
 
 namespace OpenLogReplicator {
 
-    class TransactionChunk;
     class TransactionBuffer;
+    class CommandBuffer;
     class OpCode;
     class OpCode0502;
     class OpCode0504;
@@ -39,6 +41,7 @@ namespace OpenLogReplicator {
         typescn lastScn;
         TransactionChunk *tc;
         TransactionChunk *tcLast;
+        TransactionChunkIndex opIndex;
         uint32_t opCodes;
         uint32_t pos;
         typeuba lastUba;
@@ -48,17 +51,34 @@ namespace OpenLogReplicator {
         bool isBegin;
         bool isCommit;
         bool isRollback;
-        Transaction *next;
+        bool unsorted;
+        int spillFd;
+        uint64_t spillSize;
+        uint64_t ticket;            //order of publication by serializer threads
+        vector<TransactionChunkScn> order;
+        bool isStreamed;            //operations sent before commit as provisional
+        bool isPartial;             //operations sent before commit were rolled back to savepoint
+        unordered_set<TransactionChunkKey, TransactionChunkKeyHash> sentOps;
 
-        bool operator< (Transaction &p);
         void touch(typescn scn);
         void add(OracleEnvironment *oracleEnvironment, uint32_t objn, uint32_t objd, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci,
                 RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, TransactionBuffer *transactionBuffer);
+        void merge(OracleEnvironment *oracleEnvironment, uint32_t objn, uint32_t objd, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci,
+                RedoLogRecord *redoLogRecord1, RedoLogRecord *lastRedoLogRecord1, TransactionBuffer *transactionBuffer);
         void rollbackLastOp(OracleEnvironment *oracleEnvironment, typescn scn, TransactionBuffer *transactionBuffer);
         bool rollbackPreviousOp(OracleEnvironment *oracleEnvironment, typescn scn, TransactionBuffer *transactionBuffer, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci);
+        bool rollbackSentOp(OracleEnvironment *oracleEnvironment, typescn scn, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci);
 
-        void flush(OracleEnvironment *oracleEnvironment);
-        //void free(TransactionBuffer *transactionBuffer);
+        void sort(TransactionBuffer *transactionBuffer);
+        void flush(OracleEnvironment *oracleEnvironment, CommandBuffer *commandBuffer, uint8_t *&spillBuffer);
+        uint32_t flushChunks(OracleEnvironment *oracleEnvironment, CommandBuffer *commandBuffer, uint8_t *&spillBuffer, TransactionChunk *tcEnd,
+                TransactionChunk *&tcPending, uint32_t &posPending);
+        void keepChain(RedoLogRecord *&first1, RedoLogRecord *&first2, RedoLogRecord *&last1, RedoLogRecord *&last2, uint8_t *spillBuffer,
+                vector<uint8_t*> &kept);
+        void stream(OracleEnvironment *oracleEnvironment, TransactionBuffer *transactionBuffer);
+        uint64_t memorySize();
+        void spill(TransactionBuffer *transactionBuffer);
+        void free(TransactionBuffer *transactionBuffer);
 
         Transaction(typexid xid, TransactionBuffer *transactionBuffer);
         virtual ~Transaction();
@@ -19,11 +19,15 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <cstdlib>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "OracleEnvironment.h"
 #include "TransactionBuffer.h"
 #include "MemoryException.h"
 #include "TransactionChunk.h"
@@ -33,52 +37,226 @@ using namespace std;
 
 namespace OpenLogReplicator {
 
-    TransactionBuffer::TransactionBuffer() :
-        size(1) {
-        TransactionChunk *tc, *prevTc;
-        buffer = (uint8_t*) malloc(TRANSACTION_BUFFER_CHUNK_SIZE * TRANSACTION_BUFFER_CHUNK_NUM);
+    atomic<uint64_t> TransactionBuffer::globalMemory(0);
+    atomic<uint64_t> TransactionBuffer::globalMemoryPeak(0);
+    uint64_t TransactionBuffer::globalMemoryMax = 0;
+
+    //size classes of chunks, transactions start with the smallest one
+    const uint32_t TransactionBuffer::chunkSizes[TRANSACTION_BUFFER_CLASSES] = {4096, 32768, TRANSACTION_BUFFER_CHUNK_SIZE};
+
+    TransactionBuffer::TransactionBuffer(uint32_t maxMemory, uint32_t spillMemory, const string &spillDir, uint32_t trace) :
+        allocatedMemory(0),
+        peakMemory(0),
+        usedMemory(0),
+        trace(trace),
+        spillDir(spillDir),
+        lowMemory(false),
+        spillBuffer(nullptr) {
+
+        for (uint32_t i = 0; i < TRANSACTION_BUFFER_CLASSES; ++i)
+            unused[i] = nullptr;
+
+        //maxMemory & spillMemory in MB, 0 - default
+        if (maxMemory == 0)
+            maxMemory = TRANSACTION_BUFFER_MEMORY_DEFAULT;
+        this->maxMemory = (uint64_t)maxMemory * 1024 * 1024;
+        if (this->maxMemory < TRANSACTION_BUFFER_EXTENT_SIZE * TRANSACTION_BUFFER_CLASSES)
+            this->maxMemory = TRANSACTION_BUFFER_EXTENT_SIZE * TRANSACTION_BUFFER_CLASSES;
+
+        if (spillMemory == 0)
+            spillHighWater = this->maxMemory - this->maxMemory / 8;
+        else
+            spillHighWater = (uint64_t)spillMemory * 1024 * 1024;
+        spillLowWater = spillHighWater - spillHighWater / 4;
+    }
 
-        prevTc = new TransactionChunk(nullptr, buffer);
-        unused = prevTc;
+    bool TransactionBuffer::canGrow() {
+        if (allocatedMemory + TRANSACTION_BUFFER_EXTENT_SIZE > maxMemory)
+            return false;
+        if (globalMemoryMax > 0 && globalMemory + TRANSACTION_BUFFER_EXTENT_SIZE > globalMemoryMax)
+            return false;
+        return true;
+    }
 
-        for (uint32_t a = 1; a < TRANSACTION_BUFFER_CHUNK_NUM; ++a) {
-            tc = new TransactionChunk(prevTc, buffer + TRANSACTION_BUFFER_CHUNK_SIZE * a);
-            prevTc = tc;
-            ++size;
+    void TransactionBuffer::grow(uint32_t sizeClass) {
+        //idle extents of other size classes can be reused
+        if (!canGrow())
+            releaseExtents(false);
+        if (allocatedMemory + TRANSACTION_BUFFER_EXTENT_SIZE > maxMemory)
+            throw MemoryException("out of memory: transaction buffer memory limit reached");
+
+        uint64_t memory = globalMemory.fetch_add(TRANSACTION_BUFFER_EXTENT_SIZE) + TRANSACTION_BUFFER_EXTENT_SIZE;
+        if (globalMemoryMax > 0 && memory > globalMemoryMax) {
+            globalMemory -= TRANSACTION_BUFFER_EXTENT_SIZE;
+            throw MemoryException("out of memory: global transaction buffer memory limit reached");
+        }
+        uint64_t peak = globalMemoryPeak;
+        while (memory > peak && !globalMemoryPeak.compare_exchange_weak(peak, memory))
+            ;
+
+        uint8_t *buffer = (uint8_t*) mmap(nullptr, TRANSACTION_BUFFER_EXTENT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            globalMemory -= TRANSACTION_BUFFER_EXTENT_SIZE;
+            throw MemoryException("out of memory: can't map transaction buffer extent");
+        }
+
+        TransactionBufferExtent *extent = new TransactionBufferExtent();
+        extent->buffer = buffer;
+        extent->sizeClass = sizeClass;
+        extent->usedChunks = 0;
+        extent->released = false;
+        extent->unmap = false;
+        extents.push_back(extent);
+
+        uint32_t chunkSize = chunkSizes[sizeClass];
+        for (uint32_t a = 0; a < TRANSACTION_BUFFER_EXTENT_SIZE / chunkSize; ++a) {
+            TransactionChunk *tc = new TransactionChunk(nullptr, buffer + chunkSize * a, sizeClass, chunkSize);
+            tc->extent = extent;
+            tc->next = unused[sizeClass];
+            if (unused[sizeClass] != nullptr)
+                unused[sizeClass]->prev = tc;
+            unused[sizeClass] = tc;
+        }
+        allocatedMemory += TRANSACTION_BUFFER_EXTENT_SIZE;
+
+        if (allocatedMemory > peakMemory) {
+            peakMemory = allocatedMemory;
+            if (trace >= TRACE_INFO)
+                cerr << "INFO: transaction buffer: " << dec << (getMemory() / 1024 / 1024) << "MB, peak: " <<
+                        (getMemoryPeak() / 1024 / 1024) << "MB, global: " << (getGlobalMemory() / 1024 / 1024) << "MB, global peak: " <<
+                        (getGlobalMemoryPeak() / 1024 / 1024) << "MB" << endl;
         }
     }
 
-    TransactionChunk *TransactionBuffer::newTransactionChunk() {
-        if (unused == nullptr)
-            throw MemoryException("out of memory: out of transaction buffer size");
+    //memory is released when usage stayed low for some time, extents are kept over short gaps between peaks
+    void TransactionBuffer::shrink() {
+        if (usedMemory >= allocatedMemory / 2) {
+            lowMemory = false;
+            return;
+        }
 
-        TransactionChunk *tc = unused;
-        unused = unused->next;
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if (!lowMemory) {
+            lowMemory = true;
+            lowMemorySince = now;
+            return;
+        }
 
-        if (unused == nullptr)
-            throw MemoryException("out of memory: out of transaction buffer size");
+        if (now - lowMemorySince < chrono::seconds(TRANSACTION_BUFFER_SHRINK_SECONDS))
+            return;
+        releaseExtents(true);
+        lowMemorySince = now;
+    }
 
-        unused->prev = nullptr;
+    //give memory of idle extents back to the OS, one spare extent of every size class stays mapped
+    void TransactionBuffer::releaseExtents(bool keepSpare) {
+        bool spare[TRANSACTION_BUFFER_CLASSES];
+        bool unmap = false;
+        for (uint32_t i = 0; i < TRANSACTION_BUFFER_CLASSES; ++i)
+            spare[i] = !keepSpare;
+
+        for (TransactionBufferExtent *extent : extents) {
+            if (extent->usedChunks > 0)
+                continue;
+
+            if (!spare[extent->sizeClass]) {
+                spare[extent->sizeClass] = true;
+                if (!extent->released) {
+                    madvise(extent->buffer, TRANSACTION_BUFFER_EXTENT_SIZE, MADV_DONTNEED);
+                    extent->released = true;
+                }
+                continue;
+            }
+
+            extent->unmap = true;
+            unmap = true;
+        }
+
+        if (!unmap)
+            return;
+
+        for (uint32_t i = 0; i < TRANSACTION_BUFFER_CLASSES; ++i) {
+            TransactionChunk *tc = unused[i];
+            while (tc != nullptr) {
+                TransactionChunk *nextTc = tc->next;
+                if (tc->extent->unmap) {
+                    if (tc->prev != nullptr)
+                        tc->prev->next = tc->next;
+                    else
+                        unused[i] = tc->next;
+                    if (tc->next != nullptr)
+                        tc->next->prev = tc->prev;
+                    tc->prev = nullptr;
+                    tc->next = nullptr;
+                    delete tc;
+                }
+                tc = nextTc;
+            }
+        }
+
+        for (auto it = extents.begin(); it != extents.end(); ) {
+            TransactionBufferExtent *extent = *it;
+            if (extent->unmap) {
+                munmap(extent->buffer, TRANSACTION_BUFFER_EXTENT_SIZE);
+                globalMemory -= TRANSACTION_BUFFER_EXTENT_SIZE;
+                allocatedMemory -= TRANSACTION_BUFFER_EXTENT_SIZE;
+                delete extent;
+                it = extents.erase(it);
+            } else
+                ++it;
+        }
+
+        if (trace >= TRACE_INFO)
+            cerr << "INFO: transaction buffer shrunk: " << dec << (getMemory() / 1024 / 1024) << "MB, peak: " <<
+                    (getMemoryPeak() / 1024 / 1024) << "MB, global: " << (getGlobalMemory() / 1024 / 1024) << "MB, global peak: " <<
+                    (getGlobalMemoryPeak() / 1024 / 1024) << "MB" << endl;
+    }
+
+    //smallest size class not lower than minClass which fits the element
+    uint32_t TransactionBuffer::chunkClass(uint32_t elementSize, uint32_t minClass) {
+        for (uint32_t i = minClass; i < TRANSACTION_BUFFER_CLASSES; ++i)
+            if (elementSize <= chunkSizes[i])
+                return i;
+
+        cerr << "ERROR: redo record too big for transaction chunk: " << dec << elementSize << endl;
+        throw MemoryException("out of memory: redo record too big for transaction chunk");
+    }
+
+    TransactionChunk *TransactionBuffer::newTransactionChunk(uint32_t sizeClass) {
+        if (unused[sizeClass] == nullptr)
+            grow(sizeClass);
+
+        TransactionChunk *tc = unused[sizeClass];
+        unused[sizeClass] = tc->next;
+        if (unused[sizeClass] != nullptr)
+            unused[sizeClass]->prev = nullptr;
+
+        tc->prev = nullptr;
         tc->next = nullptr;
         tc->size = 0;
         tc->elements = 0;
-
-        --size;
+        tc->deadElements = 0;
+        tc->maxScn = 0;
+        tc->unsorted = false;
+        ++tc->extent->usedChunks;
+        tc->extent->released = false;
+        usedMemory += tc->capacity;
 
         return tc;
     }
 
     void TransactionBuffer::deleteTransactionChunk(TransactionChunk* tc) {
-        ++size;
+        usedMemory -= tc->capacity;
+        --tc->extent->usedChunks;
 
-        tc->next = unused;
-        if (unused != nullptr)
-            unused->prev = tc;
-        unused = tc;
+        tc->next = unused[tc->sizeClass];
+        if (unused[tc->sizeClass] != nullptr)
+            unused[tc->sizeClass]->prev = tc;
+        unused[tc->sizeClass] = tc;
     }
 
-    TransactionChunk* TransactionBuffer::addTransactionChunk(TransactionChunk* tcLast, uint32_t objn, uint32_t objd,
-            typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2) {
+    TransactionChunk* TransactionBuffer::addTransactionChunk(TransactionChunk* tcLast, TransactionChunkIndex &opIndex, uint32_t objn,
+            uint32_t objd, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2) {
 
         //0:objn
         //4:objd
@@ -95,82 +273,31 @@ namespace OpenLogReplicator {
         //8:uba   -16
         //8:scn   -8
 
-        //last scn is higher
-        if (tcLast->size >= ROW_HEADER_MEMORY && *((typescn *)(tcLast->buffer + tcLast->size - 8)) > redoLogRecord1->scn) {
-            //cerr << "WARN: scn out of order" << endl;
-            //locate correct position
-            TransactionChunk* tcTemp = tcLast;
-            uint32_t elementsSkipped = 0;
-            uint32_t pos = tcTemp->size;
-
-            while (true) {
-                if (pos == 0) {
-                    if (tcTemp->prev == nullptr)
-                        break;
-                    tcTemp = tcTemp->prev;
-                    pos = tcTemp->size;
-                    elementsSkipped = 0;
-                }
-                if (elementsSkipped > tcTemp->elements || pos < ROW_HEADER_MEMORY) {
-                    cerr << "ERROR: bad data during finding scn out of order" << endl;
-                    return tcLast;
-                }
-                if (*((typescn *)(tcTemp->buffer + pos - 12)) <= redoLogRecord1->scn)
-                    break;
-                pos -= *((uint32_t *)(tcTemp->buffer + pos - 28));
-                ++elementsSkipped;
-            }
-
-            //does the block need to be divided
-            if (pos < tcTemp->size) {
-                TransactionChunk *tcNew = newTransactionChunk();
-                tcNew->elements = elementsSkipped;
-                tcNew->size = tcTemp->size - pos;
-                tcNew->prev = tcTemp;
-                if (tcTemp->next != nullptr) {
-                    tcNew->next = tcTemp->next;
-                    tcTemp->next->prev = tcNew;
-                }
-                tcTemp->next = tcNew;
-
-                memcpy(tcNew->buffer, tcTemp->buffer + pos, tcTemp->size - pos);
-                tcTemp->elements -= elementsSkipped;
-                tcTemp->size = pos;
-
-                if (tcTemp == tcLast)
-                    tcLast = tcNew;
-            }
-
-            //new block needed
-            if (tcTemp->size + redoLogRecord1->length + redoLogRecord2->length + sizeof(RedoLogRecord) +
-                    sizeof(struct RedoLogRecord) + 32 > TRANSACTION_BUFFER_CHUNK_SIZE) {
-                TransactionChunk *tcNew = newTransactionChunk();
-                tcNew->prev = tcTemp;
-                tcNew->next = tcTemp->next;
-                tcTemp->next->prev = tcNew;
-                tcTemp->next = tcNew;
-                tcTemp = tcNew;
-            }
-            appendTransactionChunk(tcTemp, objn, objd, uba, dba, slt, rci, redoLogRecord1, redoLogRecord2);
-        } else {
-            //new block needed
-            if (tcLast->size + redoLogRecord1->length + redoLogRecord2->length + sizeof(RedoLogRecord) +
-                    sizeof(struct RedoLogRecord) + 32 > TRANSACTION_BUFFER_CHUNK_SIZE) {
-                TransactionChunk *tcNew = newTransactionChunk();
-                tcNew->prev = tcLast;
-                tcNew->elements = 0;
-                tcNew->size = 0;
-                tcLast->next = tcNew;
-                tcLast = tcNew;
-            }
-            appendTransactionChunk(tcLast, objn, objd, uba, dba, slt, rci, redoLogRecord1, redoLogRecord2);
+        uint32_t elementSize = redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
+
+        //append only, out of order scn is sorted at commit
+        //new block needed, growing transaction gets bigger chunks
+        if (tcLast->size + elementSize > tcLast->capacity) {
+            uint32_t sizeClass = tcLast->sizeClass + 1;
+            if (sizeClass >= TRANSACTION_BUFFER_CLASSES)
+                sizeClass = TRANSACTION_BUFFER_CLASSES - 1;
+            TransactionChunk *tcNew = newTransactionChunk(chunkClass(elementSize, sizeClass));
+            tcNew->prev = tcLast;
+            tcNew->elements = 0;
+            tcNew->size = 0;
+            tcLast->next = tcNew;
+            tcLast = tcNew;
         }
+        appendTransactionChunk(tcLast, opIndex, objn, objd, uba, dba, slt, rci, redoLogRecord1, redoLogRecord2);
 
         return tcLast;
     }
 
-    void TransactionBuffer::appendTransactionChunk(TransactionChunk* tc, uint32_t objn, uint32_t objd, typeuba uba,
-            uint32_t dba, uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2) {
+    void TransactionBuffer::appendTransactionChunk(TransactionChunk* tc, TransactionChunkIndex &opIndex, uint32_t objn, uint32_t objd,
+            typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2) {
+        if (uba != 0)
+            opIndex[{uba, dba, slt, rci}] = {tc, tc->size};
+
         //append to the chunk at the end
         *((uint32_t *)(tc->buffer + tc->size)) = objn;
         *((uint32_t *)(tc->buffer + tc->size + 4)) = objd;
@@ -201,22 +328,81 @@ namespace OpenLogReplicator {
 
         tc->size += redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
         ++tc->elements;
+        updateChunkScn(tc, redoLogRecord1->scn);
     }
 
-    bool TransactionBuffer::deleteTransactionPart(TransactionChunk* tc, typeuba &uba, uint32_t &dba, uint8_t &slt, uint8_t &rci) {
-        cerr << "ERROR: part transaction delete: not yet implemented" << endl;
-        if (tc->size < ROW_HEADER_MEMORY || tc->elements == 0) {
-            cerr << "ERROR: trying to remove from empty buffer" << endl;
+    void TransactionBuffer::updateChunkScn(TransactionChunk* tc, typescn scn) {
+        if (scn < tc->maxScn)
+            tc->unsorted = true;
+        else
+            tc->maxScn = scn;
+    }
+
+    bool TransactionBuffer::deleteTransactionPart(TransactionChunk* &tcFirst, TransactionChunk* &tcLast, TransactionChunkIndex &opIndex, typeuba uba, uint32_t dba,
+            uint8_t slt, uint8_t rci, typeuba &lastUba, uint32_t &lastDba, uint8_t &lastSlt, uint8_t &lastRci) {
+        if (uba == 0)
+            return false;
+
+        auto it = opIndex.find({uba, dba, slt, rci});
+        if (it == opIndex.end())
+            return false;
+
+        TransactionChunk *tc = it->second.tc;
+        uint32_t pos = it->second.pos;
+        RedoLogRecord redoLogRecordHeader[2];
+        uint32_t op;
+
+        readTransactionChunkPart(tc, pos + 12, redoLogRecordHeader, sizeof(struct RedoLogRecord) * 2);
+        uint32_t elementSize = redoLogRecordHeader[0].length + redoLogRecordHeader[1].length + ROW_HEADER_MEMORY;
+        if (pos + elementSize > tc->size)
+            return false;
+
+        readTransactionChunkPart(tc, pos + 8, &op, sizeof(op));
+        if (op == 0) {
+            cerr << "ERROR: operation already rolled back, UBA: " << PRINTUBA(uba) << endl;
             return false;
         }
 
-        //while (tc != nullptr) {
-        //    uint32_t lastSize = *((uint32_t *)(tc->buffer + tc->size - 28));
-            //...
-        //    tc = tc->prev;
-        //}
+        //operation stays in the chunk but is skipped on flush
+        op = 0;
+        writeTransactionChunkPart(tc, pos + 8, &op, sizeof(op));
+        opIndex.erase(it);
+        ++tc->deadElements;
+
+        if (tc == tcLast) {
+            if (pos + elementSize == tc->size)
+                tcLast = trimTransactionChunk(tcLast, lastUba, lastDba, lastSlt, lastRci);
+        } else if (tc->deadElements == tc->elements) {
+            //all operations of the chunk are rolled back, none of them is in the index any more
+            if (tc == tcFirst)
+                tcFirst = tc->next;
+            if (tc->prev != nullptr)
+                tc->prev->next = tc->next;
+            tc->next->prev = tc->prev;
+            tc->prev = nullptr;
+            tc->next = nullptr;
+            deleteTransactionChunks(tc, tc);
+        }
 
-        return false;
+        return true;
+    }
+
+    //operations before endPos were sent already, they stay in the chunk but are skipped on flush
+    void TransactionBuffer::discardTransactionChunkPart(TransactionChunk* tc, uint32_t endPos) {
+        uint32_t pos = 0;
+        while (pos < endPos) {
+            RedoLogRecord redoLogRecordHeader[2];
+            uint32_t op;
+
+            readTransactionChunkPart(tc, pos + 8, &op, sizeof(op));
+            readTransactionChunkPart(tc, pos + 12, redoLogRecordHeader, sizeof(struct RedoLogRecord) * 2);
+            if (op != 0) {
+                op = 0;
+                writeTransactionChunkPart(tc, pos + 8, &op, sizeof(op));
+                ++tc->deadElements;
+            }
+            pos += redoLogRecordHeader[0].length + redoLogRecordHeader[1].length + ROW_HEADER_MEMORY;
+        }
     }
 
     bool TransactionBuffer::getLastRecord(TransactionChunk* tc, uint32_t &opCode, RedoLogRecord* &redoLogRecord1, RedoLogRecord* &redoLogRecord2) {
@@ -235,35 +421,120 @@ namespace OpenLogReplicator {
         return true;
     }
 
-    TransactionChunk* TransactionBuffer::rollbackTransactionChunk(TransactionChunk* tc, typeuba &lastUba, uint32_t &lastDba,
-            uint8_t &lastSlt, uint8_t &lastRci) {
+    //change length of data of the last record, record is moved to a new chunk when it doesn't fit
+    uint8_t *TransactionBuffer::resizeLastRecord(TransactionChunk* &tcLast, uint32_t length1) {
+        TransactionChunk *tc = tcLast;
+        uint32_t lastSize = *((uint32_t *)(tc->buffer + tc->size - 28));
+        uint32_t pos = tc->size - lastSize;
+        RedoLogRecord *redoLogRecord2 = (RedoLogRecord*)(tc->buffer + pos + 12 + sizeof(struct RedoLogRecord));
+        uint32_t elementSize = length1 + redoLogRecord2->length + ROW_HEADER_MEMORY;
+
+        if (pos + elementSize > tc->capacity) {
+            uint32_t sizeClass = tc->sizeClass + 1;
+            if (sizeClass >= TRANSACTION_BUFFER_CLASSES)
+                sizeClass = TRANSACTION_BUFFER_CLASSES - 1;
+            TransactionChunk *tcNew = newTransactionChunk(chunkClass(elementSize, sizeClass));
+            memcpy(tcNew->buffer, tc->buffer + pos, lastSize);
+            tcNew->elements = 1;
+
+            tc->size = pos;
+            --tc->elements;
+            if (tc->elements == 0 && tc->prev != nullptr) {
+                TransactionChunk *prevTc = tc->prev;
+                deleteTransactionChunk(tc);
+                tc = prevTc;
+            }
+            tc->next = tcNew;
+            tcNew->prev = tc;
+
+            tc = tcNew;
+            tcLast = tcNew;
+            pos = 0;
+        }
+
+        tc->size = pos + elementSize;
+        return tc->buffer + pos;
+    }
+
+    //write header & trailer of the last record after its data was changed
+    void TransactionBuffer::updateLastRecord(TransactionChunk* tc, TransactionChunkIndex &opIndex, uint8_t *buffer, uint32_t objn,
+            uint32_t objd, typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, typescn scn) {
+        RedoLogRecord *redoLogRecord1 = (RedoLogRecord*)(buffer + 12),
+                      *redoLogRecord2 = (RedoLogRecord*)(buffer + 12 + sizeof(struct RedoLogRecord));
+        uint32_t elementSize = redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
+        uint32_t pos = buffer - tc->buffer;
+
+        *((uint32_t *)(buffer)) = objn;
+        *((uint32_t *)(buffer + 4)) = objd;
+        *((uint32_t *)(buffer + elementSize - 28)) = elementSize;
+        *((uint8_t *)(buffer + elementSize - 24)) = slt;
+        *((uint8_t *)(buffer + elementSize - 23)) = rci;
+        *((uint32_t *)(buffer + elementSize - 20)) = dba;
+        *((typeuba *)(buffer + elementSize - 16)) = uba;
+        *((typescn *)(buffer + elementSize - 8)) = scn;
+        updateChunkScn(tc, scn);
+
+        if (uba != 0)
+            opIndex[{uba, dba, slt, rci}] = {tc, pos};
+    }
+
+    TransactionChunk* TransactionBuffer::rollbackTransactionChunk(TransactionChunk* tc, TransactionChunkIndex &opIndex, typeuba &lastUba,
+            uint32_t &lastDba, uint8_t &lastSlt, uint8_t &lastRci) {
         if (tc->size < ROW_HEADER_MEMORY || tc->elements == 0) {
             cerr << "ERROR: trying to remove from empty buffer" << endl;
             return tc;
         }
         uint32_t lastSize = *((uint32_t *)(tc->buffer + tc->size - 28));
+        typeuba uba = *((typeuba *)(tc->buffer + tc->size - 16));
+        uint32_t dba = *((uint32_t *)(tc->buffer + tc->size - 20));
+        uint8_t slt = *((uint8_t *)(tc->buffer + tc->size - 24));
+        uint8_t rci = *((uint8_t *)(tc->buffer + tc->size - 23));
+        if (uba != 0) {
+            auto it = opIndex.find({uba, dba, slt, rci});
+            if (it != opIndex.end() && it->second.tc == tc && it->second.pos == tc->size - lastSize)
+                opIndex.erase(it);
+        }
+
         tc->size -= lastSize;
         --tc->elements;
 
-        if (tc->elements == 0 && tc->prev != nullptr) {
-            TransactionChunk *prevTc = tc->prev;
-            prevTc->next = nullptr;
-            deleteTransactionChunk(tc);
-            tc = prevTc;
-        }
+        return trimTransactionChunk(tc, lastUba, lastDba, lastSlt, lastRci);
+    }
 
-        if (tc->elements == 0) {
-            lastUba = 0;
-            lastDba = 0;
-            lastSlt = 0;
-            lastRci = 0;
-            return tc;
-        }
+    TransactionChunk* TransactionBuffer::trimTransactionChunk(TransactionChunk* tc, typeuba &lastUba, uint32_t &lastDba,
+            uint8_t &lastSlt, uint8_t &lastRci) {
+        while (true) {
+            if (tc->elements == 0 && tc->prev != nullptr) {
+                TransactionChunk *prevTc = tc->prev;
+                prevTc->next = nullptr;
+                deleteTransactionChunk(tc);
+                tc = prevTc;
+                restoreTransactionChunk(tc);
+                continue;
+            }
 
-        if (tc->size < ROW_HEADER_MEMORY) {
-            cerr << "ERROR: can't set last UBA size: " << dec << tc->size << ", elements: " << tc->elements << endl;
-            return tc;
+            if (tc->elements == 0) {
+                lastUba = 0;
+                lastDba = 0;
+                lastSlt = 0;
+                lastRci = 0;
+                return tc;
+            }
+
+            if (tc->size < ROW_HEADER_MEMORY) {
+                cerr << "ERROR: can't set last UBA size: " << dec << tc->size << ", elements: " << tc->elements << endl;
+                return tc;
+            }
+
+            //drop operations which were rolled back earlier
+            uint32_t lastSize = *((uint32_t *)(tc->buffer + tc->size - 28));
+            if (*((uint32_t *)(tc->buffer + tc->size - lastSize + 8)) != 0)
+                break;
+            tc->size -= lastSize;
+            --tc->elements;
+            --tc->deadElements;
         }
+
         lastUba = *((typeuba *)(tc->buffer + tc->size - 16));
         lastDba = *((uint32_t *)(tc->buffer + tc->size - 20));
         lastSlt = *((uint8_t *)(tc->buffer + tc->size - 24));
@@ -273,30 +544,213 @@ namespace OpenLogReplicator {
     }
 
     void TransactionBuffer::deleteTransactionChunks(TransactionChunk* tc, TransactionChunk* tcLast) {
-        uint32_t num = 1;
-        TransactionChunk* tcTemp = tc;
-        while (tcTemp->next != nullptr) {
-            ++num;
-            tcTemp = tcTemp->next;
+        while (tc != nullptr) {
+            TransactionChunk *nextTc = tc->next;
+            bool last = (tc == tcLast);
+
+            if (tc->buffer != nullptr) {
+                tc->prev = nullptr;
+                deleteTransactionChunk(tc);
+            } else {
+                //spilled chunk: buffer was already returned
+                tc->prev = nullptr;
+                tc->next = nullptr;
+                delete tc;
+            }
+
+            if (last)
+                break;
+            tc = nextTc;
+        }
+    }
+
+    void TransactionBuffer::spillTransactionChunk(TransactionChunk* tc, int &spillFd, uint64_t &spillSize) {
+        if (tc->buffer == nullptr)
+            return;
+
+        if (spillFd == -1) {
+            string fileName = spillDir + "/OpenLogReplicator-spill-XXXXXX";
+            char *fileNameTemplate = new char[fileName.length() + 1];
+            strcpy(fileNameTemplate, fileName.c_str());
+            spillFd = mkstemp(fileNameTemplate);
+            //file is removed as soon as it is closed
+            if (spillFd != -1)
+                unlink(fileNameTemplate);
+            delete[] fileNameTemplate;
+
+            if (spillFd == -1) {
+                cerr << "ERROR: can't create spill file in: " << spillDir << endl;
+                throw MemoryException("out of memory: can't create spill file");
+            }
+        }
+
+        tc->spillFd = spillFd;
+        tc->spillPos = spillSize;
+        uint32_t written = 0;
+        while (written < tc->size) {
+            ssize_t ret = pwrite(spillFd, tc->buffer + written, tc->size - written, spillSize + written);
+            if (ret <= 0) {
+                cerr << "ERROR: can't write spill file, size: " << dec << spillSize << endl;
+                throw MemoryException("out of memory: can't write spill file");
+            }
+            written += ret;
+        }
+        spillSize += tc->size;
+
+        //return memory to the pool
+        TransactionChunk *tcFree = new TransactionChunk(nullptr, tc->buffer, tc->sizeClass, tc->capacity);
+        tcFree->extent = tc->extent;
+        tc->buffer = nullptr;
+        tc->extent = nullptr;
+        deleteTransactionChunk(tcFree);
+    }
+
+    void TransactionBuffer::restoreTransactionChunk(TransactionChunk* tc) {
+        if (tc->buffer != nullptr)
+            return;
+
+        TransactionChunk *tcBuffer = newTransactionChunk(tc->sizeClass);
+        uint8_t *chunkBuffer = tcBuffer->buffer;
+        tc->extent = tcBuffer->extent;
+        tcBuffer->buffer = nullptr;
+        tcBuffer->prev = nullptr;
+        tcBuffer->next = nullptr;
+        delete tcBuffer;
+
+        readTransactionChunkPart(tc, 0, chunkBuffer, tc->size);
+        tc->buffer = chunkBuffer;
+        tc->spillFd = -1;
+    }
+
+    //spilled chunk is read to the buffer of the calling thread
+    uint8_t *TransactionBuffer::readTransactionChunk(TransactionChunk* tc, uint8_t *&spillBuffer) {
+        if (tc->buffer != nullptr)
+            return tc->buffer;
+
+        if (spillBuffer == nullptr) {
+            spillBuffer = (uint8_t*) malloc(TRANSACTION_BUFFER_CHUNK_SIZE);
+            if (spillBuffer == nullptr)
+                throw MemoryException("out of memory: can't allocate spill buffer");
+        }
+
+        readTransactionChunkPart(tc, 0, spillBuffer, tc->size);
+        return spillBuffer;
+    }
+
+    //only chunks with out of order operations are sorted, chunks are merged by scn on flush
+    void TransactionBuffer::sortTransactionChunks(TransactionChunk* tc, vector<TransactionChunkScn> &order) {
+        for (; tc != nullptr; tc = tc->next) {
+            if (!tc->unsorted)
+                continue;
+
+            uint8_t *buffer = readTransactionChunk(tc, spillBuffer);
+            uint32_t pos = 0;
+            size_t orderPos = order.size();
+
+            for (uint32_t i = 0; i < tc->elements; ++i) {
+                RedoLogRecord *redoLogRecord1 = (RedoLogRecord*)(buffer + pos + 12),
+                              *redoLogRecord2 = (RedoLogRecord*)(buffer + pos + 12 + sizeof(struct RedoLogRecord));
+                uint32_t elementSize = redoLogRecord1->length + redoLogRecord2->length + ROW_HEADER_MEMORY;
+                order.push_back({*((typescn *)(buffer + pos + elementSize - 8)), {tc, pos}});
+                pos += elementSize;
+            }
+
+            stable_sort(order.begin() + orderPos, order.end(),
+                    [](const TransactionChunkScn &a, const TransactionChunkScn &b) { return a.scn < b.scn; });
+        }
+    }
+
+    //chunk may be spilled, only header & trailer of the operation are read
+    typescn TransactionBuffer::readElementScn(TransactionChunk* tc, uint32_t pos, uint32_t &elementSize) {
+        RedoLogRecord redoLogRecordHeader[2];
+        typescn scn;
+
+        readTransactionChunkPart(tc, pos + 12, redoLogRecordHeader, sizeof(struct RedoLogRecord) * 2);
+        elementSize = redoLogRecordHeader[0].length + redoLogRecordHeader[1].length + ROW_HEADER_MEMORY;
+        readTransactionChunkPart(tc, pos + elementSize - 8, &scn, sizeof(scn));
+        return scn;
+    }
+
+    void TransactionBuffer::readTransactionChunkPart(TransactionChunk* tc, uint32_t pos, void *buf, uint32_t length) {
+        if (tc->buffer != nullptr) {
+            memcpy(buf, tc->buffer + pos, length);
+            return;
+        }
+
+        uint32_t read = 0;
+        while (read < length) {
+            ssize_t ret = pread(tc->spillFd, (uint8_t*)buf + read, length - read, tc->spillPos + pos + read);
+            if (ret <= 0) {
+                cerr << "ERROR: can't read spill file, pos: " << dec << (tc->spillPos + pos) << endl;
+                throw MemoryException("out of memory: can't read spill file");
+            }
+            read += ret;
+        }
+    }
+
+    void TransactionBuffer::writeTransactionChunkPart(TransactionChunk* tc, uint32_t pos, const void *buf, uint32_t length) {
+        if (tc->buffer != nullptr) {
+            memcpy(tc->buffer + pos, buf, length);
+            return;
+        }
+
+        if (pwrite(tc->spillFd, buf, length, tc->spillPos + pos) != (ssize_t)length) {
+            cerr << "ERROR: can't write spill file, pos: " << dec << (tc->spillPos + pos) << endl;
+            throw MemoryException("out of memory: can't write spill file");
         }
-        size += num;
+    }
 
-        tcLast->next = unused;
-        if (unused != nullptr)
-            unused->prev = tcLast;
-        unused = tc;
+    uint64_t TransactionBuffer::getUsedMemory() {
+        return usedMemory;
+    }
+
+    bool TransactionBuffer::spillNeeded() {
+        return usedMemory > spillHighWater ||
+                (allocatedMemory - usedMemory < TRANSACTION_BUFFER_EXTENT_SIZE / 4 && !canGrow());
+    }
+
+    bool TransactionBuffer::spillDone() {
+        return usedMemory <= spillLowWater &&
+                (allocatedMemory - usedMemory >= TRANSACTION_BUFFER_EXTENT_SIZE / 2 || canGrow());
+    }
+
+    uint64_t TransactionBuffer::getMemory() {
+        return allocatedMemory;
+    }
+
+    uint64_t TransactionBuffer::getMemoryPeak() {
+        return peakMemory;
+    }
+
+    uint64_t TransactionBuffer::getGlobalMemory() {
+        return globalMemory;
+    }
+
+    uint64_t TransactionBuffer::getGlobalMemoryPeak() {
+        return globalMemoryPeak;
     }
 
     TransactionBuffer::~TransactionBuffer() {
-        while (unused != nullptr) {
-            TransactionChunk *nextTc = unused->next;
-            delete unused;
-            unused = nextTc;
+        for (uint32_t i = 0; i < TRANSACTION_BUFFER_CLASSES; ++i) {
+            while (unused[i] != nullptr) {
+                TransactionChunk *nextTc = unused[i]->next;
+                unused[i]->prev = nullptr;
+                unused[i]->next = nullptr;
+                delete unused[i];
+                unused[i] = nextTc;
+            }
+        }
+
+        for (TransactionBufferExtent *extent : extents) {
+            munmap(extent->buffer, TRANSACTION_BUFFER_EXTENT_SIZE);
+            globalMemory -= TRANSACTION_BUFFER_EXTENT_SIZE;
+            delete extent;
         }
+        extents.clear();
 
-        if (buffer != nullptr) {
-            free(buffer);
-            buffer = nullptr;
+        if (spillBuffer != nullptr) {
+            free(spillBuffer);
+            spillBuffer = nullptr;
         }
     }
 }
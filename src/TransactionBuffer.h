@@ -17,36 +17,92 @@ You should have received a copy of the GNU General Public License
 along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
 #include "types.h"
+#include "TransactionChunk.h"
 
 #ifndef TRANSACTIONBUFFER_H_
 #define TRANSACTIONBUFFER_H_
 
 namespace OpenLogReplicator {
 
-    class TransactionChunk;
     class RedoLogRecord;
 
+    //memory mapped group of chunks, returned to the OS when idle
+    struct TransactionBufferExtent {
+        uint8_t *buffer;
+        uint32_t sizeClass;
+        uint32_t usedChunks;
+        bool released;
+        bool unmap;
+    };
+
     class TransactionBuffer {
     protected:
-        TransactionChunk *unused;
-        uint8_t *buffer;
-        uint32_t size;
+        static atomic<uint64_t> globalMemory;
+        static atomic<uint64_t> globalMemoryPeak;
+        TransactionChunk *unused[TRANSACTION_BUFFER_CLASSES];
+        vector<TransactionBufferExtent*> extents;
+        uint64_t maxMemory;
+        uint64_t allocatedMemory;
+        uint64_t peakMemory;
+        uint64_t usedMemory;
+        uint32_t trace;
+        uint64_t spillHighWater;    //memory in use which triggers spilling to disk
+        uint64_t spillLowWater;     //memory in use after spilling
+        string spillDir;
+        bool lowMemory;             //less than half of allocated memory is in use
+        chrono::steady_clock::time_point lowMemorySince;
 
-        void appendTransactionChunk(TransactionChunk* tc, uint32_t objn, uint32_t objd, typeuba uba, uint32_t dba,
-                uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2);
-    public:
-        TransactionChunk* newTransactionChunk();
-        TransactionChunk* addTransactionChunk(TransactionChunk* tc, uint32_t objn, uint32_t objd, typeuba uba, uint32_t dba,
-                uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2);
-        TransactionChunk* rollbackTransactionChunk(TransactionChunk* tc, typeuba &lastUba, uint32_t &lastDba,
+        bool canGrow();
+        void grow(uint32_t sizeClass);
+        void releaseExtents(bool keepSpare);
+        uint32_t chunkClass(uint32_t elementSize, uint32_t minClass);
+        void updateChunkScn(TransactionChunk* tc, typescn scn);
+        void writeTransactionChunkPart(TransactionChunk* tc, uint32_t pos, const void *buf, uint32_t length);
+
+        void appendTransactionChunk(TransactionChunk* tc, TransactionChunkIndex &opIndex, uint32_t objn, uint32_t objd, typeuba uba,
+                uint32_t dba, uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2);
+        TransactionChunk* trimTransactionChunk(TransactionChunk* tc, typeuba &lastUba, uint32_t &lastDba,
                 uint8_t &lastSlt, uint8_t &lastRci);
+    public:
+        static uint64_t globalMemoryMax;
+        uint8_t *spillBuffer;       //used by reader thread
+        static const uint32_t chunkSizes[TRANSACTION_BUFFER_CLASSES];
+
+        TransactionChunk* newTransactionChunk(uint32_t sizeClass);
+        TransactionChunk* addTransactionChunk(TransactionChunk* tc, TransactionChunkIndex &opIndex, uint32_t objn, uint32_t objd,
+                typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2);
+        TransactionChunk* rollbackTransactionChunk(TransactionChunk* tc, TransactionChunkIndex &opIndex, typeuba &lastUba,
+                uint32_t &lastDba, uint8_t &lastSlt, uint8_t &lastRci);
+        uint8_t *resizeLastRecord(TransactionChunk* &tcLast, uint32_t length1);
+        void updateLastRecord(TransactionChunk* tc, TransactionChunkIndex &opIndex, uint8_t *buffer, uint32_t objn, uint32_t objd,
+                typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, typescn scn);
         bool getLastRecord(TransactionChunk* tc, uint32_t &opCode, RedoLogRecord* &redoLogRecord1, RedoLogRecord* &redoLogRecord2);
-        bool deleteTransactionPart(TransactionChunk* tc, typeuba &uba, uint32_t &dba, uint8_t &slt, uint8_t &rci);
+        bool deleteTransactionPart(TransactionChunk* &tcFirst, TransactionChunk* &tcLast, TransactionChunkIndex &opIndex, typeuba uba, uint32_t dba,
+                uint8_t slt, uint8_t rci, typeuba &lastUba, uint32_t &lastDba, uint8_t &lastSlt, uint8_t &lastRci);
         void deleteTransactionChunk(TransactionChunk* tc);
+        void discardTransactionChunkPart(TransactionChunk* tc, uint32_t endPos);
         void deleteTransactionChunks(TransactionChunk* tc, TransactionChunk* lastTc);
+        void spillTransactionChunk(TransactionChunk* tc, int &spillFd, uint64_t &spillSize);
+        void restoreTransactionChunk(TransactionChunk* tc);
+        uint8_t *readTransactionChunk(TransactionChunk* tc, uint8_t *&spillBuffer);
+        void sortTransactionChunks(TransactionChunk* tc, vector<TransactionChunkScn> &order);
+        typescn readElementScn(TransactionChunk* tc, uint32_t pos, uint32_t &elementSize);
+        void readTransactionChunkPart(TransactionChunk* tc, uint32_t pos, void *buf, uint32_t length);
+        uint64_t getUsedMemory();
+        bool spillNeeded();
+        bool spillDone();
+        void shrink();
+        uint64_t getMemory();
+        uint64_t getMemoryPeak();
+        static uint64_t getGlobalMemory();
+        static uint64_t getGlobalMemoryPeak();
 
-        TransactionBuffer();
+        TransactionBuffer(uint32_t maxMemory, uint32_t spillMemory, const string &spillDir, uint32_t trace);
         virtual ~TransactionBuffer();
     };
 }
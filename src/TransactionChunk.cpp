@@ -21,10 +21,18 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 
 namespace OpenLogReplicator {
 
-    TransactionChunk::TransactionChunk(TransactionChunk *prev, uint8_t *buffer) :
+    TransactionChunk::TransactionChunk(TransactionChunk *prev, uint8_t *buffer, uint32_t sizeClass, uint32_t capacity) :
             elements(0),
+            deadElements(0),
             size(0),
+            maxScn(0),
+            unsorted(false),
+            capacity(capacity),
+            sizeClass(sizeClass),
             buffer(buffer),
+            extent(nullptr),
+            spillFd(-1),
+            spillPos(0),
             prev(prev),
             next(nullptr) {
         if (prev != nullptr)
@@ -37,4 +45,18 @@ namespace OpenLogReplicator {
         if (next != nullptr)
             next->prev = prev;
     }
+
+    bool TransactionChunkKey::operator==(const TransactionChunkKey &other) const {
+        return uba == other.uba && dba == other.dba && slt == other.slt && rci == other.rci;
+    }
+
+    size_t TransactionChunkKeyHash::operator()(const TransactionChunkKey &key) const {
+        return (size_t)(key.uba ^ ((uint64_t)key.dba << 24) ^ ((uint64_t)key.slt << 48) ^ ((uint64_t)key.rci << 56));
+    }
+
+    bool TransactionChunkRunCompare::operator()(const TransactionChunkRun &r1, const TransactionChunkRun &r2) {
+        if (r1.scn != r2.scn)
+            return r1.scn > r2.scn;
+        return r1.seq > r2.seq;
+    }
 }
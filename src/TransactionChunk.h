@@ -17,24 +17,81 @@ You should have received a copy of the GNU General Public License
 along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <unordered_map>
+#include <vector>
 #include "types.h"
 
 #ifndef TRANSACTIONCHUNK_H_
 #define TRANSACTIONCHUNK_H_
 
+using namespace std;
+
 namespace OpenLogReplicator {
 
+    struct TransactionBufferExtent;
+
     class TransactionChunk {
     public:
         uint32_t elements;
+        uint32_t deadElements;      //operations rolled back to savepoint, left as tombstones
         uint32_t size;
-        uint8_t *buffer;
+        typescn maxScn;
+        bool unsorted;              //operation with lower scn was appended after higher one
+        uint32_t capacity;
+        uint32_t sizeClass;
+        uint8_t *buffer;            //nullptr when spilled to disk
+        TransactionBufferExtent *extent;
+        int spillFd;
+        uint64_t spillPos;
         TransactionChunk *prev;
         TransactionChunk *next;
 
-        TransactionChunk(TransactionChunk *prev, uint8_t *buffer);
+        TransactionChunk(TransactionChunk *prev, uint8_t *buffer, uint32_t sizeClass, uint32_t capacity);
         virtual ~TransactionChunk();
     };
+
+    //location of operation stored in transaction chunk
+    struct TransactionChunkPos {
+        TransactionChunk *tc;
+        uint32_t pos;
+    };
+
+    //undo record of operation, referenced by rollback to savepoint
+    struct TransactionChunkKey {
+        typeuba uba;
+        uint32_t dba;
+        uint8_t slt;
+        uint8_t rci;
+
+        bool operator==(const TransactionChunkKey &other) const;
+    };
+
+    struct TransactionChunkKeyHash {
+        size_t operator()(const TransactionChunkKey &key) const;
+    };
+
+    typedef unordered_map<TransactionChunkKey, TransactionChunkPos, TransactionChunkKeyHash> TransactionChunkIndex;
+
+    //operation position ordered by scn at commit
+    struct TransactionChunkScn {
+        typescn scn;
+        TransactionChunkPos chunkPos;
+    };
+
+    //next operation of one chunk while chunks of transaction are merged by scn
+    struct TransactionChunkRun {
+        typescn scn;
+        uint32_t seq;               //chunk number, operations with equal scn keep order
+        TransactionChunk *tc;
+        uint32_t element;
+        uint32_t pos;
+        uint32_t elementSize;
+        uint32_t orderPos;          //first operation of unsorted chunk in sorted index
+    };
+
+    struct TransactionChunkRunCompare {
+        bool operator()(const TransactionChunkRun &r1, const TransactionChunkRun &r2);
+    };
 }
 
 #endif
@@ -20,6 +20,7 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include <iostream>
 #include <iomanip>
 #include <string.h>
+#include "MemoryException.h"
 #include "TransactionMap.h"
 #include "Transaction.h"
 
@@ -27,125 +28,148 @@ using namespace std;
 
 namespace OpenLogReplicator {
 
+    TransactionMap::TransactionMap() :
+        elements(0),
+        mapSize(TRANSACTION_MAP_INITIAL_SIZE),
+        mapShift(64) {
+        for (uint32_t size = mapSize; size > 1; size >>= 1)
+            --mapShift;
+        hashMap = new TransactionMapEntry[mapSize];
+        memset(hashMap, 0, (sizeof(TransactionMapEntry)) * mapSize);
+    }
+
+    TransactionMap::~TransactionMap() {
+        if (hashMap != nullptr) {
+            delete[] hashMap;
+            hashMap = nullptr;
+        }
+    }
+
+    uint32_t TransactionMap::hashKey(typeuba uba, uint8_t slt, uint8_t rci) {
+        return HASHINGFUNCTION(uba, slt, rci) >> mapShift;
+    }
+
+    void TransactionMap::grow() {
+        TransactionMapEntry *oldHashMap = hashMap;
+        uint32_t oldMapSize = mapSize;
+
+        if (mapSize >= 0x80000000)
+            throw MemoryException("out of memory: transaction map size exceeded");
+
+        mapSize <<= 1;
+        --mapShift;
+        hashMap = new TransactionMapEntry[mapSize];
+        memset(hashMap, 0, (sizeof(TransactionMapEntry)) * mapSize);
+
+        for (uint32_t i = 0; i < oldMapSize; ++i) {
+            if (oldHashMap[i].transaction == nullptr)
+                continue;
+
+            uint32_t pos = hashKey(oldHashMap[i].uba, oldHashMap[i].slt, oldHashMap[i].rci);
+            while (hashMap[pos].transaction != nullptr)
+                pos = (pos + 1) & (mapSize - 1);
+            hashMap[pos] = oldHashMap[i];
+        }
+
+        delete[] oldHashMap;
+    }
+
     void TransactionMap::set(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, Transaction* transaction) {
         if (uba == 0 && dba == 0 && slt == 0 && rci == 0)
             return;
-        uint32_t hashKey = HASHINGFUNCTION(uba, slt, rci);
-
-        if (hashMap[hashKey] == nullptr) {
-            hashMap[hashKey] = transaction;
-        } else {
-            Transaction *transactionTemp = hashMap[hashKey];
-            while (transactionTemp->next != nullptr)
-                transactionTemp = transactionTemp->next;
-            transactionTemp->next = transaction;
-        }
+
+        //keep load factor below 1/2 so that probe sequences stay short
+        if ((elements + 1) * 2 > mapSize)
+            grow();
+
+        uint32_t pos = hashKey(uba, slt, rci);
+        while (hashMap[pos].transaction != nullptr)
+            pos = (pos + 1) & (mapSize - 1);
+
+        hashMap[pos].uba = uba;
+        hashMap[pos].dba = dba;
+        hashMap[pos].slt = slt;
+        hashMap[pos].rci = rci;
+        hashMap[pos].transaction = transaction;
         ++elements;
     }
 
     void TransactionMap::erase(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci) {
         if (uba == 0 && dba == 0 && slt == 0 && rci == 0)
             return;
-        uint32_t hashKey = HASHINGFUNCTION(uba, slt, rci);
 
-        if (hashMap[hashKey] == nullptr) {
-            cerr << "ERROR: transaction does not exists in hash map1: UBA: " << PRINTUBA(uba) <<
+        uint32_t pos = hashKey(uba, slt, rci);
+        while (hashMap[pos].transaction != nullptr) {
+            if (hashMap[pos].uba == uba && hashMap[pos].dba == dba && hashMap[pos].slt == slt && hashMap[pos].rci == rci)
+                break;
+            pos = (pos + 1) & (mapSize - 1);
+        }
+
+        if (hashMap[pos].transaction == nullptr) {
+            cerr << "ERROR: transaction does not exists in hash map: UBA: " << PRINTUBA(uba) <<
                     " DBA: 0x" << setfill('0') << setw(8) << hex << dba <<
                     " SLT: " << dec << (uint32_t) slt <<
                     " RCI: " << dec << (uint32_t) rci << endl;
             return;
         }
 
-        Transaction *transactionTemp = hashMap[hashKey];
-        if (transactionTemp->lastUba == uba && transactionTemp->lastDba == dba && transactionTemp->lastSlt == slt
-                 && transactionTemp->lastRci == rci) {
-            hashMap[hashKey] = transactionTemp->next;
-            transactionTemp->next = nullptr;
-            --elements;
-            return;
-        }
-        Transaction *transactionTempNext = transactionTemp->next;
-        while (transactionTempNext != nullptr) {
-            if (transactionTempNext->lastUba == uba && transactionTempNext->lastDba == dba
-                    && transactionTempNext->lastSlt == slt && transactionTempNext->lastRci == rci) {
-                transactionTemp->next = transactionTempNext->next;
-                transactionTempNext->next = nullptr;
-                --elements;
-                return;
+        //backward shift deletion - move following elements of the cluster to fill the gap
+        uint32_t next = (pos + 1) & (mapSize - 1);
+        while (hashMap[next].transaction != nullptr) {
+            uint32_t home = hashKey(hashMap[next].uba, hashMap[next].slt, hashMap[next].rci);
+            if (((next - home) & (mapSize - 1)) >= ((next - pos) & (mapSize - 1))) {
+                hashMap[pos] = hashMap[next];
+                pos = next;
             }
-            transactionTemp = transactionTempNext;
-            transactionTempNext = transactionTemp->next;
+            next = (next + 1) & (mapSize - 1);
         }
-
-        cerr << "ERROR: transaction does not exists in hash map2: UBA: " << PRINTUBA(uba) <<
-                " DBA: 0x" << setfill('0') << setw(8) << hex << dba <<
-                " SLT: " << dec << (uint32_t) slt <<
-                " RCI: " << dec << (uint32_t) rci << endl;
-        return;
+        hashMap[pos].transaction = nullptr;
+        --elements;
     }
 
     Transaction* TransactionMap::getMatch(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci) {
-        uint32_t hashKey = HASHINGFUNCTION(uba, slt, rci);
-
-        Transaction *transactionTemp = hashMap[hashKey], *transactionTempPartial1, *transactionTempPartial2;
+        Transaction *transactionPartial1 = nullptr, *transactionPartial2 = nullptr;
         uint32_t partialMatches1 = 0, partialMatches2 = 0;
 
-        while (transactionTemp != nullptr) {
-            if (transactionTemp->lastUba == uba && transactionTemp->lastDba == dba &&
-                    transactionTemp->lastSlt == slt && transactionTemp->lastRci == rci)
-                return transactionTemp;
+        uint32_t pos = hashKey(uba, slt, rci);
+        while (hashMap[pos].transaction != nullptr) {
+            TransactionMapEntry *entry = hashMap + pos;
+            if (entry->uba == uba && entry->slt == slt && entry->rci == rci) {
+                if (entry->dba == dba)
+                    return entry->transaction;
 
-            if (transactionTemp->lastUba == uba && (uba != 0 || transactionTemp->lastDba == dba) &&
-                    transactionTemp->lastSlt == slt && transactionTemp->lastRci == rci) {
-                transactionTempPartial1 = transactionTemp;
-                ++partialMatches1;
-            }
+                if (uba != 0) {
+                    transactionPartial1 = entry->transaction;
+                    ++partialMatches1;
+                }
 
-            if (transactionTemp->lastUba == uba && transactionTemp->lastSlt == slt && transactionTemp->lastRci == rci) {
-                transactionTempPartial2 = transactionTemp;
+                transactionPartial2 = entry->transaction;
                 ++partialMatches2;
             }
-
-            transactionTemp = transactionTemp->next;
+            pos = (pos + 1) & (mapSize - 1);
         }
 
         if (partialMatches1 == 1)
-            return transactionTempPartial1;
+            return transactionPartial1;
 
         if (partialMatches2 == 1)
-            return transactionTempPartial2;
+            return transactionPartial2;
 
         return nullptr;
     }
 
     Transaction* TransactionMap::get(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci) {
-        uint32_t hashKey = HASHINGFUNCTION(uba, slt, rci);
-
-        Transaction *transactionTemp = hashMap[hashKey]; //, *transactionTempPartial1, *transactionTempPartial2;
-        //uint32_t partialMatches1 = 0, partialMatches2 = 0;
-
-        while (transactionTemp != nullptr) {
-            if (transactionTemp->lastUba == uba && transactionTemp->lastDba == dba &&
-                    transactionTemp->lastSlt == slt && transactionTemp->lastRci == rci)
-                return transactionTemp;
-
-            transactionTemp = transactionTemp->next;
+        uint32_t pos = hashKey(uba, slt, rci);
+        while (hashMap[pos].transaction != nullptr) {
+            if (hashMap[pos].uba == uba && hashMap[pos].dba == dba && hashMap[pos].slt == slt && hashMap[pos].rci == rci)
+                return hashMap[pos].transaction;
+            pos = (pos + 1) & (mapSize - 1);
         }
 
         return nullptr;
     }
 
-    TransactionMap::TransactionMap() :
-        elements(0) {
-        hashMap = new Transaction*[MAX_CONCURRENT_TRANSACTIONS * 2];
-        memset(hashMap, 0, (sizeof(Transaction*)) * (MAX_CONCURRENT_TRANSACTIONS * 2));
+    uint32_t TransactionMap::size() {
+        return elements;
     }
-
-    TransactionMap::~TransactionMap() {
-        if (hashMap != nullptr) {
-            delete[] hashMap;
-            hashMap = nullptr;
-        }
-    }
-
 }
@@ -22,16 +22,32 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #ifndef TRANSACTIONMAP_H_
 #define TRANSACTIONMAP_H_
 
-#define HASHINGFUNCTION(uba,slt,rci) ((uba>>32)^(uba&0xFFFFFFFF)^(slt<<9)^(rci<<17))%(MAX_CONCURRENT_TRANSACTIONS*2-1)
+#define TRANSACTION_MAP_INITIAL_SIZE 1024
+//dba is not part of the hash so that partial matches are found in the same probe sequence
+#define HASHINGFUNCTION(uba,slt,rci) ((((uba)>>32)^((uba)&0xFFFFFFFF)^((uint64_t)(slt)<<9)^((uint64_t)(rci)<<17))*0x9E3779B97F4A7C15ULL)
 
 namespace OpenLogReplicator {
 
     class Transaction;
 
+    struct TransactionMapEntry {
+        typeuba uba;
+        uint32_t dba;
+        uint8_t slt;
+        uint8_t rci;
+        Transaction *transaction;
+    };
+
+    //open addressing hash map with linear probing
     class TransactionMap {
     protected:
         uint32_t elements;
-        Transaction** hashMap;
+        uint32_t mapSize;
+        uint32_t mapShift;
+        TransactionMapEntry *hashMap;
+
+        uint32_t hashKey(typeuba uba, uint8_t slt, uint8_t rci);
+        void grow();
 
     public:
         TransactionMap();
@@ -40,6 +56,7 @@ namespace OpenLogReplicator {
         void set(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci, Transaction * transaction);
         Transaction* get(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci);
         Transaction* getMatch(typeuba uba, uint32_t dba, uint8_t slt, uint8_t rci);
+        uint32_t size();
     };
 }
 
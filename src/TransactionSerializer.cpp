@@ -0,0 +1,89 @@
+/* Thread formatting committed transactions
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <iostream>
+#include <mutex>
+#include <stdlib.h>
+#include "types.h"
+#include "TransactionSerializer.h"
+#include "OracleEnvironment.h"
+#include "OutputBuffer.h"
+#include "Transaction.h"
+#include "Writer.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    TransactionSerializer::TransactionSerializer(const string alias, CommandBuffer *commandBuffer, OracleEnvironment *oracleEnvironment) :
+        Thread(alias, commandBuffer),
+        oracleEnvironment(oracleEnvironment),
+        spillBuffer(nullptr) {
+        outputBuffer = new OutputBuffer(oracleEnvironment, commandBuffer);
+        outputBuffer->writer = commandBuffer->writer->clone(outputBuffer);
+    }
+
+    TransactionSerializer::~TransactionSerializer() {
+        if (outputBuffer != nullptr) {
+            delete outputBuffer->writer;
+            delete outputBuffer;
+            outputBuffer = nullptr;
+        }
+        if (spillBuffer != nullptr) {
+            free(spillBuffer);
+            spillBuffer = nullptr;
+        }
+    }
+
+    void TransactionSerializer::terminate(void) {
+        this->shutdown = true;
+        outputBuffer->terminate();
+    }
+
+    void *TransactionSerializer::run() {
+        while (!this->shutdown) {
+            Transaction *transaction;
+            {
+                unique_lock<mutex> lck(oracleEnvironment->serializeMtx);
+                while (oracleEnvironment->serializeQueue.empty() && !this->shutdown)
+                    oracleEnvironment->serializeCond.wait(lck);
+                if (this->shutdown)
+                    break;
+
+                transaction = oracleEnvironment->serializeQueue.front();
+                oracleEnvironment->serializeQueue.pop();
+            }
+
+            outputBuffer->ticket = transaction->ticket;
+            transaction->flush(oracleEnvironment, outputBuffer, spillBuffer);
+            bool published = outputBuffer->publish();
+
+            //chunks are returned to the pool by the reader, transaction not published keeps later tickets waiting
+            {
+                unique_lock<mutex> lck(oracleEnvironment->serializeMtx);
+                if (published)
+                    ++oracleEnvironment->publishTicket;
+                oracleEnvironment->serializedQueue.push(transaction);
+                oracleEnvironment->publishCond.notify_all();
+            }
+        }
+
+        return 0;
+    }
+}
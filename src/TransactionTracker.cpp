@@ -0,0 +1,117 @@
+/* Tracker of open transactions
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <iostream>
+#include <stdint.h>
+#include "TransactionTracker.h"
+#include "MemoryException.h"
+#include "Transaction.h"
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    TransactionTracker::TransactionTracker() {
+    }
+
+    TransactionTracker::~TransactionTracker() {
+        heap.clear();
+    }
+
+    void TransactionTracker::set(uint32_t pos, Transaction *transaction) {
+        heap[pos] = transaction;
+        transaction->pos = pos;
+    }
+
+    void TransactionTracker::moveUp(uint32_t pos) {
+        Transaction *transaction = heap[pos];
+        while (pos > 0 && transaction->firstScn < heap[(pos - 1) >> 1]->firstScn) {
+            set(pos, heap[(pos - 1) >> 1]);
+            pos = (pos - 1) >> 1;
+        }
+        set(pos, transaction);
+    }
+
+    void TransactionTracker::moveDown(uint32_t pos) {
+        Transaction *transaction = heap[pos];
+        uint32_t heapSize = heap.size();
+
+        while ((pos << 1) + 1 < heapSize) {
+            uint32_t child = (pos << 1) + 1;
+            if (child + 1 < heapSize && heap[child + 1]->firstScn < heap[child]->firstScn)
+                ++child;
+            if (heap[child]->firstScn >= transaction->firstScn)
+                break;
+            set(pos, heap[child]);
+            pos = child;
+        }
+        set(pos, transaction);
+    }
+
+    void TransactionTracker::add(Transaction *transaction) {
+        heap.push_back(transaction);
+        moveUp(heap.size() - 1);
+    }
+
+    void TransactionTracker::erase(Transaction *transaction) {
+        uint32_t pos = transaction->pos;
+        if (pos >= heap.size() || heap[pos] != transaction)
+            throw MemoryException("tracker inconsistency: erase of non existent transaction");
+
+        Transaction *last = heap.back();
+        heap.pop_back();
+        if (last == transaction)
+            return;
+
+        set(pos, last);
+        moveUp(pos);
+        moveDown(last->pos);
+    }
+
+    //first SCN can only move back, no need to check children
+    void TransactionTracker::update(Transaction *transaction) {
+        uint32_t pos = transaction->pos;
+        if (pos >= heap.size() || heap[pos] != transaction)
+            throw MemoryException("tracker inconsistency: update of non existent transaction");
+
+        if (pos > 0 && transaction->firstScn < heap[(pos - 1) >> 1]->firstScn)
+            moveUp(pos);
+    }
+
+    Transaction *TransactionTracker::at(uint32_t pos) {
+        return heap[pos];
+    }
+
+    typescn TransactionTracker::minScn() {
+        if (heap.size() > 0)
+            return heap[0]->firstScn;
+        else
+            return ZERO_SCN;
+    }
+
+    uint32_t TransactionTracker::size() {
+        return heap.size();
+    }
+
+    bool TransactionCommitCompare::operator()(Transaction* const& p1, Transaction* const& p2) {
+        if (p1->lastScn != p2->lastScn)
+            return p1->lastScn > p2->lastScn;
+        return p1->xid > p2->xid;
+    }
+}
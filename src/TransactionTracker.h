@@ -0,0 +1,58 @@
+/* Header for TransactionTracker class
+   Copyright (C) 2018-2020 Adam Leszczynski.
+
+This file is part of Open Log Replicator.
+
+Open Log Replicator is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License as published
+by the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+Open Log Replicator is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Open Log Replicator; see the file LICENSE.txt  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <vector>
+#include "types.h"
+
+#ifndef TRANSACTIONTRACKER_H_
+#define TRANSACTIONTRACKER_H_
+
+using namespace std;
+
+namespace OpenLogReplicator {
+
+    class Transaction;
+
+    //min-heap of open transactions ordered by first SCN
+    class TransactionTracker {
+    protected:
+        vector<Transaction*> heap;
+
+        void moveUp(uint32_t pos);
+        void moveDown(uint32_t pos);
+        void set(uint32_t pos, Transaction *transaction);
+
+    public:
+        void add(Transaction *transaction);
+        void erase(Transaction *transaction);
+        void update(Transaction *transaction);
+        Transaction *at(uint32_t pos);
+        typescn minScn();
+        uint32_t size();
+
+        TransactionTracker();
+        virtual ~TransactionTracker();
+    };
+
+    struct TransactionCommitCompare {
+        bool operator()(Transaction* const& p1, Transaction* const& p2);
+    };
+}
+
+#endif
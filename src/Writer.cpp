@@ -21,8 +21,10 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 #include "Writer.h"
 
 #include "CommandBuffer.h"
+#include "Compressor.h"
 #include "OracleObject.h"
 #include "OracleColumn.h"
+#include "OracleTime.h"
 #include "RedoLogRecord.h"
 #include "RedoLogException.h"
 
@@ -30,15 +32,133 @@ using namespace std;
 
 namespace OpenLogReplicator {
 
-    Writer::Writer(const string alias, CommandBuffer *commandBuffer) :
-        Thread(alias, commandBuffer) {
+    Writer::Writer(const string alias, CommandBuffer *commandBuffer, uint32_t format, bool markers) :
+        Thread(alias, commandBuffer),
+        tranScn(0),
+        tranXid(0),
+        tranProvisional(false),
+        tranSeq(0),
+        format(format),
+        markers(markers),
+        keyActive(false),
+        keyRowid(0),
+        keyFound(0),
+        keyTotal(0),
+        consumer(0),
+        compressor(nullptr) {
+    }
+
+    void Writer::begin(typescn scn, typexid xid, bool provisional) {
+        tranScn = scn;
+        tranXid = xid;
+        tranProvisional = provisional;
+        tranSeq = 0;
+        commandBuffer->setScn(scn);
+
+        //transaction streamed before commit is closed by endTran anyway
+        if (format == MESSAGE_FORMAT_ROW && markers && !provisional) {
+            beginMarker(scn, xid);
+            commandBuffer->rewind();
+        }
+
+        if (provisional)
+            beginProvisional(scn, xid);
+        else
+            beginTran(scn, xid);
+    }
+
+    void Writer::end() {
+        commitTran();
+
+        if (format == MESSAGE_FORMAT_ROW && markers && !tranProvisional) {
+            commandBuffer->rewind();
+            endTran(tranScn, tranXid, false, false);
+        }
+    }
+
+    //close current message and continue the transaction in next one
+    void Writer::split() {
+        commitTran();
+        commandBuffer->rewind();
+        ++tranSeq;
+        if (tranProvisional)
+            beginProvisional(tranScn, tranXid);
+        else
+            beginTran(tranScn, tranXid);
+    }
+
+    //separator between operations, new message when table changes or every row has own key
+    void Writer::beginOp(OracleObject *object, bool hasPrev) {
+        if (hasPrev) {
+            uint32_t route = commandBuffer->messageRoute();
+            if (format == MESSAGE_FORMAT_ROW || route == MESSAGE_ROUTE_KEY ||
+                    (route == MESSAGE_ROUTE_TABLE && commandBuffer->tranObject != object))
+                split();
+            else
+                next();
+        }
+        commandBuffer->addObject(object);
+    }
+
+    //separator between rows of one operation
+    void Writer::nextRow(OracleObject *object) {
+        if (format == MESSAGE_FORMAT_ROW || commandBuffer->messageRoute() == MESSAGE_ROUTE_KEY) {
+            split();
+            commandBuffer->addObject(object);
+        } else
+            next();
+    }
+
+    //row key is built from primary key columns, rowid is used for tables without primary key
+    void Writer::beginKey(OracleObject *object, uint32_t objd, uint32_t bdba, uint16_t slot) {
+        keyActive = (commandBuffer->messageRoute() == MESSAGE_ROUTE_KEY);
+        if (!keyActive)
+            return;
+
+        keyRowid = (objd * 31 + bdba) * 31 + slot;
+        keyFound = 0;
+        keyTotal = object->totalPk;
+        keyParts.assign(object->totalCols, 0);
+    }
+
+    void Writer::addKey(OracleColumn *column, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength) {
+        if (!keyActive || column->numPk == 0 || column->segColNo == 0 || column->segColNo > keyParts.size())
+            return;
+
+        //FNV-1a
+        uint32_t hash = 2166136261;
+        for (uint32_t i = 0; i < fieldLength; ++i)
+            hash = (hash ^ redoLogRecord->data[fieldPos + i]) * 16777619;
+        if (keyParts[column->segColNo - 1] == 0)
+            ++keyFound;
+        keyParts[column->segColNo - 1] = hash | 1;
+    }
+
+    void Writer::endKey() {
+        if (!keyActive)
+            return;
+
+        if (keyTotal == 0 || keyFound < keyTotal) {
+            commandBuffer->addKey(keyRowid);
+        } else {
+            uint32_t key = 0;
+            for (uint32_t part : keyParts)
+                key = key * 31 + part;
+            commandBuffer->addKey(key);
+        }
+        keyActive = false;
     }
 
     Writer::~Writer() {
+        if (compressor != nullptr) {
+            delete compressor;
+            compressor = nullptr;
+        }
     }
 
     void Writer::appendValue(RedoLogRecord *redoLogRecord, uint32_t typeNo, uint32_t fieldPos, uint32_t fieldLength) {
-        uint32_t j, jMax; uint8_t digits;
+        //upper bound of formatted value: escaped text, digits with exponent padding or date
+        commandBuffer->reserve(fieldLength * 2 + 128);
 
         switch(typeNo) {
         case 1: //varchar(2)
@@ -47,194 +167,24 @@ namespace OpenLogReplicator {
             break;
 
         case 2: //numeric
-            digits = redoLogRecord->data[fieldPos + 0];
-            //just zero
-            if (digits == 0x80) {
-                commandBuffer->append('0');
-                break;
-            }
-
-            j = 1;
-            jMax = fieldLength - 1;
-
-            //positive number
-            if (digits >= 0xC0 && jMax >= 1) {
-                uint32_t val;
-                //part of the total
-                if (digits == 0xC0)
-                    commandBuffer->append('0');
-                else {
-                    digits -= 0xC0;
-                    //part of the total - omitting first zero for first digit
-                    val = redoLogRecord->data[fieldPos + j] - 1;
-                    if (val < 10)
-                        commandBuffer->append('0' + val);
-                    else
-                        commandBuffer
-                                ->append('0' + (val / 10))
-                                ->append('0' + (val % 10));
-
-                    ++j;
-                    --digits;
-
-                    while (digits > 0) {
-                        val = redoLogRecord->data[fieldPos + j] - 1;
-                        if (j <= jMax) {
-                            commandBuffer
-                                    ->append('0' + (val / 10))
-                                    ->append('0' + (val % 10));
-                            ++j;
-                        } else {
-                            commandBuffer->append("00");
-                        }
-                        --digits;
-                    }
-                }
-
-                //fraction part
-                if (j <= jMax) {
-                    commandBuffer->append('.');
-
-                    while (j <= jMax - 1) {
-                        val = redoLogRecord->data[fieldPos + j] - 1;
-                        commandBuffer
-                                ->append('0' + (val / 10))
-                                ->append('0' + (val % 10));
-                        ++j;
-                    }
-
-                    //last digit - omitting 0 at the end
-                    val = redoLogRecord->data[fieldPos + j] - 1;
-                    commandBuffer->append('0' + (val / 10));
-                    if ((val % 10) != 0)
-                        commandBuffer->append('0' + (val % 10));
-                }
-            //negative number
-            } else if (digits <= 0x3F && fieldLength >= 2) {
-                uint32_t val;
-                commandBuffer->append('-');
-
-                if (redoLogRecord->data[fieldPos + jMax] == 0x66)
-                    --jMax;
-
-                //part of the total
-                if (digits == 0x3F)
-                    commandBuffer->append('0');
-                else {
-                    digits = 0x3F - digits;
-
-                    val = 101 - redoLogRecord->data[fieldPos + j];
-                    if (val < 10)
-                        commandBuffer->append('0' + val);
-                    else
-                        commandBuffer
-                                ->append('0' + (val / 10))
-                                ->append('0' + (val % 10));
-                    ++j;
-                    --digits;
-
-                    while (digits > 0) {
-                        if (j <= jMax) {
-                            val = 101 - redoLogRecord->data[fieldPos + j];
-                            commandBuffer
-                                    ->append('0' + (val / 10))
-                                    ->append('0' + (val % 10));
-                            ++j;
-                        } else {
-                            commandBuffer->append("00");
-                        }
-                        --digits;
-                    }
-                }
-
-                if (j <= jMax) {
-                    commandBuffer->append('.');
-
-                    while (j <= jMax - 1) {
-                        val = 101 - redoLogRecord->data[fieldPos + j];
-                        commandBuffer
-                                ->append('0' + (val / 10))
-                                ->append('0' + (val % 10));
-                        ++j;
-                    }
-
-                    val = 101 - redoLogRecord->data[fieldPos + j];
-                    commandBuffer->append('0' + (val / 10));
-                    if ((val % 10) != 0)
-                        commandBuffer->append('0' + (val % 10));
-                }
-            } else {
+            if (!commandBuffer->appendNumber(redoLogRecord->data + fieldPos, fieldLength)) {
                 cerr << "ERROR: unknown value (type: " << typeNo << "): " << dec << fieldLength << " - ";
                 for (uint32_t j = 0; j < fieldLength; ++j)
                     cout << " " << hex << setw(2) << (uint32_t) redoLogRecord->data[fieldPos + j];
                 cout << endl;
             }
             break;
-        case 12:
-        case 180:
-            //2012-04-23T18:25:43.511Z - ISO 8601 format
-            jMax = fieldLength;
-
-            if (jMax != 7) {
+        case ORACLE_TYPE_DATE:
+        case ORACLE_TYPE_TIMESTAMP:
+        case ORACLE_TYPE_TIMESTAMP_TZ:
+        case ORACLE_TYPE_INTERVAL_YM:
+        case ORACLE_TYPE_INTERVAL_DS:
+        case ORACLE_TYPE_TIMESTAMP_LTZ:
+            if (!commandBuffer->appendTime(typeNo, redoLogRecord->data + fieldPos, fieldLength)) {
                 cerr << "ERROR: unknown value (type: " << typeNo << "): ";
                 for (uint32_t j = 0; j < fieldLength; ++j)
                     cout << " " << hex << setw(2) << (uint32_t) redoLogRecord->data[fieldPos + j];
                 cout << endl;
-            } else {
-                uint32_t val1 = redoLogRecord->data[fieldPos + 0],
-                         val2 = redoLogRecord->data[fieldPos + 1];
-                bool bc = false;
-
-                //AD
-                if (val1 >= 100 && val2 >= 100) {
-                    val1 -= 100;
-                    val2 -= 100;
-                //BC
-                } else {
-                    val1 = 100 - val1;
-                    val2 = 100 - val2;
-                    bc = true;
-                }
-                if (val1 > 0) {
-                    if (val1 > 10)
-                        commandBuffer
-                                ->append('0' + (val1 / 10))
-                                ->append('0' + (val1 % 10))
-                                ->append('0' + (val2 / 10))
-                                ->append('0' + (val2 % 10));
-                    else
-                        commandBuffer
-                                ->append('0' + val1)
-                                ->append('0' + (val2 / 10))
-                                ->append('0' + (val2 % 10));
-                } else {
-                    if (val2 > 10)
-                        commandBuffer
-                                ->append('0' + (val2 / 10))
-                                ->append('0' + (val2 % 10));
-                    else
-                        commandBuffer->append('0' + val2);
-                }
-
-                if (bc)
-                    commandBuffer->append("BC");
-
-                commandBuffer
-                        ->append('-')
-                        ->append('0' + (redoLogRecord->data[fieldPos + 2] / 10))
-                        ->append('0' + (redoLogRecord->data[fieldPos + 2] % 10))
-                        ->append('-')
-                        ->append('0' + (redoLogRecord->data[fieldPos + 3] / 10))
-                        ->append('0' + (redoLogRecord->data[fieldPos + 3] % 10))
-                        ->append('T')
-                        ->append('0' + ((redoLogRecord->data[fieldPos + 4] - 1) / 10))
-                        ->append('0' + ((redoLogRecord->data[fieldPos + 4] - 1) % 10))
-                        ->append(':')
-                        ->append('0' + ((redoLogRecord->data[fieldPos + 5] - 1) / 10))
-                        ->append('0' + ((redoLogRecord->data[fieldPos + 5] - 1) % 10))
-                        ->append(':')
-                        ->append('0' + ((redoLogRecord->data[fieldPos + 6] - 1) / 10))
-                        ->append('0' + ((redoLogRecord->data[fieldPos + 6] - 1) % 10));
             }
             break;
         default:
@@ -18,6 +18,7 @@ along with Open Log Replicator; see the file LICENSE.txt  If not see
 <http://www.gnu.org/licenses/>.  */
 
 #include <string>
+#include <vector>
 #include <pthread.h>
 #include "types.h"
 #include "Thread.h"
@@ -33,27 +34,62 @@ namespace OpenLogReplicator {
 #define TRANSACTION_DELETE 2
 #define TRANSACTION_UPDATE 3
 
+#define MESSAGE_FORMAT_TRANSACTION 0
+#define MESSAGE_FORMAT_ROW 1
+
     class CommandBuffer;
     class RedoLogRecord;
     class OracleEnvironment;
+    class OracleObject;
+    class OracleColumn;
+    class Compressor;
 
     class Writer : public Thread {
+    protected:
+        typescn tranScn;
+        typexid tranXid;
+        bool tranProvisional;
+        uint64_t tranSeq;                           //message number in transaction
+        uint32_t format;
+        bool markers;                               //begin and commit messages around rows of transaction
+        bool keyActive;
+        uint32_t keyRowid;
+        uint32_t keyFound;
+        uint32_t keyTotal;
+        vector<uint32_t> keyParts;                  //hash of primary key columns by column position
 
     public:
+        uint32_t consumer;                          //position in source buffer
+        Compressor *compressor;                     //optional, compresses messages before they reach the sink
+
+        void begin(typescn scn, typexid xid, bool provisional);
+        void end();
+        void split();
+        void beginOp(OracleObject *object, bool hasPrev);
+        void nextRow(OracleObject *object);
+        void beginKey(OracleObject *object, uint32_t objd, uint32_t bdba, uint16_t slot);
+        void addKey(OracleColumn *column, RedoLogRecord *redoLogRecord, uint32_t fieldPos, uint32_t fieldLength);
+        void endKey();
+
         void terminate(void);
         virtual void *run() = 0;
         int initialize();
 
         void appendValue(RedoLogRecord *redoLogRecord, uint32_t typeNo, uint32_t fieldPos, uint32_t fieldLength);
         virtual void beginTran(typescn scn, typexid xid) = 0;
+        virtual void beginProvisional(typescn scn, typexid xid) = 0;
+        virtual void beginMarker(typescn scn, typexid xid) = 0;
+        virtual void endTran(typescn scn, typexid xid, bool rollback, bool partial) = 0;
+        virtual void rollbackSavepoint(typescn scn, typexid xid, typeuba uba) = 0;
         virtual void next() = 0;
         virtual void commitTran() = 0;
         virtual void parseInsertMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) = 0;
         virtual void parseDeleteMultiple(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, OracleEnvironment *oracleEnvironment) = 0;
         virtual void parseDML(RedoLogRecord *redoLogRecord1, RedoLogRecord *redoLogRecord2, uint32_t type, OracleEnvironment *oracleEnvironment) = 0;
         virtual void parseDDL(RedoLogRecord *redoLogRecord1, OracleEnvironment *oracleEnvironment) = 0;
+        virtual Writer *clone(CommandBuffer *commandBuffer) = 0;
 
-        Writer(const string alias, CommandBuffer *commandBuffer);
+        Writer(const string alias, CommandBuffer *commandBuffer, uint32_t format, bool markers);
         virtual ~Writer();
     };
 }
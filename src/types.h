@@ -39,9 +39,11 @@ typedef uint32_t typeseq;
 #define REDO_PAGE_SIZE_MIN 512
 #define REDO_PAGE_SIZE_MAX 1024
 #define READ_CHUNK_MIN_SIZE 8192
-#define MAX_CONCURRENT_TRANSACTIONS 2048
 #define TRANSACTION_BUFFER_CHUNK_SIZE (65536*2)
-#define TRANSACTION_BUFFER_CHUNK_NUM (16384/2)
+#define TRANSACTION_BUFFER_CLASSES 3
+#define TRANSACTION_BUFFER_EXTENT_SIZE (8*1024*1024)
+#define TRANSACTION_BUFFER_MEMORY_DEFAULT 1024
+#define TRANSACTION_BUFFER_SHRINK_SECONDS 10
 
 #define REDO_OK                      0
 #define REDO_WRONG_SEQUENCE          1
@@ -55,6 +57,7 @@ typedef uint32_t typeseq;
 #define SLT(xid) ((uint16_t)(((((uint64_t)xid)>>32)&0xFFFF)))
 #define SQN(xid) ((uint32_t)(((xid)&0xFFFFFFFF)))
 #define XID(usn,slt,sqn) ((((uint64_t)(usn))<<48)|(((uint64_t)(slt))<<32)|((uint64_t)(sqn)))
+#define USNSLT(usn,slt) ((((uint32_t)(usn))<<16)|((uint32_t)(slt)))
 #define PRINTXID(xid) "0x"<<setfill('0')<<setw(4)<<hex<<USN(xid)<<"."<<setw(3)<<SLT(xid)<<"."<<setw(8)<<SQN(xid)
 
 #define BLOCK(uba) ((uint32_t)((uba)&0xFFFFFFFF))